@@ -0,0 +1,601 @@
+// Weather CLI Pro - microbenchmark suite
+// Times the hot paths that decide how fast a lookup feels: decoding forecast
+// payloads, the Utils helpers, cache hits and misses, and drawing full screens.
+// Every case reports ns/op plus heap allocations per op; --json writes the same
+// numbers in a stable format, and --baseline compares against an earlier run.
+//
+//   weather-bench                          # table on stdout
+//   weather-bench --json --out bench.json  # machine-readable results
+//   weather-bench --baseline bench.json --max-regression 10
+//   weather-bench --filter decode/         # only matching cases
+
+#define WEATHER_CLI_NO_MAIN
+#include "../weather_cli.cpp"
+
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <regex>
+
+// Allocation accounting: every block carries its size in a small header so
+// allocations and bytes per operation can be reported next to the timings.
+// GCC inlines these into std containers and then misreads the header offset.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Warray-bounds"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace alloc_stats {
+std::atomic<size_t> count{0};
+std::atomic<size_t> bytes{0};
+
+constexpr size_t HEADER = alignof(std::max_align_t);
+}
+
+void* operator new(std::size_t size) {
+    auto* block = static_cast<unsigned char*>(std::malloc(size + alloc_stats::HEADER));
+    if (!block) throw std::bad_alloc();
+    *reinterpret_cast<std::size_t*>(block) = size;
+    alloc_stats::count.fetch_add(1, std::memory_order_relaxed);
+    alloc_stats::bytes.fetch_add(size, std::memory_order_relaxed);
+    return block + alloc_stats::HEADER;
+}
+
+void operator delete(void* ptr) noexcept {
+    if (!ptr) return;
+    std::free(static_cast<unsigned char*>(ptr) - alloc_stats::HEADER);
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete[](void* ptr) noexcept { operator delete(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { operator delete(ptr); }
+
+namespace {
+
+// Keeps results observable so the optimizer cannot drop the measured work
+volatile size_t sink;
+
+// Mirrors the shape and field set of a real forecast.json response,
+// including the many fields the CLI never reads.
+json make_condition(int code) {
+    return {{"text", "Patchy rain nearby"},
+            {"icon", "//cdn.weatherapi.com/weather/64x64/day/176.png"},
+            {"code", code}};
+}
+
+std::string make_forecast(int days) {
+    json data;
+    data["location"] = {{"name", "London"}, {"region", "City of London, Greater London"},
+                        {"country", "United Kingdom"}, {"lat", 51.52}, {"lon", -0.11},
+                        {"tz_id", "Europe/London"}, {"localtime_epoch", 1760691600},
+                        {"localtime", "2025-10-17 10:00"}};
+    data["current"] = {{"last_updated_epoch", 1760691600}, {"last_updated", "2025-10-17 10:00"},
+                       {"temp_c", 12.3}, {"temp_f", 54.1}, {"is_day", 1}, {"condition", make_condition(1063)},
+                       {"wind_mph", 9.4}, {"wind_kph", 15.1}, {"wind_degree", 230}, {"wind_dir", "SW"},
+                       {"pressure_mb", 1012.0}, {"pressure_in", 29.88}, {"precip_mm", 0.1}, {"precip_in", 0.0},
+                       {"humidity", 77}, {"cloud", 75}, {"feelslike_c", 10.9}, {"feelslike_f", 51.6},
+                       {"windchill_c", 9.8}, {"windchill_f", 49.6}, {"heatindex_c", 12.0}, {"heatindex_f", 53.6},
+                       {"dewpoint_c", 7.9}, {"dewpoint_f", 46.2}, {"vis_km", 10.0}, {"vis_miles", 6.0},
+                       {"uv", 1.4}, {"gust_mph", 13.2}, {"gust_kph", 21.2},
+                       {"air_quality", {{"co", 250.3}, {"no2", 18.7}, {"o3", 42.0}, {"so2", 3.1},
+                                        {"pm2_5", 6.4}, {"pm10", 9.2}, {"us-epa-index", 1}, {"gb-defra-index", 1}}}};
+
+    json forecast_days = json::array();
+    for (int d = 0; d < days; ++d) {
+        std::string date = "2025-10-" + std::to_string(17 + d);
+        json day;
+        day["date"] = date;
+        day["date_epoch"] = 1760659200 + d * 86400;
+        day["day"] = {{"maxtemp_c", 15.2 + d}, {"maxtemp_f", 59.4}, {"mintemp_c", 8.1}, {"mintemp_f", 46.6},
+                      {"avgtemp_c", 11.7}, {"avgtemp_f", 53.1}, {"maxwind_mph", 12.5}, {"maxwind_kph", 20.2},
+                      {"totalprecip_mm", 1.3}, {"totalprecip_in", 0.05}, {"totalsnow_cm", 0.0},
+                      {"avgvis_km", 9.6}, {"avgvis_miles", 5.0}, {"avghumidity", 79},
+                      {"daily_will_it_rain", 1}, {"daily_chance_of_rain", 86},
+                      {"daily_will_it_snow", 0}, {"daily_chance_of_snow", 0},
+                      {"condition", make_condition(1063)}, {"uv", 1.0}};
+        day["astro"] = {{"sunrise", "07:28 AM"}, {"sunset", "06:01 PM"}, {"moonrise", "03:12 AM"},
+                        {"moonset", "04:45 PM"}, {"moon_phase", "Waning Crescent"},
+                        {"moon_illumination", 18}, {"is_moon_up", 0}, {"is_sun_up", 0}};
+        json hours = json::array();
+        for (int h = 0; h < 24; ++h) {
+            char time[32];
+            std::snprintf(time, sizeof(time), "%s %02d:00", date.c_str(), h);
+            hours.push_back({{"time_epoch", 1760659200 + d * 86400 + h * 3600}, {"time", time},
+                             {"temp_c", 9.0 + h * 0.25}, {"temp_f", 48.2}, {"is_day", h >= 7 && h < 18 ? 1 : 0},
+                             {"condition", make_condition(1063)}, {"wind_mph", 8.7}, {"wind_kph", 14.0},
+                             {"wind_degree", 224}, {"wind_dir", "SW"}, {"pressure_mb", 1011.0},
+                             {"pressure_in", 29.86}, {"precip_mm", 0.05}, {"precip_in", 0.0},
+                             {"snow_cm", 0.0}, {"humidity", 82}, {"cloud", 91}, {"feelslike_c", 7.1},
+                             {"feelslike_f", 44.8}, {"windchill_c", 7.1}, {"windchill_f", 44.8},
+                             {"heatindex_c", 9.0}, {"heatindex_f", 48.2}, {"dewpoint_c", 6.2},
+                             {"dewpoint_f", 43.2}, {"will_it_rain", 1}, {"chance_of_rain", 73},
+                             {"will_it_snow", 0}, {"chance_of_snow", 0}, {"vis_km", 10.0},
+                             {"vis_miles", 6.0}, {"gust_mph", 12.9}, {"gust_kph", 20.8}, {"uv", 0.0}});
+        }
+        day["hour"] = std::move(hours);
+        forecast_days.push_back(std::move(day));
+    }
+    data["forecast"] = {{"forecastday", std::move(forecast_days)}};
+    data["alerts"] = {{"alert", json::array({{{"headline", "Yellow warning for rain"}, {"severity", "Moderate"},
+                                             {"urgency", "Expected"}, {"areas", "London & South East England"},
+                                             {"category", "Met"}, {"event", "Rain"}, {"note", ""},
+                                             {"effective", "2025-10-17T06:00:00+00:00"},
+                                             {"expires", "2025-10-18T06:00:00+00:00"},
+                                             {"desc", "Heavy rain may lead to some disruption."},
+                                             {"instruction", ""}}})}};
+    return data.dump();
+}
+
+// The Utils string helpers as they were before the string_view rewrite, kept
+// so the */legacy cases show what the allocation-free versions save
+namespace legacy {
+std::string url_encode(const std::string& str) {
+    std::string encoded_str = "";
+    for (char c : str) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded_str += c;
+        } else if (c == ' ') {
+            encoded_str += "%20";
+        } else {
+            std::ostringstream oss;
+            oss << '%' << std::setw(2) << std::setfill('0') << std::hex << static_cast<int>(static_cast<unsigned char>(c));
+            encoded_str += oss.str();
+        }
+    }
+    return encoded_str;
+}
+
+std::vector<std::string> split(const std::string& str, char delimiter) {
+    std::vector<std::string> tokens;
+    std::stringstream ss(str);
+    std::string token;
+    while (std::getline(ss, token, delimiter)) {
+        tokens.push_back(Utils::trim(token));
+    }
+    return tokens;
+}
+
+bool is_valid_ip(const std::string& ip) {
+    std::regex ip_regex(R"(^(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)$)");
+    return std::regex_match(ip, ip_regex);
+}
+}  // namespace legacy
+
+struct Options {
+    bool json_output = false;
+    std::string out_path;
+    std::string filter;
+    std::string baseline_path;
+    double max_regression = -1;  // percent; negative only reports
+    double min_time = 0.5;       // seconds per case, split across the samples
+    int samples = 5;
+};
+
+// A case runs `batch` operations per call so per-call overhead stays out of
+// fast cases; counters() adds case-specific figures such as bytes written.
+struct Case {
+    std::string name;
+    std::function<void(size_t batch)> run;
+    size_t bytes_per_op = 0;  // input consumed per op, for MB/s
+    std::function<std::vector<std::pair<std::string, double>>(size_t ops)> counters;
+};
+
+struct Result {
+    std::string name;
+    size_t iterations = 0;
+    double ns_per_op = 0;  // median sample
+    double min_ns = 0;
+    double max_ns = 0;
+    double allocs_per_op = 0;
+    double alloc_bytes_per_op = 0;
+    double mb_per_s = 0;
+    std::vector<std::pair<std::string, double>> counters;
+};
+
+struct IoCounters {
+    size_t bytes = 0;
+    size_t writes = 0;
+};
+
+IoCounters read_io() {
+    IoCounters io;
+    std::ifstream file("/proc/self/io");
+    std::string key;
+    size_t value = 0;
+    while (file >> key >> value) {
+        if (key == "wchar:") io.bytes = value;
+        if (key == "syscw:") io.writes = value;
+    }
+    return io;
+}
+
+Result measure(const Case& c, const Options& options) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds_for = [&](size_t ops) {
+        auto start = Clock::now();
+        c.run(ops);
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // Warm up, then size one sample to its share of the time budget
+    seconds_for(1);
+    size_t ops = 1;
+    double target = options.min_time / options.samples;
+    double elapsed;
+    while ((elapsed = seconds_for(ops)) < target / 4 && ops < (size_t(1) << 30)) ops *= 4;
+    ops = std::max<size_t>(1, static_cast<size_t>(static_cast<double>(ops) * target / std::max(elapsed, 1e-9)));
+
+    Result result;
+    result.name = c.name;
+    std::vector<double> sample_ns;
+    size_t alloc_count = alloc_stats::count.load();
+    size_t alloc_bytes = alloc_stats::bytes.load();
+    IoCounters io_before = read_io();
+    for (int i = 0; i < options.samples; ++i) {
+        sample_ns.push_back(seconds_for(ops) * 1e9 / static_cast<double>(ops));
+    }
+    IoCounters io_after = read_io();
+    size_t total_ops = ops * static_cast<size_t>(options.samples);
+    result.iterations = total_ops;
+    result.allocs_per_op = static_cast<double>(alloc_stats::count.load() - alloc_count) / static_cast<double>(total_ops);
+    result.alloc_bytes_per_op = static_cast<double>(alloc_stats::bytes.load() - alloc_bytes) / static_cast<double>(total_ops);
+
+    std::sort(sample_ns.begin(), sample_ns.end());
+    result.ns_per_op = sample_ns[sample_ns.size() / 2];
+    result.min_ns = sample_ns.front();
+    result.max_ns = sample_ns.back();
+    if (c.bytes_per_op > 0) {
+        result.mb_per_s = static_cast<double>(c.bytes_per_op) / result.ns_per_op * 1e9 / (1024.0 * 1024.0);
+    }
+    if (c.counters) {
+        result.counters = c.counters(total_ops);
+        for (auto& [name, value] : result.counters) {
+            if (name == "write_bytes_per_op") value = static_cast<double>(io_after.bytes - io_before.bytes) / static_cast<double>(total_ops);
+            if (name == "write_calls_per_op") value = static_cast<double>(io_after.writes - io_before.writes) / static_cast<double>(total_ops);
+        }
+    }
+    return result;
+}
+
+// Points stdout at a pseudo-terminal so rendering cases see the same stdio
+// line buffering as an interactive session; a thread drains the other side.
+bool attach_terminal(std::thread& drain) {
+#ifdef __linux__
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) return false;
+    int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+    if (slave < 0 || dup2(slave, STDOUT_FILENO) < 0) return false;
+    close(slave);
+    drain = std::thread([master]() {
+        char buffer[65536];
+        while (read(master, buffer, sizeof(buffer)) > 0) {}
+    });
+    return true;
+#else
+    (void)drain;
+    return false;
+#endif
+}
+
+std::vector<Case> build_cases() {
+    std::vector<Case> cases;
+
+    // Forecast decoding: full DOM, DOM plus typed decode, streaming SAX decode
+    for (int days : {3, 14}) {
+        auto body = std::make_shared<std::string>(make_forecast(days));
+        std::string suffix = "_" + std::to_string(days) + "day";
+        cases.push_back({"json/parse" + suffix, [body](size_t n) {
+            for (size_t i = 0; i < n; ++i) sink = json::parse(*body).size();
+        }, body->size(), nullptr});
+        cases.push_back({"decode/dom" + suffix, [body](size_t n) {
+            for (size_t i = 0; i < n; ++i) sink = WeatherDecoder::decode(json::parse(*body)).hours.size();
+        }, body->size(), nullptr});
+        cases.push_back({"decode/sax" + suffix, [body](size_t n) {
+            for (size_t i = 0; i < n; ++i) sink = WeatherSaxDecoder::decode(*body).hours.size();
+        }, body->size(), nullptr});
+    }
+
+    // Utils helpers, each over a small mix of realistic inputs
+    auto locations = std::make_shared<std::vector<std::string>>(std::vector<std::string>{
+        "London", "New York", "São Paulo", "48.8566,2.3522", "Frankfurt am Main, DE", "10001"});
+    cases.push_back({"utils/url_encode", [locations](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = Utils::url_encode((*locations)[i % locations->size()]).size();
+    }, 0, nullptr});
+    cases.push_back({"utils/url_encode_to", [locations](size_t n) {
+        std::string buffer;
+        for (size_t i = 0; i < n; ++i) {
+            buffer.clear();
+            Utils::url_encode_to(buffer, (*locations)[i % locations->size()]);
+            sink = buffer.size();
+        }
+    }, 0, nullptr});
+    cases.push_back({"utils/url_encode_legacy", [locations](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = legacy::url_encode((*locations)[i % locations->size()]).size();
+    }, 0, nullptr});
+    auto line = std::make_shared<std::string>("London\tUnited Kingdom\t12.3\t10.9\tPartly cloudy\t77\t15.1\tSW");
+    cases.push_back({"utils/split", [line](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = Utils::split(*line, '\t').size();
+    }, line->size(), nullptr});
+    cases.push_back({"utils/split_view", [line](size_t n) {
+        std::vector<std::string_view> tokens;
+        for (size_t i = 0; i < n; ++i) sink = Utils::split_view(*line, '\t', tokens);
+    }, line->size(), nullptr});
+    cases.push_back({"utils/split_legacy", [line](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = legacy::split(*line, '\t').size();
+    }, line->size(), nullptr});
+    auto conditions = std::make_shared<std::vector<std::string>>(std::vector<std::string>{
+        "Sunny", "Partly cloudy", "Patchy rain nearby", "Moderate snow", "Thundery outbreaks possible",
+        "Freezing fog", "Overcast"});
+    auto codes = std::make_shared<std::vector<int>>(std::vector<int>{1000, 1003, 1063, 1219, 1087, 1147, 1009});
+    cases.push_back({"utils/get_weather_icon", [codes, conditions](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            size_t k = i % codes->size();
+            sink = Utils::get_weather_icon((*codes)[k], (*conditions)[k]).size();
+        }
+    }, 0, nullptr});
+    cases.push_back({"utils/get_weather_icon_text", [conditions](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = Utils::get_weather_icon(0, (*conditions)[i % conditions->size()]).size();
+    }, 0, nullptr});
+    auto addresses = std::make_shared<std::vector<std::string>>(std::vector<std::string>{
+        "8.8.8.8", "192.168.001.254", "256.1.1.1", "10.0.0", "2001:db8::1", "::ffff:10.1.2.3", "not an ip"});
+    cases.push_back({"utils/is_valid_ip", [addresses](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = Utils::is_valid_ip((*addresses)[i % addresses->size()]);
+    }, 0, nullptr});
+    cases.push_back({"utils/is_valid_ip_legacy", [addresses](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = legacy::is_valid_ip((*addresses)[i % addresses->size()]);
+    }, 0, nullptr});
+
+    // Cache paths: in-memory hit and miss, the full HttpClient::fetch hit path,
+    // and the persistent cache in a scratch directory
+    std::string url = WeatherService::forecast_url("London", 3);
+    CacheQuery query;
+    CacheQuery::parse(url, query);
+    std::string key = query.cache_key();
+    std::string forecast = make_forecast(3);
+    ResponseCache::put(key, std::make_shared<const json>(json::parse(forecast)));
+    DiskCache::store(key, forecast);
+    auto max_age = std::chrono::duration_cast<ResponseCache::Clock::duration>(HttpClient::CACHE_DURATION);
+    cases.push_back({"cache/memory_hit", [key, max_age](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = ResponseCache::get(key, max_age) != nullptr;
+    }, 0, nullptr});
+    cases.push_back({"cache/memory_miss", [key, max_age](size_t n) {
+        std::string missing = key + "&miss";
+        for (size_t i = 0; i < n; ++i) sink = ResponseCache::get(missing, max_age) != nullptr;
+    }, 0, nullptr});
+    cases.push_back({"cache/fetch_hit", [url](size_t n) {
+        for (size_t i = 0; i < n; ++i) sink = HttpClient::fetch(url) != nullptr;
+    }, 0, nullptr});
+    cases.push_back({"cache/disk_hit", [key](size_t n) {
+        std::string body;
+        for (size_t i = 0; i < n; ++i) sink = DiskCache::load(key, std::chrono::seconds(300), body);
+    }, forecast.size(), nullptr});
+    cases.push_back({"cache/disk_miss", [key](size_t n) {
+        std::string body;
+        std::string missing = key + "&miss";
+        for (size_t i = 0; i < n; ++i) sink = DiskCache::load(missing, std::chrono::seconds(300), body);
+    }, 0, nullptr});
+
+    // Nearest cached place for a coordinate query, over 20000 places in a
+    // 2 x 4 degree area (a dense metro region) plus a world-wide sprinkle
+    for (int i = 0; i < 20000; ++i) {
+        double lat = 50 + (i % 200) * 0.01, lon = -2 + (i / 200) * 0.04;
+        PlaceIndex::insert(lat, lon, "place" + std::to_string(i));
+        if (i % 4 == 0) PlaceIndex::insert(-60 + (i % 120), -180 + (i % 359), "world" + std::to_string(i));
+    }
+    cases.push_back({"cache/nearest_place", [](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            double jitter = static_cast<double>(i % 97) * 0.013;
+            sink = PlaceIndex::nearest(50.5 + jitter, -1 + jitter, 1.0, 4).size();
+        }
+    }, 0, nullptr});
+
+    // Watch scheduling: 10000 sites in a 300s cycle on the 100ms wheel; one op
+    // is one tick, expiring and rescheduling whatever came due
+    cases.push_back({"watch/timer_wheel_tick", [](size_t n) {
+        const auto tick = std::chrono::milliseconds(100);
+        const auto interval = std::chrono::duration_cast<TimerWheel::Clock::duration>(std::chrono::seconds(300));
+        TimerWheel::Clock::time_point start{};
+        TimerWheel wheel(tick, 1024, start);
+        for (size_t i = 0; i < 10000; ++i) wheel.schedule(i, interval * static_cast<long>(i) / 10000);
+        std::vector<size_t> due;
+        for (size_t i = 1; i <= n; ++i) {
+            due.clear();
+            wheel.advance(start + tick * static_cast<long>(i), due);
+            for (size_t id : due) wheel.schedule(id, interval);
+            sink = due.size();
+        }
+    }, 0, nullptr});
+
+    // Full screens drawn into the pseudo-terminal through Frame, as the menu does,
+    // and straight through std::cout for comparison
+    auto report = std::make_shared<WeatherReport>(WeatherSaxDecoder::decode(make_forecast(7)));
+    auto screen_counters = [](size_t) {
+        return std::vector<std::pair<std::string, double>>{{"write_bytes_per_op", 0}, {"write_calls_per_op", 0}};
+    };
+    auto framed = [](std::function<void()> draw) {
+        return [draw](size_t n) {
+            Frame::install();
+            for (size_t i = 0; i < n; ++i) {
+                draw();
+                Frame::present();
+            }
+            Frame::uninstall();
+        };
+    };
+    auto current = [report]() { WeatherDisplay::render_current_weather(*report, "London"); };
+    auto extended = [report]() { WeatherDisplay::render_extended_forecast(*report); };
+    cases.push_back({"render/current_screen", framed(current), 0, screen_counters});
+    cases.push_back({"render/forecast_screen", framed(extended), 0, screen_counters});
+    cases.push_back({"render/current_screen_cout", [current](size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            current();
+            std::cout.flush();
+        }
+    }, 0, screen_counters});
+    return cases;
+}
+
+std::map<std::string, double> load_baseline(const std::string& path) {
+    std::map<std::string, double> baseline;
+    std::ifstream file(path);
+    if (!file) throw std::runtime_error("cannot open baseline " + path);
+    json data = json::parse(file);
+    for (const auto& result : data.at("results")) {
+        baseline[result.at("name").get<std::string>()] = result.at("ns_per_op").get<double>();
+    }
+    return baseline;
+}
+
+std::string to_json(const std::vector<Result>& results, const Options& options) {
+    nlohmann::ordered_json document;
+    document["suite"] = "weather-bench";
+    document["version"] = VERSION;
+#if defined(__clang__)
+    document["compiler"] = "clang " __clang_version__;
+#elif defined(__GNUC__)
+    document["compiler"] = "gcc " __VERSION__;
+#else
+    document["compiler"] = "unknown";
+#endif
+    document["timestamp"] = Utils::get_current_time();
+    document["samples"] = options.samples;
+    document["results"] = nlohmann::ordered_json::array();
+    for (const auto& r : results) {
+        nlohmann::ordered_json entry;
+        entry["name"] = r.name;
+        entry["iterations"] = r.iterations;
+        entry["ns_per_op"] = r.ns_per_op;
+        entry["min_ns_per_op"] = r.min_ns;
+        entry["max_ns_per_op"] = r.max_ns;
+        entry["allocs_per_op"] = r.allocs_per_op;
+        entry["alloc_bytes_per_op"] = r.alloc_bytes_per_op;
+        if (r.mb_per_s > 0) entry["mb_per_s"] = r.mb_per_s;
+        for (const auto& [name, value] : r.counters) entry[name] = value;
+        document["results"].push_back(std::move(entry));
+    }
+    return document.dump(2) + "\n";
+}
+
+void print_table(FILE* out, const std::vector<Result>& results, const std::map<std::string, double>& baseline) {
+    std::fprintf(out, "%-28s %12s %10s %12s %9s%s\n", "case", "ns/op", "allocs/op", "alloc B/op", "MB/s",
+                 baseline.empty() ? "" : "  vs baseline");
+    for (const auto& r : results) {
+        std::fprintf(out, "%-28s %12.1f %10.1f %12.0f ", r.name.c_str(), r.ns_per_op, r.allocs_per_op,
+                     r.alloc_bytes_per_op);
+        if (r.mb_per_s > 0) std::fprintf(out, "%9.1f", r.mb_per_s);
+        else std::fprintf(out, "%9s", "-");
+        auto found = baseline.find(r.name);
+        if (found != baseline.end()) std::fprintf(out, "  %+6.1f%%", (r.ns_per_op / found->second - 1) * 100);
+        for (const auto& [name, value] : r.counters) std::fprintf(out, "  %s=%.1f", name.c_str(), value);
+        std::fprintf(out, "\n");
+    }
+}
+
+Options parse_options(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::runtime_error("missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--json") options.json_output = true;
+        else if (arg == "--out") options.out_path = value();
+        else if (arg == "--filter") options.filter = value();
+        else if (arg == "--baseline") options.baseline_path = value();
+        else if (arg == "--max-regression") options.max_regression = std::stod(value());
+        else if (arg == "--min-time") options.min_time = std::stod(value());
+        else if (arg == "--samples") options.samples = std::max(1, std::stoi(value()));
+        else throw std::runtime_error("unknown option " + arg);
+    }
+    return options;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception& e) {
+        std::fprintf(stderr, "weather-bench: %s\n", e.what());
+        std::fprintf(stderr, "usage: weather-bench [--json] [--out file] [--filter text] [--min-time s]\n"
+                             "                     [--samples n] [--baseline file] [--max-regression pct]\n");
+        return 2;
+    }
+
+    // Scratch persistent cache, resolved before anything touches DiskCache
+    char cache_template[] = "/tmp/weather-bench-XXXXXX";
+    const char* cache_dir = mkdtemp(cache_template);
+    if (!cache_dir) {
+        std::perror("weather-bench: mkdtemp");
+        return 1;
+    }
+    setenv("WEATHER_CLI_CACHE_DIR", cache_dir, 1);
+    Config::BASE_URL = "http://127.0.0.1:9/v1/";  // cache cases must never reach the network
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    std::map<std::string, double> baseline;
+    if (!options.baseline_path.empty()) {
+        try {
+            baseline = load_baseline(options.baseline_path);
+        } catch (const std::exception& e) {
+            std::fprintf(stderr, "weather-bench: %s\n", e.what());
+            return 2;
+        }
+    }
+
+    // Results go to the original stdout; fd 1 becomes the pseudo-terminal
+    FILE* report_out = fdopen(dup(STDOUT_FILENO), "w");
+    std::thread drain;
+    bool terminal = report_out && attach_terminal(drain);
+
+    std::vector<Result> results;
+    for (const auto& c : build_cases()) {
+        if (!options.filter.empty() && c.name.find(options.filter) == std::string::npos) continue;
+        if (!terminal && c.name.compare(0, 7, "render/") == 0) continue;
+        results.push_back(measure(c, options));
+        if (!options.json_output) std::fprintf(stderr, "  %s done\n", c.name.c_str());
+    }
+
+    FILE* out = report_out ? report_out : stderr;
+    FILE* file = nullptr;
+    if (!options.out_path.empty()) {
+        file = std::fopen(options.out_path.c_str(), "w");
+        if (!file) std::fprintf(stderr, "weather-bench: cannot write %s\n", options.out_path.c_str());
+    }
+    if (options.json_output) {
+        std::string document = to_json(results, options);
+        std::fputs(document.c_str(), file ? file : out);
+    } else {
+        print_table(out, results, baseline);
+        if (file) std::fputs(to_json(results, options).c_str(), file);
+    }
+    if (file) std::fclose(file);
+
+    int status = 0;
+    if (options.max_regression >= 0) {
+        for (const auto& r : results) {
+            auto found = baseline.find(r.name);
+            if (found == baseline.end()) continue;
+            double change = (r.ns_per_op / found->second - 1) * 100;
+            if (change > options.max_regression) {
+                std::fprintf(stderr, "REGRESSION %s: %+.1f%% (%.1f -> %.1f ns/op)\n", r.name.c_str(), change,
+                             found->second, r.ns_per_op);
+                status = 1;
+            }
+        }
+    }
+
+    DiskCache::clear();
+    std::error_code ignored;
+    std::filesystem::remove_all(cache_dir, ignored);
+    if (report_out) std::fclose(report_out);
+    if (terminal) {
+        // Closing the slave side ends the drain thread
+        close(STDOUT_FILENO);
+        drain.detach();
+    }
+    return status;
+}
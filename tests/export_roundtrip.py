@@ -0,0 +1,244 @@
+#!/usr/bin/env python3
+"""End-to-end checks of --export against tools/mock_server.py.
+
+    python3 tests/export_roundtrip.py ./build/weather-cli
+
+Covers what the unit tests cannot reach without a server: the columnar
+writer decodes (tools/read_columnar.py) to the same rows as the ndjson
+export, an interrupted export resumed from its last checkpoint is identical
+to an uninterrupted one, a location that failed is retried by --resume until
+it succeeds, and --resume refuses a changed location list or an output
+shorter than its checkpoint.
+"""
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import urllib.parse
+import urllib.request
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+sys.path.insert(0, os.path.join(ROOT, "tools"))
+import read_columnar  # noqa: E402
+
+FORMATS = ("csv", "ndjson", "columnar")
+PREFIX = 40      # locations in the "interrupted" run
+LOCATIONS = 100  # locations in the full run
+
+failures = 0
+
+
+def check(condition, message):
+    global failures
+    if not condition:
+        print("  " + message, file=sys.stderr)
+        failures += 1
+    return condition
+
+
+def start_mock():
+    mock = subprocess.Popen([sys.executable, os.path.join(ROOT, "tools", "mock_server.py"), "--port", "0"],
+                            stdout=subprocess.PIPE, stderr=subprocess.DEVNULL, text=True)
+    banner = mock.stdout.readline()  # Mock WeatherAPI on http://127.0.0.1:<port>/v1/
+    if not banner.startswith("Mock WeatherAPI on "):
+        mock.kill()
+        sys.exit("export_roundtrip: mock server did not start")
+    return mock, banner.split()[-1]
+
+
+class Exporter:
+    def __init__(self, cli, base_url, work):
+        self.cli = cli
+        self.work = work
+        self.control = base_url.split("/v1/")[0]
+        self.env = dict(os.environ, WEATHER_CLI_BASE_URL=base_url)
+
+    def locations(self, name, lines):
+        path = os.path.join(self.work, name)
+        with open(path, "w") as f:
+            f.write("\n".join(lines) + "\n")
+        return path
+
+    def configure_mock(self, **settings):
+        urllib.request.urlopen(self.control + "/__config?" + urllib.parse.urlencode(settings)).read()
+
+    def run(self, locations, output, fmt, resume=False, cache="cache"):
+        args = [self.cli, "--export", locations, "--output", output, "--format", fmt, "--concurrency", "8"]
+        if resume:
+            args.append("--resume")
+        env = dict(self.env, WEATHER_CLI_CACHE_DIR=os.path.join(self.work, cache))
+        return subprocess.run(args, env=env, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                              text=True, timeout=120)
+
+
+def read_bytes(path):
+    with open(path, "rb") as f:
+        return f.read()
+
+
+def rows(path, fmt):
+    data = read_bytes(path)
+    if fmt == "columnar":
+        return [dict(zip(columns, values)) for columns, values in read_columnar.read(data)]
+    if fmt == "ndjson":
+        return [json.loads(line) for line in data.decode("utf-8").splitlines()]
+    return data.decode("utf-8").splitlines()
+
+
+def mark_interrupted(output, junk):
+    # What a kill between two checkpoints leaves: progress short of the end, a partial write after it
+    progress_path = output + ".progress"
+    with open(progress_path) as f:
+        progress = json.load(f)
+    progress["complete"] = False
+    with open(progress_path, "w") as f:
+        json.dump(progress, f)
+    with open(output, "ab") as f:
+        f.write(junk)
+    return progress
+
+
+def test_columnar_matches_ndjson(exporter, full, outputs):
+    columnar = rows(outputs["columnar"], "columnar")
+    ndjson = rows(outputs["ndjson"], "ndjson")
+    check(len(columnar) == len(ndjson) and len(ndjson) > 0,
+          "columnar has %d rows, ndjson %d" % (len(columnar), len(ndjson)))
+    for i, (decoded, expected) in enumerate(zip(columnar, ndjson)):
+        if not check(decoded == expected, "row %d differs:\n    %s\n    %s" % (i, decoded, expected)):
+            break
+
+
+def test_resume(exporter, full, prefix, outputs, fmt):
+    output = os.path.join(exporter.work, "resumed." + fmt)
+    result = exporter.run(prefix, output, fmt)
+    if not check(result.returncode == 0, "prefix export failed: " + result.stderr):
+        return
+    junk = b"\x00\x01half a row" if fmt == "columnar" else b"Half,a,row"
+    progress = mark_interrupted(output, junk)
+    check(progress["locations"] == PREFIX, "checkpoint after %d locations" % progress["locations"])
+
+    result = exporter.run(full, output, fmt, resume=True)
+    if not check(result.returncode == 0, "resume failed: " + result.stderr):
+        return
+    check("resumed after %d" % PREFIX in result.stderr, "resume did not start at the checkpoint: " + result.stderr)
+    if fmt == "columnar":
+        # Row groups split at the checkpoint, so compare what they decode to
+        check(rows(output, fmt) == rows(outputs[fmt], fmt), "resumed columnar export decodes differently")
+    else:
+        check(read_bytes(output) == read_bytes(outputs[fmt]), "resumed %s export differs from a full one" % fmt)
+
+
+def load_progress(output):
+    with open(output + ".progress") as f:
+        return json.load(f)
+
+
+def test_failed_location(exporter, full_lines, full, outputs, fmt):
+    output = os.path.join(exporter.work, "retried." + fmt)
+    cache = "cache-retried-" + fmt  # a cached response would hide the failure
+    missing = PREFIX // 2
+    exporter.configure_mock(unknown=full_lines[missing])
+    try:
+        result = exporter.run(full, output, fmt, cache=cache)
+        check(result.returncode != 0, "an export with a failed location exited 0")
+        progress = load_progress(output)
+        check(not progress["complete"] and progress["failed"] == [missing],
+              "progress after a failure: complete=%s failed=%s" % (progress["complete"], progress["failed"]))
+
+        # Still failing: reported again, nothing is marked complete
+        result = exporter.run(full, output, fmt, resume=True, cache=cache)
+        check(result.returncode != 0 and "already complete" not in result.stderr,
+              "a resume that failed again exited %d: %s" % (result.returncode, result.stderr))
+        check(load_progress(output)["failed"] == [missing], "the failed location was forgotten")
+    finally:
+        exporter.configure_mock(unknown="")
+
+    result = exporter.run(full, output, fmt, resume=True, cache=cache)
+    if not check(result.returncode == 0, "the retrying resume failed: " + result.stderr):
+        return
+    progress = load_progress(output)
+    check(progress["complete"] and progress["failed"] == [],
+          "progress after the retry: complete=%s failed=%s" % (progress["complete"], progress["failed"]))
+    # The retried rows come last; the set of rows is that of an export that never failed
+    key = lambda row: json.dumps(row, sort_keys=True)
+    check(sorted(rows(output, fmt), key=key) == sorted(rows(outputs[fmt], fmt), key=key),
+          "the retried %s export holds different rows" % fmt)
+
+    result = exporter.run(full, output, fmt, resume=True, cache=cache)
+    check(result.returncode == 0 and "already complete" in result.stderr,
+          "a complete export was not recognised: " + result.stderr)
+
+
+def test_refusals(exporter, full_lines, prefix, fmt):
+    output = os.path.join(exporter.work, "refused." + fmt)
+    result = exporter.run(prefix, output, fmt)
+    if not check(result.returncode == 0, "prefix export failed: " + result.stderr):
+        return
+    progress = mark_interrupted(output, b"")
+    before = read_bytes(output)
+
+    # A location inside the checkpointed prefix changed
+    changed = list(full_lines)
+    changed[PREFIX // 2] = "Somewhere Else"
+    result = exporter.run(exporter.locations("changed.txt", changed), output, fmt, resume=True)
+    check(result.returncode != 0 and "same locations" in result.stderr,
+          "a changed location list was resumed: %d %s" % (result.returncode, result.stderr))
+    check(read_bytes(output) == before, "a refused resume modified the output")
+
+    # The output lost bytes the checkpoint counts on
+    with open(output, "r+b") as f:
+        f.truncate(progress["bytes"] // 2)
+    result = exporter.run(exporter.locations("full.txt", full_lines), output, fmt, resume=True)
+    check(result.returncode != 0 and "shorter" in result.stderr,
+          "a truncated output was resumed: %d %s" % (result.returncode, result.stderr))
+    check(os.path.getsize(output) == progress["bytes"] // 2, "a refused resume resized the output")
+
+    # Someone else's file under the same name
+    with open(output, "wb") as f:
+        f.write(b"#" * progress["bytes"])
+    result = exporter.run(exporter.locations("full.txt", full_lines), output, fmt, resume=True)
+    check(result.returncode != 0 and "does not start as" in result.stderr,
+          "a foreign output was resumed: %d %s" % (result.returncode, result.stderr))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: export_roundtrip.py path/to/weather-cli")
+    cli = os.path.abspath(sys.argv[1])
+    mock, base_url = start_mock()
+    work = tempfile.mkdtemp(prefix="weather-export-")
+    try:
+        exporter = Exporter(cli, base_url, work)
+        full_lines = ["Export Town %d" % i for i in range(LOCATIONS)]
+        full = exporter.locations("full.txt", full_lines)
+        prefix = exporter.locations("prefix.txt", full_lines[:PREFIX])
+
+        outputs = {}
+        for fmt in FORMATS:
+            outputs[fmt] = os.path.join(work, "full." + fmt)
+            result = exporter.run(full, outputs[fmt], fmt)
+            if result.returncode != 0:
+                sys.exit("export_roundtrip: %s export failed:\n%s" % (fmt, result.stderr))
+
+        cases = [("export/columnar_matches_ndjson", lambda: test_columnar_matches_ndjson(exporter, full, outputs))]
+        for fmt in FORMATS:
+            cases.append(("export/resume_" + fmt, lambda fmt=fmt: test_resume(exporter, full, prefix, outputs, fmt)))
+            cases.append(("export/retry_failed_" + fmt,
+                          lambda fmt=fmt: test_failed_location(exporter, full_lines, full, outputs, fmt)))
+            cases.append(("export/refuse_" + fmt, lambda fmt=fmt: test_refusals(exporter, full_lines, prefix, fmt)))
+
+        for name, run in cases:
+            before = failures
+            run()
+            print(("ok   " if failures == before else "FAIL ") + name)
+    finally:
+        mock.terminate()
+        mock.wait()
+        shutil.rmtree(work, ignore_errors=True)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
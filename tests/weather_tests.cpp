@@ -0,0 +1,680 @@
+// Weather CLI Pro - unit tests
+// Checks the pieces whose behavior is easy to get subtly wrong and hard to
+// observe from the command line: retry classification, the circuit breaker,
+// address parsing, change detection and the export formats. Cases are named group/case; ctest
+// runs one group per test.
+//
+//   weather-tests                    # every case
+//   weather-tests circuit_breaker/   # only matching cases
+//   weather-tests --list
+
+#define WEATHER_CLI_NO_MAIN
+#include "../weather_cli.cpp"
+
+#include <cstdio>
+#include <functional>
+#include <map>
+
+namespace {
+
+struct Case {
+    std::string name;
+    std::function<void()> run;
+};
+
+int failed_checks = 0;
+
+void report_failure(const char* file, int line, const std::string& what) {
+    std::fprintf(stderr, "  %s:%d: %s\n", file, line, what.c_str());
+    failed_checks++;
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) report_failure(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        const auto& actual_value = (actual); \
+        const auto& expected_value = (expected); \
+        if (!(actual_value == expected_value)) { \
+            std::ostringstream message; \
+            message << #actual " == " #expected ": got " << actual_value << ", expected " << expected_value; \
+            report_failure(__FILE__, __LINE__, message.str()); \
+        } \
+    } while (0)
+
+const char* verdict_name(RetryPolicy::Verdict verdict) {
+    switch (verdict) {
+        case RetryPolicy::Verdict::SUCCESS: return "SUCCESS";
+        case RetryPolicy::Verdict::RETRY: return "RETRY";
+        case RetryPolicy::Verdict::FAIL: return "FAIL";
+    }
+    return "?";
+}
+
+// Opens the host's circuit the way a run of upstream failures would
+void trip(const std::string& host) {
+    for (int i = 0; i < CircuitBreaker::FAILURE_THRESHOLD; ++i) {
+        CHECK(CircuitBreaker::allow(host));
+        CircuitBreaker::record_failure(host, std::nullopt);
+    }
+}
+
+void wait_out_cooldown(std::chrono::seconds cooldown) {
+    std::this_thread::sleep_for(cooldown + std::chrono::milliseconds(50));
+}
+
+std::string hex(const unsigned char* bytes, size_t length) {
+    std::string text;
+    char byte[3];
+    for (size_t i = 0; i < length; ++i) {
+        std::snprintf(byte, sizeof(byte), "%02x", bytes[i]);
+        text += byte;
+    }
+    return text;
+}
+
+void retry_policy_cases(std::vector<Case>& cases) {
+    cases.push_back({"retry_policy/classify", [] {
+        struct Row {
+            CURLcode code;
+            long status;
+            RetryPolicy::Verdict verdict;
+        };
+        using V = RetryPolicy::Verdict;
+        const Row rows[] = {
+            {CURLE_OK, 200, V::SUCCESS},
+            {CURLE_OK, 304, V::SUCCESS},
+            {CURLE_OK, 400, V::FAIL},
+            {CURLE_OK, 401, V::FAIL},
+            {CURLE_OK, 404, V::FAIL},
+            {CURLE_OK, 408, V::RETRY},
+            {CURLE_OK, 425, V::RETRY},
+            {CURLE_OK, 429, V::RETRY},
+            {CURLE_OK, 500, V::RETRY},
+            {CURLE_OK, 503, V::RETRY},
+            {CURLE_COULDNT_RESOLVE_HOST, 0, V::RETRY},
+            {CURLE_COULDNT_CONNECT, 0, V::RETRY},
+            {CURLE_OPERATION_TIMEDOUT, 0, V::RETRY},
+            {CURLE_RECV_ERROR, 0, V::RETRY},
+            {CURLE_GOT_NOTHING, 0, V::RETRY},
+            {CURLE_URL_MALFORMAT, 0, V::FAIL},
+            {CURLE_PEER_FAILED_VERIFICATION, 0, V::FAIL},
+            {CURLE_ABORTED_BY_CALLBACK, 0, V::FAIL},
+        };
+        for (const Row& row : rows) {
+            std::string actual = verdict_name(RetryPolicy::classify(row.code, row.status));
+            std::string expected = verdict_name(row.verdict);
+            if (actual != expected) {
+                report_failure(__FILE__, __LINE__, std::string(curl_easy_strerror(row.code)) + " / HTTP " +
+                               std::to_string(row.status) + ": got " + actual + ", expected " + expected);
+            }
+        }
+    }});
+
+    cases.push_back({"retry_policy/upstream_fault", [] {
+        CHECK(RetryPolicy::upstream_fault(CURLE_OK, 503));
+        CHECK(RetryPolicy::upstream_fault(CURLE_COULDNT_CONNECT, 0));
+        CHECK(!RetryPolicy::upstream_fault(CURLE_OK, 404));
+        CHECK(!RetryPolicy::upstream_fault(CURLE_OK, 200));
+        // A cancelled request says nothing about the upstream
+        CHECK(!RetryPolicy::upstream_fault(CURLE_ABORTED_BY_CALLBACK, 0));
+    }});
+
+    cases.push_back({"retry_policy/delay", [] {
+        for (int attempt = 0; attempt < 12; ++attempt) {
+            auto wait = RetryPolicy::delay(attempt, std::nullopt);
+            CHECK(wait.has_value());
+            if (wait) CHECK(*wait <= RetryPolicy::MAX_DELAY);
+        }
+        auto floor = RetryPolicy::delay(1, std::chrono::seconds(2));
+        CHECK(floor.has_value());
+        if (floor) CHECK(*floor >= std::chrono::milliseconds(2000));
+        CHECK(!RetryPolicy::delay(1, RetryPolicy::MAX_RETRY_AFTER + std::chrono::seconds(1)).has_value());
+    }});
+}
+
+void circuit_breaker_cases(std::vector<Case>& cases) {
+    cases.push_back({"circuit_breaker/opens_after_threshold", [] {
+        const std::string host = "http://opens.test";
+        const auto cooldown = CircuitBreaker::COOLDOWN;
+        CircuitBreaker::COOLDOWN = std::chrono::seconds(60);  // long enough to still be open below
+        for (int i = 0; i < CircuitBreaker::FAILURE_THRESHOLD - 1; ++i) {
+            CircuitBreaker::record_failure(host, std::nullopt);
+        }
+        CHECK(CircuitBreaker::allow(host));
+        CHECK(!CircuitBreaker::is_open(host));
+
+        CircuitBreaker::record_failure(host, std::nullopt);
+        std::chrono::seconds retry_in(0);
+        CHECK(!CircuitBreaker::allow(host, &retry_in));
+        CHECK(CircuitBreaker::is_open(host));
+        CHECK(retry_in > std::chrono::seconds(0));
+        CHECK(retry_in <= CircuitBreaker::COOLDOWN);
+        CircuitBreaker::COOLDOWN = cooldown;
+
+        // Other hosts are unaffected
+        CHECK(CircuitBreaker::allow("http://other.test"));
+    }});
+
+    cases.push_back({"circuit_breaker/success_resets_count", [] {
+        const std::string host = "http://flaky.test";
+        for (int round = 0; round < 3; ++round) {
+            for (int i = 0; i < CircuitBreaker::FAILURE_THRESHOLD - 1; ++i) {
+                CircuitBreaker::record_failure(host, std::nullopt);
+            }
+            CircuitBreaker::record_success(host);
+        }
+        CHECK(CircuitBreaker::allow(host));
+    }});
+
+    cases.push_back({"circuit_breaker/probe_closes", [] {
+        const std::string host = "http://recovers.test";
+        trip(host);
+        CHECK(!CircuitBreaker::allow(host));
+        wait_out_cooldown(CircuitBreaker::COOLDOWN);
+
+        bool probe = false;
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(probe);
+        // Only one probe at a time
+        bool second = true;
+        CHECK(!CircuitBreaker::allow(host, nullptr, &second));
+        CHECK(!second);
+
+        CircuitBreaker::record_success(host);
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(!probe);
+        CHECK(!CircuitBreaker::is_open(host));
+    }});
+
+    cases.push_back({"circuit_breaker/failed_probe_backs_off", [] {
+        const std::string host = "http://still-down.test";
+        trip(host);
+        wait_out_cooldown(CircuitBreaker::COOLDOWN);
+
+        bool probe = false;
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(probe);
+        CircuitBreaker::record_failure(host, std::nullopt);
+
+        std::chrono::seconds retry_in(0);
+        CHECK(!CircuitBreaker::allow(host, &retry_in));
+        CHECK(CircuitBreaker::is_open(host));
+        // Twice the base cooldown, rounded down by the elapsed milliseconds
+        CHECK(retry_in >= CircuitBreaker::COOLDOWN * 2 - std::chrono::seconds(1));
+        CHECK(retry_in <= CircuitBreaker::COOLDOWN * 2);
+    }});
+
+    cases.push_back({"circuit_breaker/abandoned_probe_is_released", [] {
+        const std::string host = "http://abandoned.test";
+        trip(host);
+        wait_out_cooldown(CircuitBreaker::COOLDOWN);
+
+        bool probe = false;
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(probe);
+        CHECK(!CircuitBreaker::allow(host));
+
+        // No verdict: the circuit stays open for business, and the next request probes
+        CircuitBreaker::release_probe(host);
+        probe = false;
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(probe);
+        CircuitBreaker::record_success(host);
+    }});
+
+    cases.push_back({"circuit_breaker/cancelled_request_releases_probe", [] {
+        // Nothing listens on the discard port; the request is cancelled before it matters
+        const std::string url = "http://127.0.0.1:9/v1/current.json";
+        const std::string host = CircuitBreaker::host_of(url);
+        trip(host);
+        wait_out_cooldown(CircuitBreaker::COOLDOWN);
+
+        ConnectionPool::Lease lease = ConnectionPool::acquire();
+        CHECK(static_cast<bool>(lease));
+        if (!lease) return;
+        std::string body;
+        CancelFlag cancel{true};
+        HttpClient::configure_handle(lease.get(), url, &body, &cancel);
+        RequestScheduler::Result result = RequestScheduler::perform(lease.get(), url, body, 3, &cancel);
+        CHECK_EQ(result.code, CURLE_ABORTED_BY_CALLBACK);
+
+        bool probe = false;
+        CHECK(CircuitBreaker::allow(host, nullptr, &probe));
+        CHECK(probe);
+        CircuitBreaker::record_success(host);
+    }});
+}
+
+void ip_cases(std::vector<Case>& cases) {
+    cases.push_back({"ip/parse_ipv6", [] {
+        struct Row {
+            const char* input;
+            const char* bytes;  // nullptr when the input must be rejected
+        };
+        const Row rows[] = {
+            {"::", "00000000000000000000000000000000"},
+            {"::1", "00000000000000000000000000000001"},
+            {"1::", "00010000000000000000000000000000"},
+            {"2001:db8::1", "20010db8000000000000000000000001"},
+            {"2001:DB8:0:0:0:0:0:1", "20010db8000000000000000000000001"},
+            {"2001:db8:85a3::8a2e:370:7334", "20010db885a3000000008a2e03707334"},
+            {"fe80::1:2:3:4", "fe800000000000000001000200030004"},
+            {"1:2:3:4:5:6:7:8", "00010002000300040005000600070008"},
+            {"1:2:3:4:5:6:7::", "00010002000300040005000600070000"},
+            {"::1:2:3:4:5:6:7", "00000001000200030004000500060007"},
+            // Embedded IPv4 tail
+            {"::ffff:192.0.2.128", "00000000000000000000ffffc0000280"},
+            {"::192.0.2.1", "000000000000000000000000c0000201"},
+            {"64:ff9b::10.0.0.1", "0064ff9b0000000000000000" "0a000001"},
+            {"1:2:3:4:5:6:1.2.3.4", "00010002000300040005000601020304"},
+            // Invalid groups and shapes
+            {"", nullptr},
+            {":", nullptr},
+            {":::", nullptr},
+            {":1::", nullptr},
+            {"1::2::3", nullptr},
+            {"1:2:3:4:5:6:7:8:9", nullptr},
+            {"1:2:3:4:5:6:7", nullptr},
+            {"12345::1", nullptr},
+            {"g::1", nullptr},
+            {"1::2:", nullptr},
+            {"1:2:3:4:5:6:7:1.2.3.4", nullptr},
+            {"::ffff:1.2.3", nullptr},
+            {"::ffff:256.1.1.1", nullptr},
+            {"::1.2.3.4:5", nullptr},
+            {"1.2.3.4", nullptr},
+        };
+        for (const Row& row : rows) {
+            unsigned char bytes[16] = {};
+            bool parsed = Utils::parse_ipv6(row.input, bytes);
+            if (!row.bytes) {
+                if (parsed) report_failure(__FILE__, __LINE__, std::string("accepted \"") + row.input + "\"");
+                continue;
+            }
+            if (!parsed) {
+                report_failure(__FILE__, __LINE__, std::string("rejected \"") + row.input + "\"");
+            } else if (hex(bytes, 16) != row.bytes) {
+                report_failure(__FILE__, __LINE__, std::string(row.input) + " parsed as " + hex(bytes, 16));
+            }
+        }
+    }});
+
+    cases.push_back({"ip/network_key", [] {
+        struct Row {
+            const char* input;
+            int ipv4_prefix;
+            int ipv6_prefix;
+            const char* network;  // nullptr when the input is not an address
+        };
+        const Row rows[] = {
+            {"192.168.1.77", 32, 128, "192.168.1.77"},
+            {"192.168.1.77", 24, 128, "192.168.1.0/24"},
+            {"10.1.17.5", 20, 128, "10.1.16.0/20"},
+            {"10.1.17.5", 0, 128, "0.0.0.0/0"},
+            {"2001:db8::1", 32, 128, "2001:db8::1"},
+            {"2001:db8:1:2::1", 32, 48, "2001:db8:1::/48"},
+            {"2001:db8:abcd:12:ffff::1", 32, 56, "2001:db8:abcd::/56"},
+            {"::ffff:192.0.2.128", 32, 96, "::ffff:0:0/96"},
+            {"not-an-ip", 24, 48, nullptr},
+            {"", 24, 48, nullptr},
+        };
+        for (const Row& row : rows) {
+            IpBatchProcessor::Options options;
+            options.ipv4_prefix = row.ipv4_prefix;
+            options.ipv6_prefix = row.ipv6_prefix;
+            std::string key, network;
+            bool ok = IpBatchProcessor::network_key(row.input, options, key, network);
+            if (!row.network) {
+                if (ok) report_failure(__FILE__, __LINE__, std::string("accepted \"") + row.input + "\"");
+            } else if (!ok) {
+                report_failure(__FILE__, __LINE__, std::string("rejected \"") + row.input + "\"");
+            } else if (network != row.network) {
+                report_failure(__FILE__, __LINE__, std::string(row.input) + " -> " + network + ", expected " +
+                               row.network);
+            }
+        }
+    }});
+
+    cases.push_back({"ip/network_key_dedup", [] {
+        IpBatchProcessor::Options collapse;
+        collapse.ipv4_prefix = 24;
+        collapse.ipv6_prefix = 48;
+        auto key_of = [](const char* ip, const IpBatchProcessor::Options& options) {
+            std::string key, network;
+            IpBatchProcessor::network_key(ip, options, key, network);
+            return key;
+        };
+
+        // One key per network, whatever the host part or spelling
+        CHECK(key_of("192.168.1.1", collapse) == key_of("192.168.1.254", collapse));
+        CHECK(key_of("192.168.1.1", collapse) != key_of("192.168.2.1", collapse));
+        CHECK(key_of("2001:db8:1:2::1", collapse) == key_of("2001:DB8:1:ffff:0:0:0:9", collapse));
+        CHECK(key_of("2001:db8:1::1", collapse) != key_of("2001:db8:2::1", collapse));
+
+        IpBatchProcessor::Options exact;
+        CHECK(key_of("2001:db8::1", exact) == key_of("2001:0db8:0:0:0:0:0:1", exact));
+        CHECK(key_of("192.168.1.1", exact) != key_of("192.168.1.2", exact));
+        // IPv4 and IPv4-mapped IPv6 stay distinct: the lookups may differ
+        CHECK(key_of("192.0.2.1", exact) != key_of("::ffff:192.0.2.1", exact));
+    }});
+}
+
+void watch_cases(std::vector<Case>& cases) {
+    using Record = RecordOutput::Record;
+
+    cases.push_back({"watch/diff_first_record", [] {
+        Record current = {{"query", "London"}, {"temp_c", 12.5}};
+        CHECK(WeatherWatch::diff(Record(), current) == current);
+    }});
+
+    cases.push_back({"watch/diff_unchanged", [] {
+        Record record = {{"query", "London"}, {"temp_c", 12.5}, {"condition", "Cloudy"}};
+        Record changes = WeatherWatch::diff(record, record);
+        CHECK(changes.is_object());
+        CHECK(changes.empty());
+    }});
+
+    cases.push_back({"watch/diff_changed_added_removed", [] {
+        Record previous = {{"query", "London"}, {"temp_c", 12.5}, {"gust_kph", 30}};
+        Record current = {{"query", "London"}, {"temp_c", 13.4}, {"precip_mm", 0.2}};
+        Record changes = WeatherWatch::diff(previous, current);
+        CHECK_EQ(changes.size(), size_t(3));
+        CHECK(changes["temp_c"] == 13.4);
+        CHECK(changes["precip_mm"] == 0.2);
+        CHECK(changes["gust_kph"].is_null());  // merge patch removal
+        CHECK(!changes.contains("query"));
+    }});
+
+    cases.push_back({"watch/diff_type_change", [] {
+        Record changes = WeatherWatch::diff({{"uv", nullptr}}, {{"uv", 3}});
+        CHECK(changes == Record({{"uv", 3}}));
+    }});
+}
+
+void timer_wheel_cases(std::vector<Case>& cases) {
+    using Clock = TimerWheel::Clock;
+    using std::chrono::milliseconds;
+    static const Clock::time_point origin{};
+
+    // Advances tick by tick and returns the tick each id fired on
+    auto run_ticks = [](TimerWheel& wheel, uint64_t ticks) {
+        std::map<size_t, uint64_t> fired;
+        std::vector<size_t> expired;
+        for (uint64_t t = 1; t <= ticks; ++t) {
+            expired.clear();
+            wheel.advance(origin + milliseconds(100) * static_cast<Clock::rep>(t), expired);
+            for (size_t id : expired) {
+                if (!fired.emplace(id, t).second) report_failure(__FILE__, __LINE__, "timer fired twice");
+            }
+        }
+        return fired;
+    };
+
+    cases.push_back({"timer_wheel/fires_on_rounded_up_tick", [run_ticks] {
+        TimerWheel wheel(milliseconds(100), 8, origin);
+        wheel.schedule(1, milliseconds(250));
+        wheel.schedule(2, milliseconds(300));
+        wheel.schedule(3, milliseconds(0));  // never sooner than the next tick
+        CHECK_EQ(wheel.pending(), size_t(3));
+        auto fired = run_ticks(wheel, 5);
+        CHECK_EQ(fired[1], uint64_t(3));
+        CHECK_EQ(fired[2], uint64_t(3));
+        CHECK_EQ(fired[3], uint64_t(1));
+        CHECK_EQ(wheel.pending(), size_t(0));
+    }});
+
+    cases.push_back({"timer_wheel/slot_wrap", [run_ticks] {
+        TimerWheel wheel(milliseconds(100), 8, origin);
+        // 8, 9, 16 and 25 ticks share slots with earlier timers and need whole rounds
+        wheel.schedule(1, milliseconds(100));
+        wheel.schedule(8, milliseconds(800));
+        wheel.schedule(9, milliseconds(900));
+        wheel.schedule(16, milliseconds(1600));
+        wheel.schedule(25, milliseconds(2500));
+        auto fired = run_ticks(wheel, 30);
+        CHECK_EQ(fired.size(), size_t(5));
+        for (const auto& entry : fired) CHECK_EQ(entry.second, uint64_t(entry.first));
+    }});
+
+    cases.push_back({"timer_wheel/advance_skips_ticks", [] {
+        TimerWheel wheel(milliseconds(100), 4, origin);
+        wheel.schedule(7, milliseconds(1000));
+        std::vector<size_t> expired;
+        wheel.advance(origin + milliseconds(950), expired);
+        CHECK(expired.empty());
+        CHECK(wheel.next_tick() == origin + milliseconds(1000));
+        wheel.advance(origin + milliseconds(5000), expired);  // one call across many wraps
+        CHECK_EQ(expired.size(), size_t(1));
+        CHECK(wheel.next_tick() == origin + milliseconds(5100));
+    }});
+}
+
+Alert make_alert(const std::string& headline, const std::string& expires) {
+    Alert alert;
+    alert.headline = headline;
+    alert.severity = "Moderate";
+    alert.event = "Wind";
+    alert.effective = "2025-10-17T06:00:00+00:00";
+    alert.expires = expires;
+    alert.desc = "Gusts of 80 km/h";
+    return alert;
+}
+
+std::vector<AlertMonitor::Change> changes_of(const std::vector<AlertMonitor::Event>& events) {
+    std::vector<AlertMonitor::Change> changes;
+    for (const auto& event : events) changes.push_back(event.change);
+    return changes;
+}
+
+void alert_cases(std::vector<Case>& cases) {
+    using Change = AlertMonitor::Change;
+    // 2025-10-17T12:00:00Z: alerts expiring on the 18th are live, those on the 16th are over
+    static const std::time_t now = 1760702400;
+    static const std::string live = "2025-10-18T06:00:00+00:00";
+    static const std::string over = "2025-10-16T06:00:00+00:00";
+
+    cases.push_back({"alerts/parse_time", [] {
+        CHECK_EQ(AlertMonitor::parse_time("1970-01-02T00:00:00+00:00"), std::time_t(86400));
+        CHECK_EQ(AlertMonitor::parse_time("2025-10-17T13:30:00+01:30"), now);
+        CHECK_EQ(AlertMonitor::parse_time("2025-10-17T12:00:00Z"), now);
+        CHECK_EQ(AlertMonitor::parse_time("tomorrow"), std::time_t(0));
+        CHECK_EQ(AlertMonitor::parse_time(""), std::time_t(0));
+    }});
+
+    cases.push_back({"alerts/new_then_deduplicated", [] {
+        json seen;
+        std::vector<AlertMonitor::Event> events;
+        std::vector<Alert> alerts = {make_alert("Wind warning", live), make_alert("Rain warning", live)};
+        AlertMonitor::compare(alerts, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::NEW, Change::NEW}));
+        CHECK_EQ(seen.size(), size_t(2));
+
+        // The same feed again, in either order, reports nothing
+        events.clear();
+        std::swap(alerts[0], alerts[1]);
+        AlertMonitor::compare(alerts, now, seen, events);
+        CHECK(events.empty());
+        CHECK_EQ(seen.size(), size_t(2));
+    }});
+
+    cases.push_back({"alerts/updated", [] {
+        json seen;
+        std::vector<AlertMonitor::Event> events;
+        AlertMonitor::compare({make_alert("Wind warning", live)}, now, seen, events);
+
+        // Revised text under the same key
+        events.clear();
+        Alert revised = make_alert("Wind warning", live);
+        revised.severity = "Severe";
+        AlertMonitor::compare({revised}, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::UPDATED}));
+        CHECK(events.size() == 1 && events[0].alert["severity"] == "Severe");
+
+        // Extended expiry: one update that names the old end, not a new alert
+        events.clear();
+        Alert extended = revised;
+        extended.expires = "2025-10-19T06:00:00+00:00";
+        AlertMonitor::compare({extended}, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::UPDATED}));
+        CHECK(events.size() == 1 && events[0].alert.value("previous_expires", "") == live);
+        CHECK_EQ(seen.size(), size_t(1));
+    }});
+
+    cases.push_back({"alerts/cleared", [] {
+        json seen;
+        std::vector<AlertMonitor::Event> events;
+        AlertMonitor::compare({make_alert("Wind warning", live), make_alert("Rain warning", live)}, now, seen,
+                              events);
+
+        // Withdrawn from the feed before its expiry
+        events.clear();
+        AlertMonitor::compare({make_alert("Rain warning", live)}, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::EXPIRED}));
+        CHECK(events.size() == 1 && events[0].alert["headline"] == "Wind warning");
+        CHECK_EQ(seen.size(), size_t(1));
+
+        events.clear();
+        AlertMonitor::compare({}, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::EXPIRED}));
+        CHECK(seen.empty());
+
+        events.clear();
+        AlertMonitor::compare({}, now, seen, events);
+        CHECK(events.empty());
+    }});
+
+    cases.push_back({"alerts/expired_in_feed", [] {
+        json seen;
+        std::vector<AlertMonitor::Event> events;
+        AlertMonitor::compare({make_alert("Wind warning", "2025-10-17T13:00:00+00:00")}, now, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::NEW}));
+
+        // Its expiry passes while the feed still lists it: expired once, then quiet
+        events.clear();
+        AlertMonitor::compare({make_alert("Wind warning", "2025-10-17T13:00:00+00:00")}, now + 7200, seen, events);
+        CHECK(changes_of(events) == std::vector<Change>({Change::EXPIRED}));
+        events.clear();
+        AlertMonitor::compare({make_alert("Wind warning", "2025-10-17T13:00:00+00:00")}, now + 9000, seen, events);
+        CHECK(events.empty());
+
+        // Dropping an alert already reported expired says nothing more
+        AlertMonitor::compare({}, now + 9000, seen, events);
+        CHECK(events.empty());
+        CHECK(seen.empty());
+
+        // First seen after its end: never announced
+        AlertMonitor::compare({make_alert("Old warning", over)}, now, seen, events);
+        CHECK(events.empty());
+    }});
+
+    cases.push_back({"alerts/state_round_trip", [] {
+        const std::string path = DiskCache::directory() + "/alerts-test.json";
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        CHECK(AlertMonitor::load_state(path) == json::object());
+
+        json state;
+        std::vector<AlertMonitor::Event> events;
+        AlertMonitor::compare({make_alert("Wind warning", live), make_alert("Frost warning", over)}, now,
+                              state["London"], events);
+        CHECK(AlertMonitor::save_state(path, state));
+        json loaded = AlertMonitor::load_state(path);
+        CHECK(loaded == state);
+
+        // A reloaded state suppresses what the saved one had already reported
+        events.clear();
+        AlertMonitor::compare({make_alert("Wind warning", live), make_alert("Frost warning", over)}, now,
+                              loaded["London"], events);
+        CHECK(events.empty());
+
+        // No temporary file is left behind
+        size_t files = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(DiskCache::directory())) {
+            if (entry.path().filename().string().rfind("alerts-test.json", 0) == 0) ++files;
+        }
+        CHECK_EQ(files, size_t(1));
+
+        // Unreadable or non-object state starts over rather than failing the check
+        for (const char* content : {"{\"London\": [", "[1, 2]", ""}) {
+            std::ofstream(path, std::ios::trunc) << content;
+            CHECK(AlertMonitor::load_state(path) == json::object());
+        }
+
+        CHECK(!AlertMonitor::save_state(DiskCache::directory() + "/missing/alerts.json", state));
+        std::filesystem::remove(path, ec);
+    }});
+}
+
+std::vector<Case> build_cases() {
+    std::vector<Case> cases;
+    retry_policy_cases(cases);
+    circuit_breaker_cases(cases);
+    ip_cases(cases);
+    watch_cases(cases);
+    timer_wheel_cases(cases);
+    alert_cases(cases);
+    return cases;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter;
+    bool list = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--list") {
+            list = true;
+        } else if (!arg.empty() && arg[0] == '-') {
+            std::fprintf(stderr, "usage: weather-tests [--list] [filter]\n");
+            return 2;
+        } else {
+            filter = arg;
+        }
+    }
+
+    // Scratch persistent cache, resolved before anything touches DiskCache
+    char cache_template[] = "/tmp/weather-tests-XXXXXX";
+    const char* cache_dir = mkdtemp(cache_template);
+    if (!cache_dir) {
+        std::perror("weather-tests: mkdtemp");
+        return 1;
+    }
+    setenv("WEATHER_CLI_CACHE_DIR", cache_dir, 1);
+    Config::BASE_URL = "http://127.0.0.1:9/v1/";  // unit tests must never reach the network
+    CircuitBreaker::COOLDOWN = std::chrono::seconds(1);
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    int ran = 0, failed = 0;
+    for (const auto& c : build_cases()) {
+        if (!filter.empty() && c.name.find(filter) == std::string::npos) continue;
+        if (list) {
+            std::printf("%s\n", c.name.c_str());
+            continue;
+        }
+        int before = failed_checks;
+        c.run();
+        ran++;
+        bool ok = failed_checks == before;
+        if (!ok) failed++;
+        std::printf("%s %s\n", ok ? "ok  " : "FAIL", c.name.c_str());
+    }
+
+    RequestScheduler::shutdown();
+    ConnectionPool::shutdown();
+    curl_global_cleanup();
+    std::error_code ec;
+    std::filesystem::remove_all(cache_dir, ec);
+
+    if (list) return 0;
+    if (ran == 0) {
+        std::fprintf(stderr, "weather-tests: no case matches '%s'\n", filter.c_str());
+        return 1;
+    }
+    std::printf("%d of %d cases passed\n", ran - failed, ran);
+    return failed == 0 ? 0 : 1;
+}
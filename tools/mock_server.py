@@ -0,0 +1,257 @@
+#!/usr/bin/env python3
+"""Offline stand-in for the WeatherAPI endpoints used by weather-cli.
+
+Replays the recorded current.json, forecast.json and ip.json fixtures with
+configurable latency, error rate and payload size, so throughput, retries and
+cache behaviour can be measured without network access:
+
+    python3 tools/mock_server.py --port 8089 --latency 50 --error-rate 0.05 &
+    WEATHER_CLI_BASE_URL=http://127.0.0.1:8089/v1/ ./build/weather-cli --batch tools/fixtures/locations.txt
+
+Control endpoints (no API key needed):
+    GET /__stats      request, error and byte counters as JSON
+    GET /__reset      zero the counters
+    GET /__config     change settings at runtime, e.g. /__config?latency=200&error_rate=0.1
+                      or /__config?unknown=Atlantis (empty to clear)
+"""
+
+import argparse
+import copy
+import json
+import os
+import random
+import sys
+import threading
+import time
+from datetime import date, timedelta
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qsl, urlparse
+
+FIXTURE_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "fixtures")
+ENDPOINTS = ("current.json", "forecast.json", "ip.json")
+
+
+class Settings:
+    def __init__(self, args):
+        self.latency_ms = args.latency
+        self.jitter_ms = args.jitter
+        self.error_rate = args.error_rate
+        self.error_status = args.error_status
+        self.retry_after = args.retry_after
+        self.pad_bytes = args.pad_bytes
+        self.unknown = args.unknown
+        self.random = random.Random(args.seed)
+        self.lock = threading.Lock()
+
+    def update(self, params):
+        with self.lock:
+            if "latency" in params:
+                self.latency_ms = float(params["latency"])
+            if "jitter" in params:
+                self.jitter_ms = float(params["jitter"])
+            if "error_rate" in params:
+                self.error_rate = float(params["error_rate"])
+            if "error_status" in params:
+                self.error_status = int(params["error_status"])
+            if "retry_after" in params:
+                self.retry_after = int(params["retry_after"])
+            if "pad_bytes" in params:
+                self.pad_bytes = int(params["pad_bytes"])
+            if "unknown" in params:
+                self.unknown = params["unknown"]
+
+    def as_dict(self):
+        return {
+            "latency": self.latency_ms,
+            "jitter": self.jitter_ms,
+            "error_rate": self.error_rate,
+            "error_status": self.error_status,
+            "retry_after": self.retry_after,
+            "pad_bytes": self.pad_bytes,
+            "unknown": self.unknown,
+        }
+
+    def draw(self):
+        """Delay in seconds and whether this request should fail."""
+        with self.lock:
+            delay = self.latency_ms + self.random.uniform(-self.jitter_ms, self.jitter_ms)
+            fail = self.random.random() < self.error_rate
+            return max(0.0, delay) / 1000.0, fail
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.zero()
+
+    def zero(self):
+        self.requests = 0
+        self.errors = 0
+        self.bytes = 0
+        self.by_endpoint = {name: 0 for name in ENDPOINTS}
+        self.started = time.time()
+
+    def reset(self):
+        with self.lock:
+            self.zero()
+
+    def record(self, endpoint, status, size):
+        with self.lock:
+            self.requests += 1
+            self.bytes += size
+            if status >= 400:
+                self.errors += 1
+            if endpoint in self.by_endpoint:
+                self.by_endpoint[endpoint] += 1
+
+    def as_dict(self):
+        with self.lock:
+            return {
+                "requests": self.requests,
+                "errors": self.errors,
+                "bytes": self.bytes,
+                "by_endpoint": dict(self.by_endpoint),
+                "uptime_s": round(time.time() - self.started, 3),
+            }
+
+
+def load_fixtures(directory):
+    fixtures = {}
+    for name in ENDPOINTS:
+        with open(os.path.join(directory, name), encoding="utf-8") as f:
+            fixtures[name] = json.load(f)
+    return fixtures
+
+
+def forecast_days(recorded, days):
+    """Cycles the recorded days so any days=1..14 request gets a full answer."""
+    first = date.fromisoformat(recorded[0]["date"])
+    result = []
+    for i in range(days):
+        day = copy.deepcopy(recorded[i % len(recorded)])
+        when = first + timedelta(days=i)
+        shift = (i - i % len(recorded)) * 86400
+        day["date"] = when.isoformat()
+        day["date_epoch"] += shift
+        for hour in day["hour"]:
+            hour["time_epoch"] += shift
+            hour["time"] = when.isoformat() + hour["time"][10:]
+        result.append(day)
+    return result
+
+
+def api_error(code, message):
+    return {"error": {"code": code, "message": message}}
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    server_version = "weather-mock/1.0"
+
+    def log_message(self, fmt, *args):
+        if self.server.verbose:
+            sys.stderr.write("%s %s\n" % (self.address_string(), fmt % args))
+
+    def send_json(self, status, body, endpoint="", headers=None):
+        payload = json.dumps(body, separators=(",", ":")).encode()
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(payload)))
+        for name, value in (headers or {}).items():
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(payload)
+        if endpoint:
+            self.server.stats.record(endpoint, status, len(payload))
+
+    def do_GET(self):
+        url = urlparse(self.path)
+        params = dict(parse_qsl(url.query, keep_blank_values=True))
+        endpoint = url.path.rsplit("/", 1)[-1]
+
+        if url.path == "/__stats":
+            return self.send_json(200, self.server.stats.as_dict())
+        if url.path == "/__reset":
+            self.server.stats.reset()
+            return self.send_json(200, {"ok": True})
+        if url.path == "/__config":
+            try:
+                self.server.settings.update(params)
+            except ValueError as e:
+                return self.send_json(400, {"ok": False, "error": str(e)})
+            return self.send_json(200, self.server.settings.as_dict())
+
+        delay, fail = self.server.settings.draw()
+        time.sleep(delay)
+
+        if endpoint not in ENDPOINTS:
+            return self.send_json(400, api_error(1005, "API request url is invalid."), endpoint)
+        if not params.get("key"):
+            return self.send_json(401, api_error(1002, "API key is invalid or not provided."), endpoint)
+        if fail:
+            status = self.server.settings.error_status
+            headers = {"Retry-After": str(self.server.settings.retry_after)} if status in (429, 503) else None
+            return self.send_json(status, api_error(9999, "Internal application error."), endpoint, headers)
+        query = params.get("q", "")
+        if not query:
+            return self.send_json(400, api_error(1003, "Parameter q is missing."), endpoint)
+        if self.server.settings.unknown and query == self.server.settings.unknown:
+            return self.send_json(400, api_error(1006, "No matching location found."), endpoint)
+
+        body = copy.deepcopy(self.server.fixtures[endpoint])
+        if endpoint == "ip.json":
+            if query != "auto":
+                body["ip"] = query
+        else:
+            # Coordinates keep the recorded place name, anything else is echoed back
+            if not any(ch.isdigit() for ch in query):
+                body["location"]["name"] = query
+            if endpoint == "forecast.json":
+                days = min(14, max(1, int(params.get("days", "1") or 1)))
+                body["forecast"]["forecastday"] = forecast_days(body["forecast"]["forecastday"], days)
+                if params.get("alerts") != "yes":
+                    body.pop("alerts", None)
+            if params.get("aqi") != "yes":
+                body["current"].pop("air_quality", None)
+        if self.server.settings.pad_bytes > 0:
+            body["padding"] = "x" * self.server.settings.pad_bytes
+        self.send_json(200, body, endpoint)
+
+
+class Server(ThreadingHTTPServer):
+    daemon_threads = True
+    request_queue_size = 512
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Mock WeatherAPI server replaying recorded fixtures")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=8089)
+    parser.add_argument("--fixtures", default=FIXTURE_DIR, help="directory with current/forecast/ip.json")
+    parser.add_argument("--latency", type=float, default=0.0, help="mean response delay in ms")
+    parser.add_argument("--jitter", type=float, default=0.0, help="uniform +/- delay spread in ms")
+    parser.add_argument("--error-rate", type=float, default=0.0, help="fraction of requests that fail (0-1)")
+    parser.add_argument("--error-status", type=int, default=503, help="HTTP status for injected failures")
+    parser.add_argument("--retry-after", type=int, default=1, help="Retry-After seconds sent with 429/503")
+    parser.add_argument("--pad-bytes", type=int, default=0, help="extra bytes added to every response body")
+    parser.add_argument("--unknown", default="", help="a q value answered with 'No matching location found.'")
+    parser.add_argument("--seed", type=int, default=1, help="random seed for latency and failures")
+    parser.add_argument("--verbose", action="store_true", help="log every request to stderr")
+    args = parser.parse_args()
+
+    server = Server((args.host, args.port), Handler)
+    server.fixtures = load_fixtures(args.fixtures)
+    server.settings = Settings(args)
+    server.stats = Stats()
+    server.verbose = args.verbose
+    print("Mock WeatherAPI on http://%s:%d/v1/" % (args.host, server.server_address[1]), flush=True)
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    finally:
+        server.server_close()
+
+
+if __name__ == "__main__":
+    main()
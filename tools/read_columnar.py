@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+"""Decodes a `weather-cli --export --format columnar` file to NDJSON or CSV.
+
+Layout (all integers are LEB128 varints):
+  "WXC1", column count, then each column name as length + UTF-8 bytes
+  row groups until end of file:
+    row count, then per column: chunk length + chunk
+  chunk: type byte (0 null, 1 string, 2 integer, 3 decimal, 4 double),
+         null-bitmap flag byte, bitmap (one bit per row, LSB first) when set,
+         values for the non-null rows:
+           string   dictionary size, entries (length + bytes), one index per row
+           integer  zigzag varint
+           decimal  zigzag varint of value * 1000
+           double   8 little-endian bytes
+"""
+import argparse
+import csv
+import json
+import struct
+import sys
+
+NULLS, STRING, INTEGER, DECIMAL, DOUBLE = range(5)
+
+
+class Reader:
+    def __init__(self, data, pos=0, end=None):
+        self.data = data
+        self.pos = pos
+        self.end = len(data) if end is None else end
+
+    def done(self):
+        return self.pos >= self.end
+
+    def varint(self):
+        value = shift = 0
+        while True:
+            if self.pos >= self.end:
+                raise ValueError("truncated varint at byte %d" % self.pos)
+            byte = self.data[self.pos]
+            self.pos += 1
+            value |= (byte & 0x7F) << shift
+            if byte < 0x80:
+                return value
+            shift += 7
+
+    def zigzag(self):
+        value = self.varint()
+        return (value >> 1) ^ -(value & 1)
+
+    def take(self, count):
+        if self.pos + count > self.end:
+            raise ValueError("truncated data at byte %d" % self.pos)
+        chunk = self.data[self.pos:self.pos + count]
+        self.pos += count
+        return chunk
+
+
+def decode_chunk(reader, rows):
+    kind = reader.take(1)[0]
+    has_bitmap = reader.take(1)[0]
+    if kind == NULLS:
+        return [None] * rows
+    present = [True] * rows
+    if has_bitmap:
+        bitmap = reader.take((rows + 7) // 8)
+        present = [bool(bitmap[i // 8] >> (i % 8) & 1) for i in range(rows)]
+    count = sum(present)
+
+    if kind == STRING:
+        dictionary = [reader.take(reader.varint()).decode("utf-8") for _ in range(reader.varint())]
+        values = [dictionary[reader.varint()] for _ in range(count)]
+    elif kind == INTEGER:
+        values = [reader.zigzag() for _ in range(count)]
+    elif kind == DECIMAL:
+        values = [reader.zigzag() / 1000 for _ in range(count)]
+    elif kind == DOUBLE:
+        values = [struct.unpack("<d", reader.take(8))[0] for _ in range(count)]
+    else:
+        raise ValueError("unknown column type %d" % kind)
+
+    it = iter(values)
+    return [next(it) if p else None for p in present]
+
+
+def read(data):
+    reader = Reader(data)
+    if reader.take(4) != b"WXC1":
+        raise ValueError("not a columnar export (bad magic)")
+    columns = [reader.take(reader.varint()).decode("utf-8") for _ in range(reader.varint())]
+    while not reader.done():
+        rows = reader.varint()
+        table = []
+        for _ in columns:
+            length = reader.varint()
+            chunk = Reader(data, reader.pos, reader.pos + length)
+            table.append(decode_chunk(chunk, rows))
+            reader.pos += length
+        for i in range(rows):
+            yield columns, [column[i] for column in table]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("file")
+    parser.add_argument("--csv", action="store_true", help="write CSV instead of NDJSON")
+    args = parser.parse_args()
+
+    with open(args.file, "rb") as f:
+        data = f.read()
+    writer = None
+    for columns, values in read(data):
+        if args.csv:
+            if writer is None:
+                writer = csv.writer(sys.stdout, lineterminator="\n")
+                writer.writerow(columns)
+            writer.writerow("" if v is None else v for v in values)
+        else:
+            print(json.dumps(dict(zip(columns, values)), ensure_ascii=False))
+
+
+if __name__ == "__main__":
+    main()
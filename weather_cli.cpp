@@ -13,46 +13,173 @@
 #include <memory>
 #include <unordered_map>
 #include <ctime>
-#include <regex>
+#include <optional>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <deque>
+#include <queue>
+#include <unordered_set>
+#include <atomic>
+#include <filesystem>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <csignal>
+#include <future>
+#include <random>
+#include <string_view>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // SIGPIPE is ignored instead where the flag is missing
+#endif
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+// curl_multi_poll and curl_multi_wakeup drive the request scheduler
+#if LIBCURL_VERSION_NUM < 0x074400
+#error "weather-cli needs libcurl 7.68 or newer"
+#endif
 
 using json = nlohmann::json;
+using JsonPtr = std::shared_ptr<const json>;
+// Raised by the caller to abort an in-flight request
+using CancelFlag = std::atomic<bool>;
+
+#ifndef VERSION
+#define VERSION "2.0.0"
+#endif
 
 // Enhanced ANSI escape codes with 256-color support
 namespace Colors {
-    const std::string BOLD = "\033[1m";
-    const std::string DIM = "\033[2m";
-    const std::string ITALIC = "\033[3m";
-    const std::string UNDERLINE = "\033[4m";
-    const std::string BLINK = "\033[5m";
-    const std::string REVERSE = "\033[7m";
-    const std::string RESET = "\033[0m";
+    inline constexpr std::string_view BOLD = "\033[1m";
+    inline constexpr std::string_view DIM = "\033[2m";
+    inline constexpr std::string_view ITALIC = "\033[3m";
+    inline constexpr std::string_view UNDERLINE = "\033[4m";
+    inline constexpr std::string_view BLINK = "\033[5m";
+    inline constexpr std::string_view REVERSE = "\033[7m";
+    inline constexpr std::string_view RESET = "\033[0m";
     
     // Enhanced color palette
-    const std::string RED = "\033[38;5;196m";
-    const std::string ORANGE = "\033[38;5;208m";
-    const std::string YELLOW = "\033[38;5;226m";
-    const std::string GREEN = "\033[38;5;82m";
-    const std::string CYAN = "\033[38;5;87m";
-    const std::string BLUE = "\033[38;5;75m";
-    const std::string PURPLE = "\033[38;5;141m";
-    const std::string PINK = "\033[38;5;213m";
-    const std::string GRAY = "\033[38;5;246m";
-    const std::string WHITE = "\033[38;5;255m";
-    const std::string DARK_GRAY = "\033[38;5;240m";
+    inline constexpr std::string_view RED = "\033[38;5;196m";
+    inline constexpr std::string_view ORANGE = "\033[38;5;208m";
+    inline constexpr std::string_view YELLOW = "\033[38;5;226m";
+    inline constexpr std::string_view GREEN = "\033[38;5;82m";
+    inline constexpr std::string_view CYAN = "\033[38;5;87m";
+    inline constexpr std::string_view BLUE = "\033[38;5;75m";
+    inline constexpr std::string_view PURPLE = "\033[38;5;141m";
+    inline constexpr std::string_view PINK = "\033[38;5;213m";
+    inline constexpr std::string_view GRAY = "\033[38;5;246m";
+    inline constexpr std::string_view WHITE = "\033[38;5;255m";
+    inline constexpr std::string_view DARK_GRAY = "\033[38;5;240m";
     
     // Gradient colors for weather conditions
-    const std::string SUNNY = "\033[38;5;226m";
-    const std::string CLOUDY = "\033[38;5;250m";
-    const std::string RAINY = "\033[38;5;75m";
-    const std::string SNOWY = "\033[38;5;255m";
-    const std::string STORMY = "\033[38;5;93m";
+    inline constexpr std::string_view SUNNY = "\033[38;5;226m";
+    inline constexpr std::string_view CLOUDY = "\033[38;5;250m";
+    inline constexpr std::string_view RAINY = "\033[38;5;75m";
+    inline constexpr std::string_view SNOWY = "\033[38;5;255m";
+    inline constexpr std::string_view STORMY = "\033[38;5;93m";
     
     // Background colors
-    const std::string BG_BLUE = "\033[48;5;18m";
-    const std::string BG_DARK = "\033[48;5;236m";
-    const std::string BG_RED = "\033[48;5;88m";
-    const std::string BG_GREEN = "\033[48;5;22m";
-    const std::string BG_YELLOW = "\033[48;5;94m";
+    inline constexpr std::string_view BG_BLUE = "\033[48;5;18m";
+    inline constexpr std::string_view BG_DARK = "\033[48;5;236m";
+    inline constexpr std::string_view BG_RED = "\033[48;5;88m";
+    inline constexpr std::string_view BG_GREEN = "\033[48;5;22m";
+    inline constexpr std::string_view BG_YELLOW = "\033[48;5;94m";
+}
+
+// WeatherAPI condition codes mapped to a category, icon and color at compile
+// time. The sparse codes 1000-1282 are folded into a dense index so a lookup
+// is a range check and two array loads.
+namespace Conditions {
+    enum Category : std::uint8_t {
+        UNKNOWN, CLEAR, PARTLY_CLOUDY, CLOUDY, FOG, DRIZZLE, RAIN, SLEET, SNOW, THUNDER, CATEGORY_COUNT
+    };
+
+    struct Style {
+        std::string_view icon;
+        std::string_view color;
+        std::string_view name;
+    };
+
+    inline constexpr Style STYLES[CATEGORY_COUNT] = {
+        {"🌤️", Colors::WHITE, "unknown"},
+        {"☀️", Colors::SUNNY, "clear"},
+        {"⛅", Colors::SUNNY, "partly-cloudy"},
+        {"☁️", Colors::CLOUDY, "cloudy"},
+        {"🌫️", Colors::GRAY, "fog"},
+        {"🌦️", Colors::RAINY, "drizzle"},
+        {"🌧️", Colors::RAINY, "rain"},
+        {"🌨️", Colors::CYAN, "sleet"},
+        {"❄️", Colors::SNOWY, "snow"},
+        {"⛈️", Colors::STORMY, "thunder"},
+    };
+
+    struct Code {
+        int code;
+        Category category;
+    };
+
+    // https://www.weatherapi.com/docs/weather_conditions.json, sorted by code
+    inline constexpr Code CODES[] = {
+        {1000, CLEAR}, {1003, PARTLY_CLOUDY}, {1006, CLOUDY}, {1009, CLOUDY},
+        {1030, FOG}, {1063, RAIN}, {1066, SNOW}, {1069, SLEET},
+        {1072, SLEET}, {1087, THUNDER}, {1114, SNOW}, {1117, SNOW},
+        {1135, FOG}, {1147, FOG}, {1150, DRIZZLE}, {1153, DRIZZLE},
+        {1168, SLEET}, {1171, SLEET}, {1180, RAIN}, {1183, RAIN},
+        {1186, RAIN}, {1189, RAIN}, {1192, RAIN}, {1195, RAIN},
+        {1198, SLEET}, {1201, SLEET}, {1204, SLEET}, {1207, SLEET},
+        {1210, SNOW}, {1213, SNOW}, {1216, SNOW}, {1219, SNOW},
+        {1222, SNOW}, {1225, SNOW}, {1237, SLEET}, {1240, RAIN},
+        {1243, RAIN}, {1246, RAIN}, {1249, SLEET}, {1252, SLEET},
+        {1255, SNOW}, {1258, SNOW}, {1261, SLEET}, {1264, SLEET},
+        {1273, THUNDER}, {1276, THUNDER}, {1279, THUNDER}, {1282, THUNDER},
+    };
+
+    inline constexpr int FIRST_CODE = 1000;
+    inline constexpr int LAST_CODE = 1282;
+
+    struct Index {
+        Category categories[LAST_CODE - FIRST_CODE + 1];
+    };
+
+    constexpr Index build_index() {
+        Index index{};
+        for (const Code& entry : CODES) index.categories[entry.code - FIRST_CODE] = entry.category;
+        return index;
+    }
+
+    inline constexpr Index INDEX = build_index();
+
+    constexpr Category from_code(int code) {
+        return code < FIRST_CODE || code > LAST_CODE ? UNKNOWN : INDEX.categories[code - FIRST_CODE];
+    }
+
+    constexpr bool codes_sorted() {
+        for (size_t i = 0; i < std::size(CODES); ++i) {
+            if (CODES[i].code < FIRST_CODE || CODES[i].code > LAST_CODE) return false;
+            if (i > 0 && CODES[i - 1].code >= CODES[i].code) return false;
+        }
+        return true;
+    }
+
+    static_assert(codes_sorted(), "condition codes must be unique, sorted and within range");
+    static_assert(from_code(1000) == CLEAR && from_code(1282) == THUNDER && from_code(1001) == UNKNOWN);
 }
 
 // Configuration class for better organization
@@ -60,19 +187,38 @@ class Config {
 public:
     static std::string API_KEY;
     static std::string BASE_URL;
+    // base_url as read from the config file; the only one save_config writes back
+    static std::string CONFIG_BASE_URL;
     static int TIMEOUT;
     static std::string USER_AGENT;
     static std::string CONFIG_FILE;
+    static int CACHE_SIZE_MB;
+    static int MAX_STALE_MINUTES;
+    static int REFRESH_TOP_KEYS;
+    static int COORD_PRECISION;
+    static double REUSE_RADIUS_KM;
+    static int REUSE_MAX_AGE_MINUTES;
+    static std::string LOG_LEVEL;
     
     static bool load_config();
     static bool save_config();
+    // Accepts the root with or without a trailing slash
+    static void set_base_url(const std::string& url);
 };
 
 std::string Config::API_KEY = "f807e87175ee4ff98f551941252009";
 std::string Config::BASE_URL = "https://api.weatherapi.com/v1/";
+std::string Config::CONFIG_BASE_URL;
 int Config::TIMEOUT = 15;
 std::string Config::USER_AGENT = "WeatherCLI-Pro/2.0";
 std::string Config::CONFIG_FILE = "weather_cli_config.json";
+int Config::CACHE_SIZE_MB = 64;
+int Config::MAX_STALE_MINUTES = 30;
+int Config::REFRESH_TOP_KEYS = 0;
+int Config::COORD_PRECISION = 2;  // decimals kept in coordinate cache keys, ~1 km
+double Config::REUSE_RADIUS_KM = 1.0;  // 0 turns nearby reuse off
+int Config::REUSE_MAX_AGE_MINUTES = 5;
+std::string Config::LOG_LEVEL = "info";
 
 bool Config::load_config() {
     std::ifstream file(CONFIG_FILE);
@@ -82,12 +228,29 @@ bool Config::load_config() {
             file >> config;
             if (config.contains("api_key")) API_KEY = config["api_key"];
             if (config.contains("timeout")) TIMEOUT = config["timeout"];
-            return true;
+            if (config.contains("cache_size_mb")) CACHE_SIZE_MB = config["cache_size_mb"];
+            if (config.contains("max_stale_minutes")) MAX_STALE_MINUTES = config["max_stale_minutes"];
+            if (config.contains("refresh_top_keys")) REFRESH_TOP_KEYS = config["refresh_top_keys"];
+            if (config.contains("coordinate_precision")) COORD_PRECISION = config["coordinate_precision"];
+            if (config.contains("reuse_radius_km")) REUSE_RADIUS_KM = config["reuse_radius_km"];
+            if (config.contains("reuse_max_age_minutes")) REUSE_MAX_AGE_MINUTES = config["reuse_max_age_minutes"];
+            if (config.contains("log_level")) LOG_LEVEL = config["log_level"];
+            if (config.contains("base_url")) {
+                CONFIG_BASE_URL = config["base_url"];
+                set_base_url(CONFIG_BASE_URL);
+            }
         } catch (...) {
             return false;
         }
     }
-    return false;
+    // Points every lookup at a mirror or a local mock server without editing files
+    if (const char* url = std::getenv("WEATHER_CLI_BASE_URL")) set_base_url(url);
+    return file.is_open();
+}
+
+void Config::set_base_url(const std::string& url) {
+    if (url.empty()) return;
+    BASE_URL = url.back() == '/' ? url : url + "/";
 }
 
 bool Config::save_config() {
@@ -96,519 +259,6613 @@ bool Config::save_config() {
         json config;
         config["api_key"] = API_KEY;
         config["timeout"] = TIMEOUT;
+        config["cache_size_mb"] = CACHE_SIZE_MB;
+        config["max_stale_minutes"] = MAX_STALE_MINUTES;
+        config["refresh_top_keys"] = REFRESH_TOP_KEYS;
+        config["coordinate_precision"] = COORD_PRECISION;
+        config["reuse_radius_km"] = REUSE_RADIUS_KM;
+        config["reuse_max_age_minutes"] = REUSE_MAX_AGE_MINUTES;
+        config["log_level"] = LOG_LEVEL;
+        // An override from WEATHER_CLI_BASE_URL or --base-url is for this run only
+        if (!CONFIG_BASE_URL.empty()) config["base_url"] = CONFIG_BASE_URL;
         file << config.dump(4);
         return true;
     }
     return false;
 }
 
+// Compile-time floor for log statements (0=DEBUG .. 3=ERROR); LOG_* calls below it compile away
+#ifndef WEATHER_CLI_LOG_LEVEL
+#define WEATHER_CLI_LOG_LEVEL 0
+#endif
+
 // Enhanced logging system
+// Producers push into a lock-free bounded ring; one writer thread formats and
+// appends lines to the log file in batches. When the ring is full, messages are
+// dropped and counted instead of blocking the caller.
 class Logger {
+public:
+    enum Level { DEBUG, INFO, WARNING, ERROR };
+
+    static constexpr size_t RING_CAPACITY = 4096;  // power of two
+    static constexpr size_t BATCH_BYTES = 64 * 1024;
+
+    static void enable_logging(bool enable = true);
+    static bool is_enabled() { return logging_enabled.load(std::memory_order_relaxed); }
+    static void set_level(Level level) { min_level.store(level, std::memory_order_relaxed); }
+    static Level level() { return static_cast<Level>(min_level.load(std::memory_order_relaxed)); }
+    static bool should_log(Level level) {
+        return level >= min_level.load(std::memory_order_relaxed) && is_enabled();
+    }
+    static Level parse_level(const std::string& name, Level fallback = INFO);
+    static const char* level_name(Level level);
+
+    // Prefer the LOG_* macros, which skip formatting the message for filtered levels
+    static void log(Level level, std::string message);
+    static void shutdown();
+    static uint64_t dropped() { return dropped_count.load(std::memory_order_relaxed); }
+
 private:
+    struct Slot {
+        std::atomic<size_t> sequence{0};
+        Level level = INFO;
+        std::chrono::system_clock::time_point time;
+        std::string message;
+    };
+
+    // Bounded MPSC queue after Vyukov: a slot is writable when its sequence equals
+    // the producer's position and readable when it equals position + 1.
+    struct Ring {
+        Slot slots[RING_CAPACITY];
+        alignas(64) std::atomic<size_t> enqueue_pos{0};
+        alignas(64) size_t dequeue_pos = 0;  // writer thread only
+        Ring() {
+            for (size_t i = 0; i < RING_CAPACITY; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    };
+
+    struct Writer {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::atomic<bool> sleeping{false};
+        bool stop = false;
+        ~Writer() { Logger::shutdown(); }
+    };
+
     static std::string log_file;
-    static bool logging_enabled;
+    static std::atomic<bool> logging_enabled;
+    static std::atomic<int> min_level;
+    static std::atomic<uint64_t> dropped_count;
+    static Ring ring;
+    static Writer writer;  // defined after ring so it is destroyed (and drained) first
 
-public:
-    enum Level { DEBUG, INFO, WARNING, ERROR };
-    
-    static void enable_logging(bool enable = true) { logging_enabled = enable; }
-    static void log(Level level, const std::string& message);
-    static void debug(const std::string& message) { log(DEBUG, message); }
-    static void info(const std::string& message) { log(INFO, message); }
-    static void warning(const std::string& message) { log(WARNING, message); }
-    static void error(const std::string& message) { log(ERROR, message); }
+    static bool pending();
+    static void run_writer();
+    static void append_line(std::string& batch, Level level, std::chrono::system_clock::time_point time,
+                            const std::string& message);
 };
 
+#define WEATHER_LOG(level, message) \
+    do { \
+        if ((level) >= WEATHER_CLI_LOG_LEVEL && Logger::should_log(level)) Logger::log((level), (message)); \
+    } while (0)
+#define LOG_DEBUG(message) WEATHER_LOG(Logger::DEBUG, message)
+#define LOG_INFO(message) WEATHER_LOG(Logger::INFO, message)
+#define LOG_WARNING(message) WEATHER_LOG(Logger::WARNING, message)
+#define LOG_ERROR(message) WEATHER_LOG(Logger::ERROR, message)
+
 std::string Logger::log_file = "weather_cli.log";
-bool Logger::logging_enabled = false;
+std::atomic<bool> Logger::logging_enabled{false};
+std::atomic<int> Logger::min_level{Logger::INFO};
+std::atomic<uint64_t> Logger::dropped_count{0};
+Logger::Ring Logger::ring;
+Logger::Writer Logger::writer;
 
-void Logger::log(Level level, const std::string& message) {
-    if (!logging_enabled) return;
-    
-    std::ofstream file(log_file, std::ios::app);
-    if (file.is_open()) {
-        auto now = std::chrono::system_clock::now();
-        auto time_t = std::chrono::system_clock::to_time_t(now);
-        
-        std::string level_str;
-        switch (level) {
-            case DEBUG: level_str = "DEBUG"; break;
-            case INFO: level_str = "INFO"; break;
-            case WARNING: level_str = "WARNING"; break;
-            case ERROR: level_str = "ERROR"; break;
+Logger::Level Logger::parse_level(const std::string& name, Level fallback) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c) { return std::tolower(c); });
+    if (lower == "debug") return DEBUG;
+    if (lower == "info") return INFO;
+    if (lower == "warning" || lower == "warn") return WARNING;
+    if (lower == "error") return ERROR;
+    return fallback;
+}
+
+const char* Logger::level_name(Level level) {
+    switch (level) {
+        case DEBUG: return "DEBUG";
+        case INFO: return "INFO";
+        case WARNING: return "WARNING";
+        case ERROR: return "ERROR";
+    }
+    return "INFO";
+}
+
+void Logger::enable_logging(bool enable) {
+    std::lock_guard<std::mutex> lock(writer.mutex);
+    logging_enabled.store(enable, std::memory_order_relaxed);
+    if (enable && !writer.thread.joinable()) {
+        writer.stop = false;
+        writer.thread = std::thread(run_writer);
+    }
+}
+
+void Logger::log(Level level, std::string message) {
+    if (!should_log(level)) return;
+
+    size_t pos = ring.enqueue_pos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    for (;;) {
+        slot = &ring.slots[pos & (RING_CAPACITY - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+        if (diff == 0) {
+            if (ring.enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+        } else if (diff < 0) {
+            dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = ring.enqueue_pos.load(std::memory_order_relaxed);
         }
-        
-        file << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S") 
-             << " [" << level_str << "] " << message << std::endl;
     }
+
+    slot->level = level;
+    slot->time = std::chrono::system_clock::now();
+    slot->message = std::move(message);
+    slot->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+    // A wakeup lost to the race with the writer going idle only delays it one poll interval
+    if (writer.sleeping.load(std::memory_order_seq_cst)) writer.wake.notify_one();
 }
 
-// Enhanced HTTP client with retry logic and caching
-class HttpClient {
-private:
-    static std::unordered_map<std::string, std::pair<json, std::chrono::steady_clock::time_point>> cache;
-    static const std::chrono::minutes CACHE_DURATION;
+bool Logger::pending() {
+    const Slot& slot = ring.slots[ring.dequeue_pos & (RING_CAPACITY - 1)];
+    return slot.sequence.load(std::memory_order_seq_cst) == ring.dequeue_pos + 1;
+}
 
-public:
-    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp);
-    static json make_request(const std::string& url, bool use_cache = true, int retries = 3);
-    static void clear_cache() { cache.clear(); }
-};
+void Logger::append_line(std::string& batch, Level level, std::chrono::system_clock::time_point time,
+                         const std::string& message) {
+    // Formatting the timestamp is the expensive part; reuse it within the same second
+    static std::time_t cached_second = -1;
+    static char stamp[32];
 
-std::unordered_map<std::string, std::pair<json, std::chrono::steady_clock::time_point>> HttpClient::cache;
-const std::chrono::minutes HttpClient::CACHE_DURATION(5);
+    std::time_t second = std::chrono::system_clock::to_time_t(time);
+    if (second != cached_second) {
+        std::tm local{};
+#ifndef _WIN32
+        localtime_r(&second, &local);
+#else
+        localtime_s(&local, &second);
+#endif
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &local);
+        cached_second = second;
+    }
 
-size_t HttpClient::WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
-    userp->append((char*)contents, size * nmemb);
-    return size * nmemb;
+    batch.append(stamp);
+    batch.append(" [");
+    batch.append(level_name(level));
+    batch.append("] ");
+    batch.append(message);
+    batch.push_back('\n');
 }
 
-json HttpClient::make_request(const std::string& url, bool use_cache, int retries) {
-    // Check cache first
-    if (use_cache && cache.find(url) != cache.end()) {
-        auto& [cached_data, timestamp] = cache[url];
-        auto now = std::chrono::steady_clock::now();
-        if (now - timestamp < CACHE_DURATION) {
-            Logger::debug("Using cached data for: " + url);
-            return cached_data;
-        } else {
-            cache.erase(url);
+void Logger::run_writer() {
+    std::ofstream file;
+    std::string batch;
+    batch.reserve(BATCH_BYTES);
+    uint64_t reported_drops = dropped_count.load(std::memory_order_relaxed);
+
+    auto write_batch = [&]() {
+        if (batch.empty()) return;
+        if (!file.is_open()) file.open(log_file, std::ios::app | std::ios::binary);
+        if (file.is_open()) {
+            file.write(batch.data(), static_cast<std::streamsize>(batch.size()));
+            file.flush();
+        }
+        batch.clear();
+    };
+
+    for (;;) {
+        while (pending()) {
+            Slot& slot = ring.slots[ring.dequeue_pos & (RING_CAPACITY - 1)];
+            append_line(batch, slot.level, slot.time, slot.message);
+            slot.message.clear();
+            slot.sequence.store(ring.dequeue_pos + RING_CAPACITY, std::memory_order_release);
+            ++ring.dequeue_pos;
+            if (batch.size() >= BATCH_BYTES) write_batch();
         }
+
+        uint64_t drops = dropped_count.load(std::memory_order_relaxed);
+        if (drops != reported_drops) {
+            append_line(batch, WARNING, std::chrono::system_clock::now(),
+                        std::to_string(drops - reported_drops) + " log messages dropped (queue full)");
+            reported_drops = drops;
+        }
+        write_batch();
+
+        std::unique_lock<std::mutex> lock(writer.mutex);
+        if (writer.stop && !pending()) break;
+        writer.sleeping.store(true, std::memory_order_seq_cst);
+        writer.wake.wait_for(lock, std::chrono::milliseconds(50), [] { return writer.stop || pending(); });
+        writer.sleeping.store(false, std::memory_order_relaxed);
     }
+}
 
-    std::string response_string;
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        Logger::error("Failed to initialize curl");
-        return nullptr;
+// Drains everything queued so far and stops the writer thread
+void Logger::shutdown() {
+    std::unique_lock<std::mutex> lock(writer.mutex);
+    if (!writer.thread.joinable()) return;
+    logging_enabled.store(false, std::memory_order_relaxed);
+    writer.stop = true;
+    lock.unlock();
+    writer.wake.notify_all();
+    writer.thread.join();
+}
+
+// Where lookups spend their time: a latency histogram per stage plus cache and
+// HTTP counters. Recording is lock-free so it is safe from any worker thread.
+// --stats prints a summary on exit; --metrics-file writes Prometheus text format.
+class Metrics {
+public:
+    enum Stage { DNS, CONNECT, TLS, TTFB, TRANSFER, HTTP_TOTAL, PARSE, DECODE, RENDER, STAGE_COUNT };
+    enum Counter {
+        CACHE_HITS, CACHE_STALE, CACHE_NEARBY, CACHE_MISSES,
+        HTTP_REQUESTS, HTTP_RETRIES, HTTP_FAILURES, BYTES_RECEIVED,
+        CONNECTIONS_NEW, CONNECTIONS_REUSED, CIRCUIT_REJECTED, COUNTER_COUNT
+    };
+
+    // Observes the enclosing scope's duration
+    class Timer {
+    public:
+        explicit Timer(Stage timed) : stage(timed), start(std::chrono::steady_clock::now()) {}
+        ~Timer() { observe(stage, std::chrono::steady_clock::now() - start); }
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+    private:
+        Stage stage;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    static bool print_on_exit;
+    static std::string export_path;
+
+    static void observe(Stage stage, std::chrono::steady_clock::duration elapsed);
+    static void add(Counter counter, uint64_t amount = 1) {
+        counters[counter].fetch_add(amount, std::memory_order_relaxed);
     }
+    // Splits one finished transfer into DNS, connect, TLS, TTFB and transfer time
+    static void record_transfer(CURL* curl);
 
-    // Enhanced curl options
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, Config::USER_AGENT.c_str());
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, Config::TIMEOUT);
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
-    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    static std::string summary();
+    static std::string prometheus();
+    static bool write_prometheus(const std::string& path);
+    // --stats and --metrics-file output, once all work is done
+    static void finish();
 
-    CURLcode res;
-    int attempt = 0;
-    
-    while (attempt < retries) {
-        res = curl_easy_perform(curl);
-        if (res == CURLE_OK) break;
-        
-        attempt++;
-        Logger::warning("Request attempt " + std::to_string(attempt) + " failed: " + curl_easy_strerror(res));
-        
-        if (attempt < retries) {
-            std::this_thread::sleep_for(std::chrono::seconds(attempt * 2)); // Exponential backoff
+private:
+    static constexpr size_t BUCKETS = 17;
+    static const uint64_t BUCKET_BOUNDS_US[BUCKETS];
+    static const char* const STAGE_NAMES[STAGE_COUNT];
+
+    struct Histogram {
+        std::atomic<uint64_t> buckets[BUCKETS + 1] = {};  // last one is +Inf
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sum_us{0};
+        std::atomic<uint64_t> min_us{UINT64_MAX};
+        std::atomic<uint64_t> max_us{0};
+    };
+
+    static Histogram histograms[STAGE_COUNT];
+    static std::atomic<uint64_t> counters[COUNTER_COUNT];
+
+    static void observe_us(Stage stage, uint64_t us);
+    static double quantile_us(const Histogram& histogram, double q);
+    static std::string format_duration(double us);
+};
+
+bool Metrics::print_on_exit = false;
+std::string Metrics::export_path;
+// 50us .. 10s: rendering and parsing sit at the low end, slow networks at the top
+const uint64_t Metrics::BUCKET_BOUNDS_US[BUCKETS] = {
+    50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+const char* const Metrics::STAGE_NAMES[STAGE_COUNT] = {
+    "dns", "connect", "tls", "ttfb", "transfer", "http_total", "parse", "decode", "render"
+};
+Metrics::Histogram Metrics::histograms[STAGE_COUNT];
+std::atomic<uint64_t> Metrics::counters[COUNTER_COUNT];
+
+void Metrics::observe(Stage stage, std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    observe_us(stage, static_cast<uint64_t>(std::max<int64_t>(0, us)));
+}
+
+void Metrics::observe_us(Stage stage, uint64_t us) {
+    Histogram& histogram = histograms[stage];
+    size_t bucket = static_cast<size_t>(
+        std::lower_bound(BUCKET_BOUNDS_US, BUCKET_BOUNDS_US + BUCKETS, us) - BUCKET_BOUNDS_US);
+    histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    histogram.count.fetch_add(1, std::memory_order_relaxed);
+    histogram.sum_us.fetch_add(us, std::memory_order_relaxed);
+    uint64_t seen = histogram.min_us.load(std::memory_order_relaxed);
+    while (us < seen && !histogram.min_us.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+    seen = histogram.max_us.load(std::memory_order_relaxed);
+    while (us > seen && !histogram.max_us.compare_exchange_weak(seen, us, std::memory_order_relaxed)) {}
+}
+
+void Metrics::record_transfer(CURL* curl) {
+    // Each *_TIME_T value is microseconds from the start of the transfer
+    curl_off_t namelookup = 0, connect = 0, appconnect = 0, pretransfer = 0, starttransfer = 0, total = 0;
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &namelookup);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &appconnect);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &starttransfer);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_off_t received = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+
+    auto span = [](curl_off_t from, curl_off_t to) { return static_cast<uint64_t>(std::max<curl_off_t>(0, to - from)); };
+    // A reused connection skips name lookup, connect and handshake entirely
+    if (new_connections > 0) {
+        add(CONNECTIONS_NEW, static_cast<uint64_t>(new_connections));
+        observe_us(DNS, span(0, namelookup));
+        observe_us(CONNECT, span(namelookup, connect));
+        if (appconnect > 0) observe_us(TLS, span(connect, appconnect));
+    } else if (total > 0) {
+        add(CONNECTIONS_REUSED);
+    }
+    if (starttransfer > 0) {
+        observe_us(TTFB, span(pretransfer, starttransfer));
+        observe_us(TRANSFER, span(starttransfer, total));
+    }
+    observe_us(HTTP_TOTAL, span(0, total));
+    add(BYTES_RECEIVED, static_cast<uint64_t>(std::max<curl_off_t>(0, received)));
+}
+
+// Linear interpolation inside the bucket holding the q-th observation,
+// narrowed to the smallest and largest values actually seen
+double Metrics::quantile_us(const Histogram& histogram, double q) {
+    uint64_t count = histogram.count.load(std::memory_order_relaxed);
+    if (count == 0) return 0;
+    double rank = q * static_cast<double>(count);
+    uint64_t seen = 0;
+    double min_us = static_cast<double>(histogram.min_us.load(std::memory_order_relaxed));
+    double max_us = static_cast<double>(histogram.max_us.load(std::memory_order_relaxed));
+    for (size_t i = 0; i <= BUCKETS; ++i) {
+        uint64_t in_bucket = histogram.buckets[i].load(std::memory_order_relaxed);
+        if (in_bucket == 0 || static_cast<double>(seen + in_bucket) < rank) {
+            seen += in_bucket;
+            continue;
         }
+        double lower = std::max(min_us, i == 0 ? 0.0 : static_cast<double>(BUCKET_BOUNDS_US[i - 1]));
+        double upper = std::min(max_us, i == BUCKETS ? max_us : static_cast<double>(BUCKET_BOUNDS_US[i]));
+        double fraction = (rank - static_cast<double>(seen)) / static_cast<double>(in_bucket);
+        return lower + (upper - lower) * fraction;
     }
+    return max_us;
+}
 
-    curl_easy_cleanup(curl);
+std::string Metrics::format_duration(double us) {
+    std::ostringstream out;
+    out << std::fixed;
+    if (us < 1000) out << std::setprecision(0) << us << "us";
+    else if (us < 1000000) out << std::setprecision(1) << us / 1000 << "ms";
+    else out << std::setprecision(2) << us / 1000000 << "s";
+    return out.str();
+}
 
-    if (res != CURLE_OK) {
-        Logger::error("Request failed after " + std::to_string(retries) + " attempts: " + curl_easy_strerror(res));
-        return nullptr;
+std::string Metrics::summary() {
+    std::ostringstream out;
+    out << "Stage          count      p50      p90      p99      max     mean\n";
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        const Histogram& histogram = histograms[stage];
+        uint64_t count = histogram.count.load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        double mean = static_cast<double>(histogram.sum_us.load(std::memory_order_relaxed)) / static_cast<double>(count);
+        out << std::left << std::setw(12) << STAGE_NAMES[stage] << std::right << std::setw(8) << count;
+        for (double value : {quantile_us(histogram, 0.5), quantile_us(histogram, 0.9), quantile_us(histogram, 0.99),
+                             static_cast<double>(histogram.max_us.load(std::memory_order_relaxed)), mean}) {
+            out << std::setw(9) << format_duration(value);
+        }
+        out << "\n";
     }
 
-    try {
-        json data = json::parse(response_string);
-        if (data.contains("error")) {
-            Logger::error("API Error: " + data["error"]["message"].get<std::string>());
-            return nullptr;
+    auto value = [](Counter counter) { return counters[counter].load(std::memory_order_relaxed); };
+    uint64_t served = value(CACHE_HITS) + value(CACHE_STALE) + value(CACHE_NEARBY);
+    uint64_t lookups = served + value(CACHE_MISSES);
+    out << "Cache: " << value(CACHE_HITS) << " hits, " << value(CACHE_STALE) << " stale, ";
+    if (value(CACHE_NEARBY) > 0) out << value(CACHE_NEARBY) << " nearby, ";
+    out << value(CACHE_MISSES) << " misses";
+    if (lookups > 0) {
+        out << " (" << served * 100 / lookups << "% served from cache)";
+    }
+    out << "\nHTTP: " << value(HTTP_REQUESTS) << " requests, " << value(HTTP_RETRIES) << " retries, "
+        << value(HTTP_FAILURES) << " failures, " << value(BYTES_RECEIVED) / 1024 << " KiB received, "
+        << value(CONNECTIONS_NEW) << " new / " << value(CONNECTIONS_REUSED) << " reused connections";
+    if (value(CIRCUIT_REJECTED) > 0) out << ", " << value(CIRCUIT_REJECTED) << " rejected by an open circuit";
+    out << "\n";
+    return out.str();
+}
+
+std::string Metrics::prometheus() {
+    std::ostringstream out;
+    out.precision(9);
+    out << "# HELP weather_cli_stage_duration_seconds Time spent per lookup stage.\n"
+        << "# TYPE weather_cli_stage_duration_seconds histogram\n";
+    for (size_t stage = 0; stage < STAGE_COUNT; ++stage) {
+        const Histogram& histogram = histograms[stage];
+        const std::string label = std::string("stage=\"") + STAGE_NAMES[stage] + "\"";
+        uint64_t cumulative = 0;
+        for (size_t i = 0; i <= BUCKETS; ++i) {
+            cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+            out << "weather_cli_stage_duration_seconds_bucket{" << label << ",le=\"";
+            if (i == BUCKETS) out << "+Inf";
+            else out << static_cast<double>(BUCKET_BOUNDS_US[i]) / 1e6;
+            out << "\"} " << cumulative << "\n";
         }
-        
-        // Cache successful response
-        if (use_cache) {
-            cache[url] = {data, std::chrono::steady_clock::now()};
+        out << "weather_cli_stage_duration_seconds_sum{" << label << "} "
+            << static_cast<double>(histogram.sum_us.load(std::memory_order_relaxed)) / 1e6 << "\n"
+            << "weather_cli_stage_duration_seconds_count{" << label << "} "
+            << histogram.count.load(std::memory_order_relaxed) << "\n";
+    }
+
+    auto counter = [&out](const char* name, const char* help, std::initializer_list<std::pair<const char*, Counter>> series) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n";
+        for (const auto& [labels, which] : series) {
+            out << name << labels << " " << counters[which].load(std::memory_order_relaxed) << "\n";
         }
-        
-        return data;
-    } catch (const json::parse_error& e) {
-        Logger::error("JSON parsing error: " + std::string(e.what()));
-        return nullptr;
+    };
+    counter("weather_cli_cache_lookups_total", "Cache lookups by result.",
+            {{"{result=\"hit\"}", CACHE_HITS}, {"{result=\"stale\"}", CACHE_STALE},
+             {"{result=\"nearby\"}", CACHE_NEARBY}, {"{result=\"miss\"}", CACHE_MISSES}});
+    counter("weather_cli_http_requests_total", "HTTP requests sent, retries included.", {{"", HTTP_REQUESTS}});
+    counter("weather_cli_http_retries_total", "HTTP requests that repeated a failed attempt.", {{"", HTTP_RETRIES}});
+    counter("weather_cli_http_failures_total", "Requests that failed after all attempts.", {{"", HTTP_FAILURES}});
+    counter("weather_cli_http_received_bytes_total", "Response body bytes received.", {{"", BYTES_RECEIVED}});
+    counter("weather_cli_connections_total", "Transfers by connection reuse.",
+            {{"{kind=\"new\"}", CONNECTIONS_NEW}, {"{kind=\"reused\"}", CONNECTIONS_REUSED}});
+    counter("weather_cli_circuit_rejections_total", "Requests failed fast because the host's circuit was open.",
+            {{"", CIRCUIT_REJECTED}});
+    return out.str();
+}
+
+// Written beside the target and renamed so a scraper never reads half a file
+bool Metrics::write_prometheus(const std::string& path) {
+    std::string temp = path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        if (!file.is_open()) return false;
+        file << prometheus();
+        if (!file.good()) return false;
     }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    return !ec;
 }
 
-// Enhanced utility functions
-class Utils {
+void Metrics::finish() {
+    if (print_on_exit) std::cerr << "\n" << summary();
+    if (!export_path.empty() && !write_prometheus(export_path)) {
+        std::cerr << "Cannot write metrics to " << export_path << std::endl;
+    }
+}
+
+// Pool of persistent curl handles sharing DNS, TLS sessions and live connections
+class ConnectionPool {
 public:
-    static std::string url_encode(const std::string& str);
-    static std::string trim(const std::string& str);
-    static std::vector<std::string> split(const std::string& str, char delimiter);
-    static std::string format_time(const std::string& time_str);
-    static std::string get_weather_icon(const std::string& condition);
-    static std::string get_temperature_color(double temp);
-    static std::string get_aqi_color(int aqi);
-    static void animate_loading(const std::string& message, int duration_ms = 2000);
-    static bool is_valid_ip(const std::string& ip);
-    static std::string get_current_time();
+    class Lease {
+    public:
+        Lease() = default;
+        explicit Lease(CURL* handle) : handle_(handle) {}
+        Lease(Lease&& other) noexcept : handle_(other.handle_) { other.handle_ = nullptr; }
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                ConnectionPool::release(handle_);
+                handle_ = other.handle_;
+                other.handle_ = nullptr;
+            }
+            return *this;
+        }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { ConnectionPool::release(handle_); }
+
+        CURL* get() const { return handle_; }
+        explicit operator bool() const { return handle_ != nullptr; }
+
+    private:
+        CURL* handle_ = nullptr;
+    };
+
+    static size_t MAX_IDLE_HANDLES;
+
+    static Lease acquire();
+    static void shutdown();
+
+private:
+    static std::mutex pool_mutex;
+    static std::vector<CURL*> idle_handles;
+    static CURLSH* share;
+    static std::mutex share_locks[CURL_LOCK_DATA_LAST];
+
+    static CURLSH* get_share();
+    static void release(CURL* handle);
+    static void lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr);
+    static void unlock_share(CURL* handle, curl_lock_data data, void* userptr);
 };
 
-std::string Utils::url_encode(const std::string& str) {
-    std::string encoded_str = "";
-    for (char c : str) {
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            encoded_str += c;
-        } else if (c == ' ') {
-            encoded_str += "%20";
-        } else {
-            std::ostringstream oss;
-            oss << '%' << std::setw(2) << std::setfill('0') << std::hex << (int)(unsigned char)c;
-            encoded_str += oss.str();
-        }
-    }
-    return encoded_str;
+size_t ConnectionPool::MAX_IDLE_HANDLES = 64;
+std::mutex ConnectionPool::pool_mutex;
+std::vector<CURL*> ConnectionPool::idle_handles;
+CURLSH* ConnectionPool::share = nullptr;
+std::mutex ConnectionPool::share_locks[CURL_LOCK_DATA_LAST];
+
+void ConnectionPool::lock_share(CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr) {
+    share_locks[data].lock();
 }
 
-std::string Utils::trim(const std::string& str) {
-    size_t start = str.find_first_not_of(" \t\n\r\f\v");
-    if (start == std::string::npos) return "";
-    size_t end = str.find_last_not_of(" \t\n\r\f\v");
-    return str.substr(start, end - start + 1);
+void ConnectionPool::unlock_share(CURL* handle, curl_lock_data data, void* userptr) {
+    share_locks[data].unlock();
 }
 
-std::vector<std::string> Utils::split(const std::string& str, char delimiter) {
-    std::vector<std::string> tokens;
-    std::stringstream ss(str);
-    std::string token;
-    while (std::getline(ss, token, delimiter)) {
-        tokens.push_back(trim(token));
+// Must be called with pool_mutex held
+CURLSH* ConnectionPool::get_share() {
+    if (!share) {
+        share = curl_share_init();
+        if (!share) {
+            LOG_WARNING("Failed to initialize curl share; handles will not share caches");
+            return nullptr;
+        }
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        // Connections stay per handle (or per multi handle): a shared
+        // connection cache is not safe with transfers on several threads
     }
-    return tokens;
+    return share;
 }
 
-std::string Utils::get_weather_icon(const std::string& condition) {
-    std::string lower_condition = condition;
-    std::transform(lower_condition.begin(), lower_condition.end(), lower_condition.begin(), ::tolower);
-    
-    if (lower_condition.find("sunny") != std::string::npos || lower_condition.find("clear") != std::string::npos) {
-        return "☀️";
-    } else if (lower_condition.find("cloud") != std::string::npos) {
-        return "☁️";
-    } else if (lower_condition.find("rain") != std::string::npos || lower_condition.find("drizzle") != std::string::npos) {
-        return "🌧️";
-    } else if (lower_condition.find("snow") != std::string::npos) {
-        return "❄️";
-    } else if (lower_condition.find("storm") != std::string::npos || lower_condition.find("thunder") != std::string::npos) {
-        return "⛈️";
-    } else if (lower_condition.find("fog") != std::string::npos || lower_condition.find("mist") != std::string::npos) {
-        return "🌫️";
+ConnectionPool::Lease ConnectionPool::acquire() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    CURL* handle = nullptr;
+    if (!idle_handles.empty()) {
+        handle = idle_handles.back();
+        idle_handles.pop_back();
+    } else {
+        handle = curl_easy_init();
+        if (!handle) {
+            LOG_ERROR("Failed to initialize curl");
+            return Lease();
+        }
+    }
+
+    if (CURLSH* shared = get_share()) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, shared);
     }
-    return "🌤️";
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    return Lease(handle);
 }
 
-std::string Utils::get_temperature_color(double temp) {
-    if (temp >= 35) return Colors::RED;
-    else if (temp >= 25) return Colors::ORANGE;
-    else if (temp >= 15) return Colors::YELLOW;
-    else if (temp >= 5) return Colors::GREEN;
-    else if (temp >= -5) return Colors::CYAN;
-    else return Colors::BLUE;
+void ConnectionPool::release(CURL* handle) {
+    if (!handle) return;
+
+    // Reset drops per-request options but keeps live connections and caches
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (idle_handles.size() < MAX_IDLE_HANDLES) {
+        idle_handles.push_back(handle);
+    } else {
+        curl_easy_cleanup(handle);
+    }
 }
 
-std::string Utils::get_aqi_color(int aqi) {
-    switch(aqi) {
-        case 1: return Colors::GREEN;
-        case 2: return Colors::YELLOW;
-        case 3: return Colors::ORANGE;
-        case 4: return Colors::RED;
-        case 5: case 6: return Colors::PURPLE;
-        default: return Colors::GRAY;
+void ConnectionPool::shutdown() {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    for (CURL* handle : idle_handles) {
+        curl_easy_cleanup(handle);
+    }
+    idle_handles.clear();
+    if (share) {
+        curl_share_cleanup(share);
+        share = nullptr;
     }
 }
 
-void Utils::animate_loading(const std::string& message, int duration_ms) {
-    const std::vector<std::string> frames = {"⠋", "⠙", "⠹", "⠸", "⠼", "⠴", "⠦", "⠧", "⠇", "⠏"};
-    auto start = std::chrono::steady_clock::now();
-    int frame_idx = 0;
-    
-    while (std::chrono::duration_cast<std::chrono::milliseconds>(
-           std::chrono::steady_clock::now() - start).count() < duration_ms) {
-        std::cout << "\r" << Colors::CYAN << frames[frame_idx] << " " << message << Colors::RESET << std::flush;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        frame_idx = (frame_idx + 1) % frames.size();
+// Decides whether a failed attempt is worth repeating and how long to wait.
+// Only failures that can clear up on their own are retried: dropped or
+// refused connections, timeouts, 408/425/429 and 5xx. Waits use full jitter
+// (uniform between zero and an exponential cap) so clients that failed
+// together do not retry together, and never undercut a server's Retry-After.
+class RetryPolicy {
+public:
+    enum class Verdict { SUCCESS, RETRY, FAIL };
+
+    static const std::chrono::milliseconds BASE_DELAY;
+    static const std::chrono::milliseconds MAX_DELAY;
+    // A longer Retry-After than this means the upstream is down; give up instead
+    static const std::chrono::seconds MAX_RETRY_AFTER;
+
+    static Verdict classify(CURLcode code, long http_status);
+    // Counts towards opening the circuit: the upstream, not the request, is at fault
+    static bool upstream_fault(CURLcode code, long http_status);
+    // Retry-After from the last response, when the server sent one
+    static std::optional<std::chrono::seconds> retry_after(CURL* curl);
+    // Wait before attempt number `attempt + 1`, or nullopt when waiting is pointless
+    static std::optional<std::chrono::milliseconds> delay(int attempt, std::optional<std::chrono::seconds> retry_after);
+};
+
+const std::chrono::milliseconds RetryPolicy::BASE_DELAY(500);
+const std::chrono::milliseconds RetryPolicy::MAX_DELAY(8000);
+const std::chrono::seconds RetryPolicy::MAX_RETRY_AFTER(30);
+
+RetryPolicy::Verdict RetryPolicy::classify(CURLcode code, long http_status) {
+    switch (code) {
+        case CURLE_OK:
+            break;
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_RESOLVE_PROXY:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_HTTP2:
+        case CURLE_HTTP2_STREAM:
+            return Verdict::RETRY;
+        default:
+            // Bad URLs, certificate failures, cancellation: repeating changes nothing
+            return Verdict::FAIL;
     }
-    std::cout << "\r" << std::string(message.length() + 5, ' ') << "\r";
+    if (http_status < 400) return Verdict::SUCCESS;
+    if (http_status == 408 || http_status == 425 || http_status == 429 || http_status >= 500) return Verdict::RETRY;
+    return Verdict::FAIL;
 }
 
-bool Utils::is_valid_ip(const std::string& ip) {
-    std::regex ip_regex(R"(^(?:(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)\.){3}(?:25[0-5]|2[0-4][0-9]|[01]?[0-9][0-9]?)$)");
-    return std::regex_match(ip, ip_regex);
+bool RetryPolicy::upstream_fault(CURLcode code, long http_status) {
+    if (code == CURLE_ABORTED_BY_CALLBACK) return false;
+    return classify(code, http_status) == Verdict::RETRY;
 }
 
-std::string Utils::get_current_time() {
-    auto now = std::chrono::system_clock::now();
-    auto time_t = std::chrono::system_clock::to_time_t(now);
-    std::stringstream ss;
-    ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
-    return ss.str();
+std::optional<std::chrono::seconds> RetryPolicy::retry_after(CURL* curl) {
+    curl_off_t seconds = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &seconds) == CURLE_OK && seconds > 0) {
+        return std::chrono::seconds(seconds);
+    }
+    return std::nullopt;
 }
 
-// Enhanced display functions
-class Display {
+std::optional<std::chrono::milliseconds> RetryPolicy::delay(int attempt, std::optional<std::chrono::seconds> retry_after) {
+    thread_local std::mt19937 random(std::random_device{}());
+    auto cap = std::min(MAX_DELAY, BASE_DELAY * (1 << std::min(attempt, 10)));
+    std::chrono::milliseconds jitter(std::uniform_int_distribution<long long>(0, cap.count())(random));
+    if (!retry_after) return jitter;
+    if (*retry_after > MAX_RETRY_AFTER) return std::nullopt;
+    // Retry-After is a floor; the jitter on top keeps waiting clients apart
+    return std::chrono::duration_cast<std::chrono::milliseconds>(*retry_after) + jitter / 4;
+}
+
+// Per-host circuit breaker. After FAILURE_THRESHOLD consecutive upstream
+// faults the circuit opens and requests fail immediately for the cooldown
+// (or the server's Retry-After, when longer). Then one probe is let through:
+// success closes the circuit, failure opens it again for twice as long. A
+// probe that ends without a verdict (cancelled, shut down, failed locally)
+// must be released so the next request can probe instead.
+class CircuitBreaker {
 public:
-    static void banner();
-    static void section_header(const std::string& title);
-    static void key_value(const std::string& key, const std::string& value, const std::string& color = Colors::CYAN);
-    static void progress_bar(int percentage, const std::string& label = "");
-    static void weather_card(const json& data, const std::string& location);
-    static void hourly_forecast(const json& data);
-    static void seven_day_forecast(const json& data);
-    static void menu();
-    static void clear_screen();
-    static void error_message(const std::string& message);
-    static void success_message(const std::string& message);
-    static void warning_message(const std::string& message);
-    static void info_message(const std::string& message);
+    static const int FAILURE_THRESHOLD;
+    static std::chrono::seconds COOLDOWN;  // adjustable so tests need not wait it out
+    static const std::chrono::seconds MAX_COOLDOWN;
+
+    // False while the host's circuit is open; otherwise the caller must report the outcome.
+    // `probe` is set when this request is the half-open probe.
+    static bool allow(const std::string& host, std::chrono::seconds* retry_in = nullptr, bool* probe = nullptr);
+    // Read-only check, used to drop a parked retry instead of waiting for nothing
+    static bool is_open(const std::string& host);
+    static void record_success(const std::string& host);
+    static void record_failure(const std::string& host, std::optional<std::chrono::seconds> retry_after);
+    static void release_probe(const std::string& host);
+    // scheme://host[:port] of a URL, the unit the breaker tracks
+    static std::string host_of(const std::string& url);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Circuit {
+        int failures = 0;
+        bool open = false;
+        bool probing = false;  // half-open: one request is testing the upstream
+        Clock::time_point open_until;
+        std::chrono::seconds cooldown{0};
+    };
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, Circuit> circuits;
 };
 
-void Display::banner() {
-    std::cout << Colors::BG_BLUE << Colors::PURPLE << R"(
-  ╔══════════════════════════════════════════════════════════════╗
-  ║  ╦ ╦┌─┐┌─┐┌─┐┬ ┬┌─┐┬─┐  ╔═╗┬  ┬  ╔═╗┬─┐┌─┐  ┌┬┐ ┬ ┬  ┬┌─┐  ║
-  ║  ║║║├┤ ├─┤│  ├─┤├┤ ├┬┘  ║  │  ║  ╠═╝├┬┘│ │   │ ┬│└┬┘ │ │  ║
-  ║  ╚╩╝└─┘┴ ┴└─┘┴ ┴└─┘┴└─  ╚═╝┴─┘┴  ╩  ┴└─└─┘  ─┴─ ┴ ┴  ┴└─┘  ║
-  ╚══════════════════════════════════════════════════════════════╝
-)" << Colors::RESET << std::endl;
-    std::cout << Colors::BG_BLUE << Colors::CYAN << "      🌍 Professional Weather Intelligence Platform v2.0      " << Colors::RESET << std::endl;
-    std::cout << Colors::BG_BLUE << Colors::YELLOW << "      ──────────────────────────────────────────────────      " << Colors::RESET << "\n\n";
-    std::cout << Colors::DIM << "Current time: " << Utils::get_current_time() << Colors::RESET << "\n\n";
+const int CircuitBreaker::FAILURE_THRESHOLD = 5;
+std::chrono::seconds CircuitBreaker::COOLDOWN(15);
+const std::chrono::seconds CircuitBreaker::MAX_COOLDOWN(300);
+std::mutex CircuitBreaker::mutex;
+std::unordered_map<std::string, CircuitBreaker::Circuit> CircuitBreaker::circuits;
+
+std::string CircuitBreaker::host_of(const std::string& url) {
+    size_t scheme = url.find("://");
+    size_t start = scheme == std::string::npos ? 0 : scheme + 3;
+    size_t end = url.find_first_of("/?#", start);
+    return url.substr(0, end);
+}
+
+bool CircuitBreaker::allow(const std::string& host, std::chrono::seconds* retry_in, bool* probe) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (probe) *probe = false;
+    auto found = circuits.find(host);
+    if (found == circuits.end() || !found->second.open) return true;
+    Circuit& circuit = found->second;
+    auto now = Clock::now();
+    if (now < circuit.open_until || circuit.probing) {
+        if (retry_in) {
+            *retry_in = std::chrono::duration_cast<std::chrono::seconds>(
+                std::max(Clock::duration::zero(), circuit.open_until - now));
+        }
+        return false;
+    }
+    circuit.probing = true;
+    if (probe) *probe = true;
+    LOG_INFO("Circuit half-open for " + host + ", sending a probe request");
+    return true;
 }
 
-void Display::section_header(const std::string& title) {
-    std::string border(title.length() + 4, '═');
-    std::cout << "\n" << Colors::BG_DARK << Colors::BOLD << Colors::BLUE;
-    std::cout << "╔" << border << "╗" << std::endl;
-    std::cout << "║ " << title << " ║" << std::endl;
-    std::cout << "╚" << border << "╝" << Colors::RESET << std::endl;
-}
+bool CircuitBreaker::is_open(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = circuits.find(host);
+    return found != circuits.end() && found->second.open && Clock::now() < found->second.open_until;
+}
+
+void CircuitBreaker::record_success(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = circuits.find(host);
+    if (found == circuits.end()) return;
+    if (found->second.open) LOG_INFO("Circuit closed for " + host);
+    circuits.erase(found);
+}
+
+void CircuitBreaker::record_failure(const std::string& host, std::optional<std::chrono::seconds> retry_after) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Circuit& circuit = circuits[host];
+    circuit.failures++;
+    if (!circuit.probing && circuit.failures < FAILURE_THRESHOLD) return;
+
+    // A failed probe doubles the wait; the first trip uses the base cooldown
+    circuit.cooldown = circuit.probing ? std::min(MAX_COOLDOWN, circuit.cooldown * 2) : COOLDOWN;
+    if (retry_after) circuit.cooldown = std::min(MAX_COOLDOWN, std::max(circuit.cooldown, *retry_after));
+    circuit.open = true;
+    circuit.probing = false;
+    circuit.open_until = Clock::now() + circuit.cooldown;
+    LOG_WARNING("Circuit open for " + host + " after " + std::to_string(circuit.failures) +
+                " failures; failing fast for " + std::to_string(circuit.cooldown.count()) + "s");
+}
+
+void CircuitBreaker::release_probe(const std::string& host) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = circuits.find(host);
+    if (found != circuits.end()) found->second.probing = false;
+}
+
+// Drives single requests (interactive screens, scripting, daemon workers and
+// background refreshes) on one thread through a curl multi handle. A failed
+// attempt that is worth repeating is parked on a timer and re-added when it
+// is due, so a backoff never puts a thread to sleep; callers only wait for
+// their own final result, and a raised CancelFlag ends that wait at once.
+class RequestScheduler {
+public:
+    struct Result {
+        CURLcode code = CURLE_OK;
+        long http_status = 0;
+        int attempts = 0;
+        std::string error;  // set when the request did not succeed
+    };
+
+    // `curl` must already be configured; `body` receives the final attempt's response.
+    // Retries are only scheduled within Config::TIMEOUT of the call, so with the
+    // last attempt's own timeout a caller waits at most about twice that.
+    static Result perform(CURL* curl, const std::string& url, std::string& body, int max_attempts,
+                          const CancelFlag* cancel = nullptr);
+    static void shutdown();
+
+private:
+    using Clock = std::chrono::steady_clock;
+    struct Transfer {
+        CURL* curl;
+        std::string host;
+        std::string* body;
+        const CancelFlag* cancel;
+        int max_attempts;
+        Result result;
+        Clock::time_point due;
+        Clock::time_point deadline;  // no retry is parked past this
+        bool done = false;
+        bool probe = false;  // holds the host's half-open probe until an outcome is recorded
+    };
+    struct Later {
+        bool operator()(const Transfer* a, const Transfer* b) const { return a->due > b->due; }
+    };
+
+    struct Engine {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::deque<Transfer*> submitted;
+        CURLM* multi = nullptr;
+        bool stop = false;
+        ~Engine() { RequestScheduler::shutdown(); }
+    };
+    static Engine engine;
+
+    static void run();
+    static void start(Transfer* transfer, std::vector<Transfer*>& active);
+    static void complete(Transfer* transfer, CURLcode code, const std::string& error);
+    static void wake();
+};
+
+RequestScheduler::Engine RequestScheduler::engine;
+
+RequestScheduler::Result RequestScheduler::perform(CURL* curl, const std::string& url, std::string& body,
+                                                   int max_attempts, const CancelFlag* cancel) {
+    Transfer transfer{curl, CircuitBreaker::host_of(url), &body, cancel, std::max(1, max_attempts), {}, {},
+                      Clock::now() + std::chrono::seconds(std::max(1, Config::TIMEOUT))};
+    std::unique_lock<std::mutex> lock(engine.mutex);
+    if (engine.stop && engine.thread.joinable()) {
+        transfer.result.code = CURLE_ABORTED_BY_CALLBACK;
+        transfer.result.error = "shutting down";
+        return transfer.result;
+    }
+    if (!engine.thread.joinable()) {
+        engine.stop = false;
+        engine.multi = curl_multi_init();
+        if (!engine.multi) {
+            transfer.result.code = CURLE_OUT_OF_MEMORY;
+            transfer.result.error = "cannot create curl multi handle";
+            return transfer.result;
+        }
+        engine.thread = std::thread(run);
+    }
+    engine.submitted.push_back(&transfer);
+    wake();
+    engine.finished.wait(lock, [&transfer] { return transfer.done; });
+    return transfer.result;
+}
+
+// Must be called with engine.mutex held
+void RequestScheduler::wake() {
+    if (engine.multi) curl_multi_wakeup(engine.multi);
+}
+
+void RequestScheduler::shutdown() {
+    std::unique_lock<std::mutex> lock(engine.mutex);
+    if (!engine.thread.joinable()) return;
+    engine.stop = true;
+    wake();
+    lock.unlock();
+    engine.thread.join();  // the engine thread releases the multi handle itself
+}
+
+void RequestScheduler::complete(Transfer* transfer, CURLcode code, const std::string& error) {
+    if (transfer->probe) CircuitBreaker::release_probe(transfer->host);
+    std::lock_guard<std::mutex> lock(engine.mutex);
+    transfer->result.code = code;
+    transfer->result.error = error;
+    transfer->done = true;
+    engine.finished.notify_all();
+}
+
+void RequestScheduler::start(Transfer* transfer, std::vector<Transfer*>& active) {
+    std::chrono::seconds retry_in(0);
+    if (!CircuitBreaker::allow(transfer->host, &retry_in, &transfer->probe)) {
+        Metrics::add(Metrics::CIRCUIT_REJECTED);
+        complete(transfer, CURLE_COULDNT_CONNECT, "upstream " + transfer->host + " is failing, not retrying for " +
+                                                  std::to_string(retry_in.count()) + "s");
+        return;
+    }
+    if (transfer->result.attempts++ > 0) Metrics::add(Metrics::HTTP_RETRIES);
+    Metrics::add(Metrics::HTTP_REQUESTS);
+    transfer->body->clear();
+    curl_easy_setopt(transfer->curl, CURLOPT_PRIVATE, transfer);
+    curl_multi_add_handle(engine.multi, transfer->curl);
+    active.push_back(transfer);
+}
+
+void RequestScheduler::run() {
+    std::vector<Transfer*> active;
+    std::vector<Transfer*> waiting;  // min-heap on due time
+    auto cancelled = [](const Transfer* t) { return t->cancel && t->cancel->load(std::memory_order_relaxed); };
+
+    while (true) {
+        std::deque<Transfer*> incoming;
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(engine.mutex);
+            incoming.swap(engine.submitted);
+            stopping = engine.stop;
+        }
+        if (stopping) {
+            for (Transfer* t : active) curl_multi_remove_handle(engine.multi, t->curl);
+            for (auto* list : {&active, &waiting}) {
+                for (Transfer* t : *list) complete(t, CURLE_ABORTED_BY_CALLBACK, "shutting down");
+            }
+            for (Transfer* t : incoming) complete(t, CURLE_ABORTED_BY_CALLBACK, "shutting down");
+            CURLM* multi;
+            {
+                std::lock_guard<std::mutex> lock(engine.mutex);
+                multi = engine.multi;
+                engine.multi = nullptr;
+            }
+            curl_multi_cleanup(multi);
+            return;
+        }
+        for (Transfer* t : incoming) start(t, active);
+
+        // Cancelled transfers end now rather than at curl's next progress callback
+        for (size_t i = 0; i < active.size();) {
+            if (!cancelled(active[i])) { ++i; continue; }
+            curl_multi_remove_handle(engine.multi, active[i]->curl);
+            complete(active[i], CURLE_ABORTED_BY_CALLBACK, "cancelled");
+            active.erase(active.begin() + static_cast<std::ptrdiff_t>(i));
+        }
+
+        // Parked retries that were cancelled stop waiting; due ones go out again
+        size_t kept = 0;
+        for (Transfer* t : waiting) {
+            if (cancelled(t)) complete(t, CURLE_ABORTED_BY_CALLBACK, "cancelled");
+            else waiting[kept++] = t;
+        }
+        if (kept != waiting.size()) {
+            waiting.resize(kept);
+            std::make_heap(waiting.begin(), waiting.end(), Later());
+        }
+        auto now = Clock::now();
+        while (!waiting.empty() && waiting.front()->due <= now) {
+            std::pop_heap(waiting.begin(), waiting.end(), Later());
+            Transfer* t = waiting.back();
+            waiting.pop_back();
+            start(t, active);
+        }
+
+        int running = 0;
+        curl_multi_perform(engine.multi, &running);
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(engine.multi, &pending)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Transfer* t = nullptr;
+            CURLcode code = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&t));
+            curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &t->result.http_status);
+            Metrics::record_transfer(t->curl);
+            curl_multi_remove_handle(engine.multi, t->curl);
+            active.erase(std::find(active.begin(), active.end(), t));
+
+            long status = t->result.http_status;
+            RetryPolicy::Verdict verdict = RetryPolicy::classify(code, status);
+            auto retry_after = RetryPolicy::retry_after(t->curl);
+            if (verdict == RetryPolicy::Verdict::SUCCESS) {
+                CircuitBreaker::record_success(t->host);
+                t->probe = false;
+                complete(t, code, "");
+                continue;
+            }
+            if (RetryPolicy::upstream_fault(code, status)) {
+                CircuitBreaker::record_failure(t->host, retry_after);
+                t->probe = false;
+            } else if (code == CURLE_OK) {
+                CircuitBreaker::record_success(t->host);  // a 4xx still proves the host is up
+                t->probe = false;
+            }
+
+            std::string error = code != CURLE_OK ? curl_easy_strerror(code) : "HTTP " + std::to_string(status);
+            std::optional<std::chrono::milliseconds> wait;
+            if (verdict == RetryPolicy::Verdict::RETRY && t->result.attempts < t->max_attempts && !cancelled(t) &&
+                !CircuitBreaker::is_open(t->host)) {
+                wait = RetryPolicy::delay(t->result.attempts, retry_after);
+                // Someone is blocked on this request: a backoff past its deadline is not worth waiting out
+                if (wait && Clock::now() + *wait > t->deadline) wait.reset();
+            }
+            if (!wait) {
+                complete(t, code, error);
+                continue;
+            }
+            LOG_WARNING("Request attempt " + std::to_string(t->result.attempts) + " failed (" + error +
+                        "), retrying in " + std::to_string(wait->count()) + "ms");
+            t->due = Clock::now() + *wait;
+            waiting.push_back(t);
+            std::push_heap(waiting.begin(), waiting.end(), Later());
+        }
+
+        // Sleep until there is socket activity, a retry falls due or a caller submits
+        long timeout_ms = 1000;
+        if (!waiting.empty()) {
+            auto until_due = std::chrono::duration_cast<std::chrono::milliseconds>(waiting.front()->due - Clock::now());
+            timeout_ms = std::clamp<long>(static_cast<long>(until_due.count()), 0, timeout_ms);
+        }
+        // A raised CancelFlag wakes nothing, so poll often while one could be
+        auto cancellable = [](const Transfer* t) { return t->cancel != nullptr; };
+        if (std::any_of(active.begin(), active.end(), cancellable) ||
+            std::any_of(waiting.begin(), waiting.end(), cancellable)) {
+            timeout_ms = std::min(timeout_ms, 50L);
+        }
+        curl_multi_poll(engine.multi, nullptr, 0, static_cast<int>(timeout_ms), nullptr);
+    }
+}
+
+// Persistent response cache shared by every process on the machine
+class DiskCache {
+public:
+    // Daemon workers switch it off when the directory turns out unwritable
+    static std::atomic<bool> enabled;
+
+    static bool load(const std::string& url, std::chrono::seconds max_age, std::string& body,
+                     std::chrono::seconds* age = nullptr);
+    static void store(const std::string& url, const std::string& body);
+    // Whether an entry may exist, without opening it: entries seen by one
+    // directory scan plus those this process has stored since
+    static bool contains(const std::string& url);
+    static size_t compact(std::chrono::seconds max_age);
+    static void clear();
+    static std::string directory();
+    static std::string cache_key(const std::string& url);
+
+private:
+    static const char* const ENTRY_MAGIC;
+    static std::mutex index_mutex;
+    static std::unordered_set<uint64_t> index;
+    static bool index_loaded;
+
+    static uint64_t key_hash(const std::string& key);
+    static std::filesystem::path entry_path(const std::string& key);
+    static void remember(const std::string& key);
+    static void forget_index();
+    static bool read_header(std::istream& in, std::string& key, long long& stored_at);
+    static long long now_seconds();
+};
+
+std::atomic<bool> DiskCache::enabled{true};
+const char* const DiskCache::ENTRY_MAGIC = "WCC1";
+std::mutex DiskCache::index_mutex;
+std::unordered_set<uint64_t> DiskCache::index;
+bool DiskCache::index_loaded = false;
+
+std::string DiskCache::directory() {
+    // Resolved once; a function-local static is initialized thread-safely
+    static const std::string dir = []() -> std::string {
+        if (const char* configured = std::getenv("WEATHER_CLI_CACHE_DIR")) return configured;
+        if (const char* xdg = std::getenv("XDG_CACHE_HOME")) return std::string(xdg) + "/weather-cli";
+        if (const char* home = std::getenv("HOME")) return std::string(home) + "/.cache/weather-cli";
+        return "weather_cli_cache";
+    }();
+    return dir;
+}
+
+// The API key is not part of the identity of a response
+std::string DiskCache::cache_key(const std::string& url) {
+    std::string key = url;
+    size_t query = key.find('?');
+    if (query == std::string::npos) return key;
+
+    size_t pos = query + 1;
+    while (pos < key.size()) {
+        size_t end = key.find('&', pos);
+        if (end == std::string::npos) end = key.size();
+        if (key.compare(pos, 4, "key=") == 0) {
+            key.erase(pos, end < key.size() ? end - pos + 1 : end - pos);
+            if (!key.empty() && (key.back() == '&' || key.back() == '?')) key.pop_back();
+            break;
+        }
+        pos = end + 1;
+    }
+    return key;
+}
+
+// FNV-1a keeps entry names short and filesystem safe
+uint64_t DiskCache::key_hash(const std::string& key) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (char c : key) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::filesystem::path DiskCache::entry_path(const std::string& key) {
+    std::ostringstream name;
+    name << std::hex << std::setw(16) << std::setfill('0') << key_hash(key) << ".entry";
+    return std::filesystem::path(directory()) / name.str();
+}
+
+bool DiskCache::contains(const std::string& url) {
+    if (!enabled) return false;
+
+    std::lock_guard<std::mutex> lock(index_mutex);
+    if (!index_loaded) {
+        // One readdir instead of an open() per probe; entries written later
+        // by other processes are only found by a direct load()
+        index_loaded = true;
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(directory(), ec)) {
+            const std::string name = entry.path().filename().string();
+            if (name.size() != 22 || entry.path().extension() != ".entry") continue;
+            try {
+                index.insert(std::stoull(name.substr(0, 16), nullptr, 16));
+            } catch (const std::exception&) {
+            }
+        }
+    }
+    return index.count(key_hash(cache_key(url))) > 0;
+}
+
+void DiskCache::remember(const std::string& key) {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    index.insert(key_hash(key));
+}
+
+// Rescan on next use after entries were removed
+void DiskCache::forget_index() {
+    std::lock_guard<std::mutex> lock(index_mutex);
+    index.clear();
+    index_loaded = false;
+}
+
+long long DiskCache::now_seconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool DiskCache::read_header(std::istream& in, std::string& key, long long& stored_at) {
+    std::string magic;
+    if (!(in >> magic >> stored_at) || magic != ENTRY_MAGIC) return false;
+    in.get();
+    return static_cast<bool>(std::getline(in, key));
+}
+
+bool DiskCache::load(const std::string& url, std::chrono::seconds max_age, std::string& body,
+                     std::chrono::seconds* age) {
+    if (!enabled) return false;
+
+    std::string key = cache_key(url);
+    std::ifstream file(entry_path(key), std::ios::binary);
+    if (!file.is_open()) return false;
+
+    std::string stored_key;
+    long long stored_at = 0;
+    if (!read_header(file, stored_key, stored_at) || stored_key != key) return false;
+
+    long long entry_age = now_seconds() - stored_at;
+    if (entry_age < 0 || entry_age >= max_age.count()) return false;
+
+    body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (age) *age = std::chrono::seconds(entry_age);
+    return !body.empty();
+}
+
+void DiskCache::store(const std::string& url, const std::string& body) {
+    if (!enabled) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(directory(), ec);
+    if (ec) {
+        LOG_WARNING("Cannot create cache directory " + directory() + ": " + ec.message());
+        enabled = false;
+        return;
+    }
+
+    // Write to a private temp file and rename it into place so that readers
+    // in other processes only ever see complete entries
+    std::string key = cache_key(url);
+    std::filesystem::path target = entry_path(key);
+    static std::atomic<unsigned> sequence{0};
+    std::filesystem::path temp = target;
+    temp += ".tmp." + std::to_string(getpid()) + "." + std::to_string(sequence++);
+
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) return;
+        file << ENTRY_MAGIC << ' ' << now_seconds() << '\n' << key << '\n';
+        file.write(body.data(), static_cast<std::streamsize>(body.size()));
+        if (!file) {
+            file.close();
+            std::filesystem::remove(temp, ec);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temp, target, ec);
+    if (ec) {
+        LOG_WARNING("Failed to write cache entry: " + ec.message());
+        std::filesystem::remove(temp, ec);
+        return;
+    }
+    remember(key);
+}
+
+size_t DiskCache::compact(std::chrono::seconds max_age) {
+    std::error_code ec;
+    std::filesystem::path dir(directory());
+    if (!std::filesystem::is_directory(dir, ec)) return 0;
+
+#ifndef _WIN32
+    // Only one process compacts at a time; others simply skip
+    int lock_fd = open((dir / ".lock").c_str(), O_CREAT | O_RDWR, 0644);
+    if (lock_fd < 0) return 0;
+    if (flock(lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(lock_fd);
+        return 0;
+    }
+#endif
+
+    const long long now = now_seconds();
+    const auto stale_temp_age = std::chrono::minutes(10);
+    size_t removed = 0;
+
+    for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+        if (!entry.is_regular_file(ec)) continue;
+        const std::string name = entry.path().filename().string();
+
+        bool remove = false;
+        if (name.find(".tmp.") != std::string::npos) {
+            auto modified = std::filesystem::last_write_time(entry.path(), ec);
+            remove = !ec && std::filesystem::file_time_type::clock::now() - modified > stale_temp_age;
+        } else if (entry.path().extension() == ".entry") {
+            std::ifstream file(entry.path(), std::ios::binary);
+            std::string key;
+            long long stored_at = 0;
+            remove = !read_header(file, key, stored_at) || now - stored_at >= max_age.count();
+        }
+
+        if (remove && std::filesystem::remove(entry.path(), ec)) removed++;
+    }
+    if (removed > 0) forget_index();
+
+#ifndef _WIN32
+    flock(lock_fd, LOCK_UN);
+    close(lock_fd);
+#endif
+    LOG_INFO("Disk cache compaction removed " + std::to_string(removed) + " entries");
+    return removed;
+}
+
+void DiskCache::clear() {
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(directory(), ec)) {
+        if (entry.path().extension() == ".entry") {
+            std::filesystem::remove(entry.path(), ec);
+        }
+    }
+    forget_index();
+}
+
+// Geohash-style grid over the coordinates of places the cache has seen, so a
+// coordinate query can be answered from a cached place nearby. A search scans
+// only the CELL_DEGREES cells its radius touches.
+class PlaceIndex {
+public:
+    struct Neighbor {
+        std::string place;
+        double distance_km;
+    };
+
+    static void insert(double lat, double lon, const std::string& place);
+    // Places within radius_km of the point, nearest first
+    static std::vector<Neighbor> nearest(double lat, double lon, double radius_km, size_t limit);
+    static double distance_km(double lat1, double lon1, double lat2, double lon2);
+    static size_t size();
+
+private:
+    static constexpr double CELL_DEGREES = 0.1;  // ~11 km of latitude
+    static constexpr long COLUMNS = 3600;        // 360 / CELL_DEGREES
+    static constexpr size_t MAX_POINTS = 100000;
+
+    struct Point {
+        double lat;
+        double lon;
+        std::string place;
+    };
+
+    static std::mutex mutex;
+    static std::unordered_map<uint64_t, std::vector<Point>> cells;
+    static size_t count;
+
+    static long row_of(double lat) { return static_cast<long>(std::floor((lat + 90) / CELL_DEGREES)); }
+    static long column_of(double lon) { return static_cast<long>(std::floor((lon + 180) / CELL_DEGREES)); }
+    static uint64_t cell_key(long row, long column) {
+        column = ((column % COLUMNS) + COLUMNS) % COLUMNS;  // longitude wraps at the antimeridian
+        return static_cast<uint64_t>(row) << 32 | static_cast<uint64_t>(column);
+    }
+};
+
+std::mutex PlaceIndex::mutex;
+std::unordered_map<uint64_t, std::vector<PlaceIndex::Point>> PlaceIndex::cells;
+size_t PlaceIndex::count = 0;
+
+double PlaceIndex::distance_km(double lat1, double lon1, double lat2, double lon2) {
+    // Haversine on a spherical Earth; well within a metre at city scale
+    constexpr double EARTH_RADIUS_KM = 6371.0088;
+    constexpr double RADIANS = 3.14159265358979323846 / 180;
+    double dlat = (lat2 - lat1) * RADIANS;
+    double dlon = (lon2 - lon1) * RADIANS;
+    double a = std::sin(dlat / 2) * std::sin(dlat / 2) +
+               std::cos(lat1 * RADIANS) * std::cos(lat2 * RADIANS) * std::sin(dlon / 2) * std::sin(dlon / 2);
+    return 2 * EARTH_RADIUS_KM * std::asin(std::min(1.0, std::sqrt(a)));
+}
+
+void PlaceIndex::insert(double lat, double lon, const std::string& place) {
+    if (!(std::abs(lat) <= 90 && std::abs(lon) <= 180)) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    // Several coordinates may resolve to one place; each is a point of its own
+    auto& points = cells[cell_key(row_of(lat), column_of(lon))];
+    for (auto& point : points) {
+        if (point.lat == lat && point.lon == lon) {
+            point.place = place;
+            return;
+        }
+    }
+    if (count >= MAX_POINTS) return;
+    points.push_back({lat, lon, place});
+    ++count;
+}
+
+std::vector<PlaceIndex::Neighbor> PlaceIndex::nearest(double lat, double lon, double radius_km, size_t limit) {
+    std::vector<Neighbor> found;
+    if (radius_km <= 0 || !(std::abs(lat) <= 90 && std::abs(lon) <= 180)) return found;
+
+    constexpr double KM_PER_DEGREE = 111.32;
+    double dlat = radius_km / KM_PER_DEGREE;
+    double cos_lat = std::cos(std::min(89.0, std::abs(lat)) * 3.14159265358979323846 / 180);
+    double dlon = std::min(180.0, radius_km / (KM_PER_DEGREE * cos_lat));
+    long first_row = row_of(std::max(-90.0, lat - dlat)), last_row = row_of(std::min(90.0, lat + dlat));
+    long first_column = column_of(lon - dlon), last_column = column_of(lon + dlon);
+    if (last_column - first_column >= COLUMNS) last_column = first_column + COLUMNS - 1;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (long row = first_row; row <= last_row; ++row) {
+        for (long column = first_column; column <= last_column; ++column) {
+            auto cell = cells.find(cell_key(row, column));
+            if (cell == cells.end()) continue;
+            for (const auto& point : cell->second) {
+                double distance = distance_km(lat, lon, point.lat, point.lon);
+                if (distance <= radius_km) found.push_back({point.place, distance});
+            }
+        }
+    }
+    std::sort(found.begin(), found.end(),
+              [](const Neighbor& a, const Neighbor& b) { return a.distance_km < b.distance_km; });
+    // Keep each place once, at its nearest point
+    std::vector<Neighbor> places;
+    for (auto& neighbor : found) {
+        if (places.size() == limit) break;
+        auto same = [&neighbor](const Neighbor& kept) { return kept.place == neighbor.place; };
+        if (std::none_of(places.begin(), places.end(), same)) places.push_back(std::move(neighbor));
+    }
+    return places;
+}
+
+size_t PlaceIndex::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return count;
+}
+
+// Canonical identities for user-entered locations so equivalent queries share
+// one cache entry. Text is lowercased with whitespace collapsed, coordinates are
+// rounded to Config::COORD_PRECISION decimals, and aliases learned from the
+// location the API resolved map every spelling seen so far to one place key.
+// Learned aliases are appended to aliases.tsv in the cache directory so later
+// processes start with them.
+class LocationKeys {
+public:
+    // Syntactic normal form of a query, which may still be percent-encoded
+    static std::string normalize(std::string_view location);
+    // The normal form before coordinates are rounded
+    static std::string decode(std::string_view location);
+    // Place key for a query: its learned alias target, else its normal form
+    static std::string canonical(std::string_view location);
+    // Records that `location` resolved to the place in the response's "location"
+    // object; false when the response names no place
+    static bool learn(std::string_view location, const json& data);
+    static size_t alias_count();
+    // Parses a normalized "lat,lon" query
+    static bool coordinates(const std::string& text, double& lat, double& lon);
+    // Rewrites aliases.tsv with one line per alias
+    static size_t compact();
+
+private:
+    static constexpr size_t MAX_ALIASES = 100000;
+
+    static std::mutex mutex;
+    static std::unordered_map<std::string, std::string> aliases;
+    static bool loaded;
+
+    static std::string path();
+    static void load_locked();
+    static bool round_coordinates(const std::string& text, std::string& rounded);
+};
+
+std::mutex LocationKeys::mutex;
+std::unordered_map<std::string, std::string> LocationKeys::aliases;
+bool LocationKeys::loaded = false;
+
+std::string LocationKeys::path() {
+    return DiskCache::directory() + "/aliases.tsv";
+}
+
+std::string LocationKeys::normalize(std::string_view location) {
+    std::string text = decode(location);
+    std::string rounded;
+    return round_coordinates(text, rounded) ? rounded : text;
+}
+
+std::string LocationKeys::decode(std::string_view location) {
+    auto hex_value = [](char c) -> int {
+        if (c >= '0' && c <= '9') return c - '0';
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+    };
+
+    // Decode, lowercase ASCII, collapse whitespace and drop it around commas
+    std::string text;
+    text.reserve(location.size());
+    bool pending_space = false;
+    for (size_t i = 0; i < location.size(); ++i) {
+        char c = location[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < location.size() && hex_value(location[i + 1]) >= 0 &&
+                   hex_value(location[i + 2]) >= 0) {
+            c = static_cast<char>(hex_value(location[i + 1]) * 16 + hex_value(location[i + 2]));
+            i += 2;
+        }
+        if (std::isspace(static_cast<unsigned char>(c))) {
+            pending_space = !text.empty() && text.back() != ',';
+            continue;
+        }
+        if (c == ',') pending_space = false;
+        if (pending_space) text += ' ';
+        pending_space = false;
+        text += static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return text;
+}
+
+bool LocationKeys::coordinates(const std::string& text, double& lat, double& lon) {
+    size_t comma = text.find(',');
+    if (comma == std::string::npos || text.find(',', comma + 1) != std::string::npos) return false;
+    const char* begin = text.c_str();
+    char* end = nullptr;
+    lat = std::strtod(begin, &end);
+    if (end != begin + comma || end == begin) return false;
+    lon = std::strtod(begin + comma + 1, &end);
+    if (end != begin + text.size() || end == begin + comma + 1) return false;
+    return std::abs(lat) <= 90 && std::abs(lon) <= 180;
+}
+
+bool LocationKeys::round_coordinates(const std::string& text, std::string& rounded) {
+    double lat, lon;
+    if (!coordinates(text, lat, lon)) return false;
+
+    int precision = std::clamp(Config::COORD_PRECISION, 0, 6);
+    double scale = std::pow(10.0, precision);
+    auto round = [scale](double value) {
+        double r = std::round(value * scale) / scale;
+        return r == 0 ? 0.0 : r;  // "-0.00" must not split one place into two keys
+    };
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "%.*f,%.*f", precision, round(lat), precision, round(lon));
+    rounded = buffer;
+    return true;
+}
+
+std::string LocationKeys::canonical(std::string_view location) {
+    std::string key = normalize(location);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) load_locked();
+    auto it = aliases.find(key);
+    return it != aliases.end() ? it->second : key;
+}
+
+bool LocationKeys::learn(std::string_view location, const json& data) {
+    auto it = data.find("location");
+    if (it == data.end() || !it->is_object()) return false;
+    const json& place = *it;
+    auto field = [&place](const char* name) {
+        auto value = place.find(name);
+        return value != place.end() && value->is_string() ? value->get<std::string>() : std::string();
+    };
+    std::string name = field("name"), region = field("region"), country = field("country");
+    if (name.empty()) return false;
+
+    std::string place_key = normalize(name + "," + region + "," + country);
+    std::vector<std::string> spellings;
+    std::string query = normalize(location);
+    // auto:ip follows the caller around, so it never becomes an alias
+    if (query.compare(0, 5, "auto:") != 0) spellings.push_back(query);
+    spellings.push_back(normalize(name + "," + country));
+    if (!region.empty()) spellings.push_back(normalize(name + "," + region));
+    auto lat = place.find("lat"), lon = place.find("lon");
+    if (lat != place.end() && lon != place.end() && lat->is_number() && lon->is_number()) {
+        spellings.push_back(normalize(std::to_string(lat->get<double>()) + "," + std::to_string(lon->get<double>())));
+    }
+
+    std::string appended;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) load_locked();
+        for (const auto& spelling : spellings) {
+            if (spelling == place_key || spelling.find('\t') != std::string::npos) continue;
+            auto existing = aliases.find(spelling);
+            if (existing != aliases.end() && existing->second == place_key) continue;
+            if (existing == aliases.end() && aliases.size() >= MAX_ALIASES) continue;
+            aliases[spelling] = place_key;
+            appended += spelling + '\t' + place_key + '\n';
+            double alias_lat, alias_lon;
+            if (coordinates(spelling, alias_lat, alias_lon)) PlaceIndex::insert(alias_lat, alias_lon, place_key);
+        }
+    }
+    if (!appended.empty() && DiskCache::enabled) {
+        std::error_code ec;
+        std::filesystem::create_directories(DiskCache::directory(), ec);
+        // One append per response; short lines from concurrent processes do not interleave
+        std::ofstream file(path(), std::ios::app | std::ios::binary);
+        file.write(appended.data(), static_cast<std::streamsize>(appended.size()));
+    }
+    return true;
+}
+
+// Must be called with mutex held
+void LocationKeys::load_locked() {
+    loaded = true;
+    if (!DiskCache::enabled) return;
+    std::ifstream file(path());
+    std::string line;
+    while (std::getline(file, line) && aliases.size() < MAX_ALIASES) {
+        size_t tab = line.find('\t');
+        if (tab == std::string::npos || tab == 0 || tab + 1 == line.size()) continue;
+        std::string alias = line.substr(0, tab);
+        std::string place = line.substr(tab + 1);
+        double lat, lon;
+        if (coordinates(alias, lat, lon)) PlaceIndex::insert(lat, lon, place);
+        aliases[std::move(alias)] = std::move(place);  // later lines win
+    }
+    if (!aliases.empty()) LOG_DEBUG("Loaded " + std::to_string(aliases.size()) + " location aliases");
+}
+
+size_t LocationKeys::alias_count() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) load_locked();
+    return aliases.size();
+}
+
+size_t LocationKeys::compact() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!loaded) load_locked();
+    if (!DiskCache::enabled) return aliases.size();
+    std::string contents;
+    for (const auto& [alias, place] : aliases) contents += alias + '\t' + place + '\n';
+    std::string tmp = path() + ".tmp." + std::to_string(getpid());
+    {
+        std::ofstream file(tmp, std::ios::trunc | std::ios::binary);
+        file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+        if (!file) return aliases.size();
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp, path(), ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+    return aliases.size();
+}
+
+// Semantic view of a WeatherAPI request so cached supersets can answer narrower queries
+struct CacheQuery {
+    enum Endpoint { CURRENT, FORECAST };
+
+    static constexpr int MAX_FORECAST_DAYS = 14;
+
+    std::string base;
+    std::string api_key;
+    std::string location;  // as sent upstream, percent-encoded
+    std::string place;     // LocationKeys::canonical(location), the cache identity
+    Endpoint endpoint = CURRENT;
+    int days = 1;
+    bool aqi = false;
+    bool alerts = false;
+
+    static bool parse(const std::string& url, CacheQuery& query);
+
+    std::string to_url() const;
+    std::string cache_key() const;
+    std::vector<CacheQuery> covering_queries() const;
+    CacheQuery widened(int min_days) const;
+    json slice(const json& data) const;
+};
+
+bool CacheQuery::parse(const std::string& url, CacheQuery& query) {
+    size_t question = url.find('?');
+    size_t slash = url.rfind('/', question);
+    if (question == std::string::npos || slash == std::string::npos) return false;
+
+    std::string file = url.substr(slash + 1, question - slash - 1);
+    if (file == "current.json") query.endpoint = CURRENT;
+    else if (file == "forecast.json") query.endpoint = FORECAST;
+    else return false;
+    query.base = url.substr(0, slash + 1);
+
+    bool has_location = false;
+    size_t pos = question + 1;
+    while (pos <= url.size()) {
+        size_t end = url.find('&', pos);
+        if (end == std::string::npos) end = url.size();
+        std::string param = url.substr(pos, end - pos);
+        size_t eq = param.find('=');
+        std::string name = param.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : param.substr(eq + 1);
+
+        if (name == "key") query.api_key = value;
+        else if (name == "q") { query.location = value; has_location = true; }
+        else if (name == "aqi") query.aqi = value == "yes";
+        else if (name == "alerts" && query.endpoint == FORECAST) query.alerts = value == "yes";
+        else if (name == "days" && query.endpoint == FORECAST) {
+            try {
+                query.days = std::stoi(value);
+            } catch (const std::exception&) {
+                return false;
+            }
+            if (query.days < 1 || query.days > MAX_FORECAST_DAYS) return false;
+        }
+        // Any other parameter changes the response in ways we do not model
+        else if (!name.empty()) return false;
+
+        pos = end + 1;
+    }
+    if (has_location) query.place = LocationKeys::canonical(query.location);
+    return has_location;
+}
+
+std::string CacheQuery::to_url() const {
+    std::string url = base + (endpoint == FORECAST ? "forecast.json" : "current.json") +
+                      "?key=" + api_key + "&q=" + location;
+    if (endpoint == FORECAST) url += "&days=" + std::to_string(days);
+    url += aqi ? "&aqi=yes" : "&aqi=no";
+    if (endpoint == FORECAST) url += alerts ? "&alerts=yes" : "&alerts=no";
+    return url;
+}
+
+// Canonical, key-free form: equivalent URLs and location spellings map to the same entry
+std::string CacheQuery::cache_key() const {
+    std::string key = base + (endpoint == FORECAST ? "forecast.json" : "current.json") + "?q=" + place;
+    if (endpoint == FORECAST) key += "&days=" + std::to_string(days);
+    key += aqi ? "&aqi=yes" : "&aqi=no";
+    if (endpoint == FORECAST) key += alerts ? "&alerts=yes" : "&alerts=no";
+    return key;
+}
+
+// Every query whose response contains this query's data, cheapest first
+std::vector<CacheQuery> CacheQuery::covering_queries() const {
+    std::vector<CacheQuery> queries;
+    CacheQuery candidate = *this;
+
+    if (endpoint == CURRENT) {
+        for (int with_aqi = aqi; with_aqi <= 1; ++with_aqi) {
+            candidate.aqi = with_aqi;
+            queries.push_back(candidate);
+        }
+        candidate.endpoint = FORECAST;
+    }
+
+    for (int d = endpoint == FORECAST ? days : 1; d <= MAX_FORECAST_DAYS; ++d) {
+        for (int with_aqi = aqi; with_aqi <= 1; ++with_aqi) {
+            for (int with_alerts = endpoint == FORECAST ? alerts : 0; with_alerts <= 1; ++with_alerts) {
+                candidate.days = d;
+                candidate.aqi = with_aqi;
+                candidate.alerts = with_alerts;
+                queries.push_back(candidate);
+            }
+        }
+    }
+    return queries;
+}
+
+// The broadest request worth making once instead of several narrow ones
+CacheQuery CacheQuery::widened(int min_days) const {
+    CacheQuery wide = *this;
+    wide.endpoint = FORECAST;
+    wide.days = std::max(endpoint == FORECAST ? days : 1, min_days);
+    wide.aqi = true;
+    wide.alerts = true;
+    return wide;
+}
+
+json CacheQuery::slice(const json& data) const {
+    json result;
+    if (data.contains("location")) result["location"] = data["location"];
+    if (data.contains("current")) {
+        result["current"] = data["current"];
+        if (!aqi) result["current"].erase("air_quality");
+    }
+    if (endpoint == CURRENT) return result;
+
+    if (data.contains("forecast") && data["forecast"].contains("forecastday")) {
+        json forecast_days = json::array();
+        for (const auto& day : data["forecast"]["forecastday"]) {
+            if (static_cast<int>(forecast_days.size()) >= days) break;
+            forecast_days.push_back(day);
+            if (!aqi) {
+                auto& sliced = forecast_days.back();
+                if (sliced.contains("day")) sliced["day"].erase("air_quality");
+                if (sliced.contains("hour")) {
+                    for (auto& hour : sliced["hour"]) hour.erase("air_quality");
+                }
+            }
+        }
+        result["forecast"]["forecastday"] = std::move(forecast_days);
+    }
+    if (alerts && data.contains("alerts")) result["alerts"] = data["alerts"];
+    return result;
+}
+
+// Sharded, byte-bounded LRU store of decoded responses shared by all threads
+class ResponseCache {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static JsonPtr get(const std::string& key, Clock::duration max_age, Clock::time_point* stored_at = nullptr);
+    static void put(const std::string& key, JsonPtr data, Clock::time_point stored_at = Clock::now(),
+                    const std::string& source_url = "");
+    static std::vector<std::pair<std::string, std::string>> hottest(size_t count, Clock::duration min_age);
+    static size_t sweep(Clock::duration max_age);
+    static void start_sweeper(Clock::duration interval, Clock::duration max_age);
+    static void stop_sweeper();
+    static void clear();
+    static size_t size_bytes();
+    static size_t entry_count();
+    static size_t budget_bytes();
+    static size_t estimate_bytes(const json& value);
+
+private:
+    static const size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        JsonPtr data;
+        Clock::time_point stored_at;
+        std::string source_url;
+        size_t bytes = 0;
+        uint32_t hits = 0;
+        std::list<std::string>::iterator lru_position;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<std::string> lru;
+        std::unordered_map<std::string, Entry> entries;
+        size_t bytes = 0;
+    };
+
+    struct Sweeper {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        bool stop = false;
+        ~Sweeper() { ResponseCache::stop_sweeper(); }
+    };
+
+    static Shard shards[SHARD_COUNT];
+    static Sweeper sweeper;
+
+    static Shard& shard_for(const std::string& key);
+    static void erase_locked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+};
+
+ResponseCache::Shard ResponseCache::shards[ResponseCache::SHARD_COUNT];
+ResponseCache::Sweeper ResponseCache::sweeper;
+
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& key) {
+    return shards[std::hash<std::string>{}(key) % SHARD_COUNT];
+}
+
+size_t ResponseCache::budget_bytes() {
+    return static_cast<size_t>(std::max(1, Config::CACHE_SIZE_MB)) * 1024 * 1024;
+}
+
+// Approximate heap footprint of a DOM, counted once on insert
+size_t ResponseCache::estimate_bytes(const json& value) {
+    size_t bytes = sizeof(json);
+    switch (value.type()) {
+        case json::value_t::object:
+            for (auto it = value.begin(); it != value.end(); ++it) {
+                // Map node overhead plus the key string
+                bytes += 48 + it.key().capacity() + estimate_bytes(it.value());
+            }
+            break;
+        case json::value_t::array:
+            for (const auto& element : value) bytes += estimate_bytes(element);
+            break;
+        case json::value_t::string:
+            bytes += sizeof(std::string) + value.get_ref<const std::string&>().capacity();
+            break;
+        default:
+            break;
+    }
+    return bytes;
+}
+
+void ResponseCache::erase_locked(Shard& shard, std::unordered_map<std::string, Entry>::iterator it) {
+    shard.bytes -= it->second.bytes;
+    shard.lru.erase(it->second.lru_position);
+    shard.entries.erase(it);
+}
+
+JsonPtr ResponseCache::get(const std::string& key, Clock::duration max_age, Clock::time_point* stored_at) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(key);
+    if (it == shard.entries.end()) return nullptr;
+    if (Clock::now() - it->second.stored_at >= max_age) return nullptr;
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru_position);
+    it->second.hits++;
+    if (stored_at) *stored_at = it->second.stored_at;
+    return it->second.data;
+}
+
+void ResponseCache::put(const std::string& key, JsonPtr data, Clock::time_point stored_at,
+                        const std::string& source_url) {
+    if (!data) return;
+    const size_t bytes = key.capacity() + source_url.capacity() + estimate_bytes(*data);
+    const size_t shard_budget = budget_bytes() / SHARD_COUNT;
+    if (bytes > shard_budget) {
+        LOG_DEBUG("Response too large to cache: " + key);
+        return;
+    }
+
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // Replacing an entry keeps its popularity
+    uint32_t hits = 0;
+    auto existing = shard.entries.find(key);
+    if (existing != shard.entries.end()) {
+        hits = existing->second.hits;
+        erase_locked(shard, existing);
+    }
+
+    while (!shard.lru.empty() && shard.bytes + bytes > shard_budget) {
+        erase_locked(shard, shard.entries.find(shard.lru.back()));
+    }
+
+    shard.lru.push_front(key);
+    Entry entry;
+    entry.data = std::move(data);
+    entry.stored_at = stored_at;
+    entry.source_url = source_url;
+    entry.bytes = bytes;
+    entry.hits = hits;
+    entry.lru_position = shard.lru.begin();
+    shard.entries.emplace(key, std::move(entry));
+    shard.bytes += bytes;
+}
+
+size_t ResponseCache::sweep(Clock::duration max_age) {
+    const auto now = Clock::now();
+    size_t removed = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto it = shard.entries.begin(); it != shard.entries.end();) {
+            auto current = it++;
+            if (now - current->second.stored_at >= max_age) {
+                erase_locked(shard, current);
+                removed++;
+            }
+        }
+    }
+    return removed;
+}
+
+// Most requested refreshable entries at least min_age old; hit counts decay on every call
+std::vector<std::pair<std::string, std::string>> ResponseCache::hottest(size_t count, Clock::duration min_age) {
+    struct Candidate { uint32_t hits; std::string key, url; };
+    std::vector<Candidate> candidates;
+    const auto now = Clock::now();
+
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& [key, entry] : shard.entries) {
+            if (entry.hits > 0 && !entry.source_url.empty() && now - entry.stored_at >= min_age) {
+                candidates.push_back({entry.hits, key, entry.source_url});
+            }
+            entry.hits /= 2;
+        }
+    }
+
+    size_t keep = std::min(count, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + static_cast<std::ptrdiff_t>(keep), candidates.end(),
+                      [](const Candidate& a, const Candidate& b) { return a.hits > b.hits; });
+
+    std::vector<std::pair<std::string, std::string>> result;
+    for (size_t i = 0; i < keep; ++i) result.emplace_back(candidates[i].key, candidates[i].url);
+    return result;
+}
+
+void ResponseCache::start_sweeper(Clock::duration interval, Clock::duration max_age) {
+    std::lock_guard<std::mutex> lock(sweeper.mutex);
+    if (sweeper.thread.joinable()) return;
+    sweeper.stop = false;
+    sweeper.thread = std::thread([interval, max_age]() {
+        std::unique_lock<std::mutex> guard(sweeper.mutex);
+        while (!sweeper.wake.wait_for(guard, interval, [] { return sweeper.stop; })) {
+            guard.unlock();
+            size_t removed = sweep(max_age);
+            if (removed > 0) LOG_DEBUG("Cache sweep removed " + std::to_string(removed) + " expired entries");
+            guard.lock();
+        }
+    });
+}
+
+void ResponseCache::stop_sweeper() {
+    std::unique_lock<std::mutex> lock(sweeper.mutex);
+    if (!sweeper.thread.joinable()) return;
+    sweeper.stop = true;
+    lock.unlock();
+    sweeper.wake.notify_all();
+    sweeper.thread.join();
+}
+
+void ResponseCache::clear() {
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.entries.clear();
+        shard.lru.clear();
+        shard.bytes = 0;
+    }
+}
+
+size_t ResponseCache::size_bytes() {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.bytes;
+    }
+    return total;
+}
+
+size_t ResponseCache::entry_count() {
+    size_t total = 0;
+    for (auto& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.entries.size();
+    }
+    return total;
+}
+
+// Refreshes stale and frequently used cache entries off the caller's thread
+class BackgroundRefresher {
+public:
+    static void schedule(const std::string& key, const std::string& url);
+    static void start();
+    static void stop();
+
+private:
+    struct Worker {
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable drained;
+        std::deque<std::pair<std::string, std::string>> queue;
+        std::unordered_set<std::string> pending;
+        bool stop = false;
+        bool finished = false;
+        std::chrono::steady_clock::time_point drain_deadline;
+        CancelFlag cancel{false};
+        ~Worker() { BackgroundRefresher::stop(); }
+    };
+
+    static const std::chrono::seconds PROACTIVE_INTERVAL;
+    static const std::chrono::seconds PROACTIVE_MARGIN;
+    static const std::chrono::seconds DRAIN_TIMEOUT;
+    static Worker worker;
+
+    static void run();
+    static void ensure_started_locked();
+    static void refresh_hot_entries();
+};
+
+// Enhanced HTTP client with retry logic and caching
+class HttpClient {
+private:
+    static JsonPtr find_cached(const std::string& key, ResponseCache::Clock::duration max_age,
+                               ResponseCache::Clock::time_point& stored_at, bool indexed_only = false);
+    static JsonPtr download(const std::string& url, int retries, std::string& body, const CancelFlag* cancel = nullptr);
+    static bool cancelled(const CancelFlag* cancel) { return cancel && cancel->load(std::memory_order_relaxed); }
+    static void store(const std::string& key, const std::string& url, const JsonPtr& data, const std::string& body);
+    static JsonPtr find_nearby(const CacheQuery& query);
+
+public:
+    static const std::chrono::minutes CACHE_DURATION;
+    static const int WIDENED_FORECAST_DAYS;
+    static bool widen_requests;
+
+    static size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp);
+    static int ProgressCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t);
+    static void configure_handle(CURL* curl, const std::string& url, std::string* response,
+                                 const CancelFlag* cancel = nullptr);
+    static JsonPtr fetch(const std::string& url, bool use_cache = true, int retries = 3,
+                         const CancelFlag* cancel = nullptr);
+    static json make_request(const std::string& url, bool use_cache = true, int retries = 3);
+    static bool refresh(const std::string& key, const std::string& url, const CancelFlag* cancel = nullptr);
+    static ResponseCache::Clock::duration retention();
+    static void clear_cache() { ResponseCache::clear(); DiskCache::clear(); }
+};
+
+const std::chrono::minutes HttpClient::CACHE_DURATION(5);
+const int HttpClient::WIDENED_FORECAST_DAYS = 7;
+bool HttpClient::widen_requests = false;
+
+size_t HttpClient::WriteCallback(void* contents, size_t size, size_t nmemb, std::string* userp) {
+    userp->append((char*)contents, size * nmemb);
+    return size * nmemb;
+}
+
+// Returning non-zero makes curl abort the transfer with CURLE_ABORTED_BY_CALLBACK
+int HttpClient::ProgressCallback(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    return cancelled(static_cast<const CancelFlag*>(clientp)) ? 1 : 0;
+}
+
+void HttpClient::configure_handle(CURL* curl, const std::string& url, std::string* response,
+                                  const CancelFlag* cancel) {
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, response);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, Config::USER_AGENT.c_str());
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, static_cast<long>(Config::TIMEOUT));
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 2L);
+    if (cancel) {
+        curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, ProgressCallback);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<CancelFlag*>(cancel));
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    }
+}
+
+// How long an entry stays usable: fresh for CACHE_DURATION, then stale for up to MAX_STALE_MINUTES
+ResponseCache::Clock::duration HttpClient::retention() {
+    return CACHE_DURATION + std::chrono::minutes(std::max(0, Config::MAX_STALE_MINUTES));
+}
+
+JsonPtr HttpClient::find_cached(const std::string& key, ResponseCache::Clock::duration max_age,
+                                ResponseCache::Clock::time_point& stored_at, bool indexed_only) {
+    if (JsonPtr data = ResponseCache::get(key, max_age, &stored_at)) {
+        return data;
+    }
+
+    // An entry written by an earlier process skips the network entirely.
+    // Speculative probes only open files the disk index knows about.
+    if (indexed_only && !DiskCache::contains(key)) return nullptr;
+    std::string body;
+    std::chrono::seconds disk_age(0);
+    auto max_age_seconds = std::chrono::duration_cast<std::chrono::seconds>(max_age);
+    if (DiskCache::load(key, max_age_seconds, body, &disk_age)) {
+        try {
+            auto data = std::make_shared<const json>(json::parse(body));
+            stored_at = ResponseCache::Clock::now() - disk_age;
+            ResponseCache::put(key, data, stored_at);
+            return data;
+        } catch (const json::parse_error&) {
+            return nullptr;
+        }
+    }
+    return nullptr;
+}
+
+json HttpClient::make_request(const std::string& url, bool use_cache, int retries) {
+    JsonPtr data = fetch(url, use_cache, retries);
+    return data ? *data : json(nullptr);
+}
+
+JsonPtr HttpClient::fetch(const std::string& url, bool use_cache, int retries, const CancelFlag* cancel) {
+    CacheQuery query;
+    const bool semantic = CacheQuery::parse(url, query);
+    std::string key = semantic ? query.cache_key() : DiskCache::cache_key(url);
+
+    // Check cache first, including any cached response that is a superset of this one.
+    // A fresh candidate wins; otherwise the first stale one is served while it is revalidated.
+    if (use_cache) {
+        std::vector<CacheQuery> candidates = semantic ? query.covering_queries() : std::vector<CacheQuery>{};
+        const size_t candidate_count = semantic ? candidates.size() : 1;
+        const auto now = ResponseCache::Clock::now();
+
+        JsonPtr stale_data;
+        std::string stale_key, stale_url;
+        ResponseCache::Clock::time_point stale_stored_at;
+
+        for (size_t i = 0; i < candidate_count; ++i) {
+            const std::string candidate = semantic ? candidates[i].cache_key() : key;
+            ResponseCache::Clock::time_point stored_at;
+            // Only the exact key is worth an open() when the index has not seen it
+            JsonPtr cached_data = find_cached(candidate, stale_data ? CACHE_DURATION : retention(), stored_at,
+                                              candidate != key);
+            if (!cached_data) continue;
+
+            if (now - stored_at >= CACHE_DURATION) {
+                if (!stale_data) {
+                    stale_data = cached_data;
+                    stale_key = candidate;
+                    stale_url = semantic ? candidates[i].to_url() : url;
+                    stale_stored_at = stored_at;
+                }
+                continue;
+            }
+
+            LOG_DEBUG("Using cached data for: " + candidate);
+            Metrics::add(Metrics::CACHE_HITS);
+            if (candidate == key) return cached_data;
+
+            // Keep the slice so repeated narrow lookups become exact hits
+            auto sliced = std::make_shared<const json>(query.slice(*cached_data));
+            ResponseCache::put(key, sliced, stored_at);
+            return sliced;
+        }
+
+        // A coordinate query with no entry of its own may borrow a fresh one from a place nearby
+        if (!stale_data && semantic) {
+            if (JsonPtr nearby = find_nearby(query)) {
+                Metrics::add(Metrics::CACHE_NEARBY);
+                return nearby;
+            }
+        }
+
+        if (stale_data) {
+            LOG_DEBUG("Serving stale data while revalidating: " + stale_key);
+            BackgroundRefresher::schedule(stale_key, stale_url);
+            Metrics::add(Metrics::CACHE_STALE);
+            if (stale_key == key) return stale_data;
+            auto sliced = std::make_shared<const json>(query.slice(*stale_data));
+            ResponseCache::put(key, sliced, stale_stored_at);
+            return sliced;
+        }
+        Metrics::add(Metrics::CACHE_MISSES);
+    }
+
+    // Fetch the broadest useful response once so later narrower queries hit the cache
+    std::string fetch_url = url;
+    std::string store_key = key;
+    CacheQuery wide;
+    const bool widened = use_cache && semantic && widen_requests;
+    if (widened) {
+        wide = query.widened(WIDENED_FORECAST_DAYS);
+        fetch_url = wide.to_url();
+        store_key = wide.cache_key();
+    }
+
+    std::string response_string;
+    JsonPtr data = download(fetch_url, retries, response_string, cancel);
+    if (!data) return nullptr;
+
+    // Now that the API has named the place, store under its key so every spelling finds it
+    if (use_cache && semantic && LocationKeys::learn(query.location, *data)) {
+        query.place = wide.place = LocationKeys::canonical(query.location);
+        key = query.cache_key();
+        store_key = widened ? wide.cache_key() : key;
+    }
+
+    // Cache successful response
+    if (use_cache) {
+        store(store_key, fetch_url, data, response_string);
+    }
+
+    if (store_key == key) return data;
+    auto sliced = std::make_shared<const json>(query.slice(*data));
+    ResponseCache::put(key, sliced);
+    return sliced;
+}
+
+JsonPtr HttpClient::find_nearby(const CacheQuery& query) {
+    double lat, lon;
+    if (Config::REUSE_RADIUS_KM <= 0 ||
+        !LocationKeys::coordinates(LocationKeys::decode(query.location), lat, lon)) {
+        return nullptr;
+    }
+    const auto max_age = std::min<ResponseCache::Clock::duration>(
+        std::chrono::minutes(std::max(0, Config::REUSE_MAX_AGE_MINUTES)), retention());
+
+    for (const auto& neighbor : PlaceIndex::nearest(lat, lon, Config::REUSE_RADIUS_KM, 4)) {
+        if (neighbor.place == query.place) continue;  // its own entry has already missed
+        CacheQuery near = query;
+        near.place = neighbor.place;
+        for (const CacheQuery& candidate : near.covering_queries()) {
+            ResponseCache::Clock::time_point stored_at;
+            // Neighbors are speculative: never open an entry the disk index has not seen
+            JsonPtr cached_data = find_cached(candidate.cache_key(), max_age, stored_at, true);
+            if (!cached_data) continue;
+
+            // A copy, so the distance is reported without touching the shared entry
+            json reused = query.slice(*cached_data);
+            reused["location"]["reuse_distance_km"] = std::round(neighbor.distance_km * 1000) / 1000;
+            LOG_DEBUG("Reusing " + candidate.cache_key() + " for " + query.location + " (" +
+                      std::to_string(neighbor.distance_km) + " km away)");
+            return std::make_shared<const json>(std::move(reused));
+        }
+    }
+    return nullptr;
+}
+
+bool HttpClient::refresh(const std::string& key, const std::string& url, const CancelFlag* cancel) {
+    std::string body;
+    JsonPtr data = download(url, 1, body, cancel);
+    if (!data) return false;
+    store(key, url, data, body);
+    return true;
+}
+
+void HttpClient::store(const std::string& key, const std::string& url, const JsonPtr& data, const std::string& body) {
+    ResponseCache::put(key, data, ResponseCache::Clock::now(), url);
+    DiskCache::store(key, body);
+}
+
+JsonPtr HttpClient::download(const std::string& url, int retries, std::string& response_string,
+                             const CancelFlag* cancel) {
+    ConnectionPool::Lease lease = ConnectionPool::acquire();
+    if (!lease) {
+        return nullptr;
+    }
+    CURL* curl = lease.get();
+
+    // Enhanced curl options
+    configure_handle(curl, url, &response_string, cancel);
+
+    // Retries are paced by the scheduler; this thread only waits for the outcome
+    RequestScheduler::Result result = RequestScheduler::perform(curl, url, response_string, retries, cancel);
+    if (cancelled(cancel)) {
+        LOG_INFO("Request cancelled: " + DiskCache::cache_key(url));
+        return nullptr;
+    }
+    if (!result.error.empty()) {
+        std::string reason = result.error;
+        if (result.code == CURLE_OK) {
+            // WeatherAPI explains 4xx responses in the body
+            json body = json::parse(response_string, nullptr, false);
+            if (body.is_object() && body.contains("error") && body["error"].is_object() &&
+                body["error"].value("message", json()).is_string()) {
+                reason += ": " + body["error"]["message"].get<std::string>();
+            }
+        }
+        LOG_ERROR("Request failed after " + std::to_string(result.attempts) + " attempt(s): " + reason);
+        Metrics::add(Metrics::HTTP_FAILURES);
+        return nullptr;
+    }
+
+    try {
+        JsonPtr data;
+        {
+            Metrics::Timer timer(Metrics::PARSE);
+            data = std::make_shared<const json>(json::parse(response_string));
+        }
+        if (data->contains("error")) {
+            LOG_ERROR("API Error: " + (*data)["error"]["message"].get<std::string>());
+            Metrics::add(Metrics::HTTP_FAILURES);
+            return nullptr;
+        }
+        return data;
+    } catch (const json::parse_error& e) {
+        LOG_ERROR("JSON parsing error: " + std::string(e.what()));
+        Metrics::add(Metrics::HTTP_FAILURES);
+        return nullptr;
+    }
+}
+
+const std::chrono::seconds BackgroundRefresher::PROACTIVE_INTERVAL(30);
+const std::chrono::seconds BackgroundRefresher::PROACTIVE_MARGIN(60);
+const std::chrono::seconds BackgroundRefresher::DRAIN_TIMEOUT(3);
+BackgroundRefresher::Worker BackgroundRefresher::worker;
+
+// Must be called with worker.mutex held
+void BackgroundRefresher::ensure_started_locked() {
+    if (worker.thread.joinable()) return;
+    worker.stop = false;
+    worker.finished = false;
+    worker.cancel = false;
+    worker.thread = std::thread(run);
+}
+
+void BackgroundRefresher::start() {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    ensure_started_locked();
+}
+
+void BackgroundRefresher::schedule(const std::string& key, const std::string& url) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (!worker.pending.insert(key).second) return;
+    worker.queue.emplace_back(key, url);
+    ensure_started_locked();
+    worker.wake.notify_one();
+}
+
+// Revalidations already queued still run, for up to DRAIN_TIMEOUT, so the
+// stale entries this process served are fresh on disk for the next one
+void BackgroundRefresher::stop() {
+    std::unique_lock<std::mutex> lock(worker.mutex);
+    if (!worker.thread.joinable()) return;
+    worker.stop = true;
+    worker.drain_deadline = std::chrono::steady_clock::now() + DRAIN_TIMEOUT;
+    worker.wake.notify_all();
+    worker.drained.wait_until(lock, worker.drain_deadline, [] { return worker.finished; });
+    worker.cancel = true;  // aborts a refresh still in flight
+    lock.unlock();
+    worker.thread.join();
+
+    lock.lock();
+    worker.queue.clear();
+    worker.pending.clear();
+}
+
+// Re-fetch the most used entries shortly before they go stale
+void BackgroundRefresher::refresh_hot_entries() {
+    if (Config::REFRESH_TOP_KEYS <= 0) return;
+    auto min_age = HttpClient::CACHE_DURATION - PROACTIVE_MARGIN;
+    for (const auto& entry : ResponseCache::hottest(static_cast<size_t>(Config::REFRESH_TOP_KEYS), min_age)) {
+        schedule(entry.first, entry.second);
+    }
+}
+
+void BackgroundRefresher::run() {
+    auto next_scan = std::chrono::steady_clock::now() + PROACTIVE_INTERVAL;
+    std::unique_lock<std::mutex> lock(worker.mutex);
+
+    while (true) {
+        if (worker.stop) {
+            // Draining: no proactive scans, and nothing past the deadline
+            if (worker.queue.empty() || std::chrono::steady_clock::now() >= worker.drain_deadline) break;
+        } else {
+            if (worker.queue.empty()) {
+                worker.wake.wait_until(lock, next_scan, [] { return worker.stop || !worker.queue.empty(); });
+            }
+            if (!worker.stop && std::chrono::steady_clock::now() >= next_scan) {
+                next_scan = std::chrono::steady_clock::now() + PROACTIVE_INTERVAL;
+                lock.unlock();
+                refresh_hot_entries();
+                lock.lock();
+                continue;
+            }
+            if (worker.queue.empty()) continue;
+        }
+
+        auto [key, url] = worker.queue.front();
+        worker.queue.pop_front();
+        lock.unlock();
+
+        bool refreshed = HttpClient::refresh(key, url, &worker.cancel);
+        LOG_DEBUG(std::string(refreshed ? "Refreshed " : "Failed to refresh ") + key);
+
+        lock.lock();
+        worker.pending.erase(key);
+    }
+    worker.finished = true;
+    worker.drained.notify_all();
+}
+
+// Terminal frame buffer. Once installed, std::cout writes into one reusable
+// buffer and a whole screen leaves the process in a single write() when it is
+// presented: explicitly, or implicitly before std::cin/std::cerr are used.
+// std::endl no longer costs a syscall per line. Consecutive SGR color codes are
+// folded against the attributes the terminal already has, so the RESET/color
+// pairs the renderers emit around every cell never reach the tty.
+class Frame {
+public:
+    static void install();
+    static void uninstall();
+    static bool installed() { return saved_cout != nullptr; }
+    // Sends the pending frame; without install() it just flushes std::cout.
+    static void present();
+
+    // The next present() records the time since this call as render time
+    static void begin_screen() { screen_started = std::chrono::steady_clock::now(); }
+
+    static size_t presented_bytes() { return bytes_written; }
+    static size_t write_calls() { return writes; }
+
+private:
+    class Buffer : public std::streambuf {
+    public:
+        ~Buffer() override { Frame::uninstall(); }
+    protected:
+        int_type overflow(int_type ch) override;
+        std::streamsize xsputn(const char* data, std::streamsize count) override;
+        int sync() override { return 0; }  // std::endl must not flush
+    };
+
+    class Presenter : public std::streambuf {
+    protected:
+        int sync() override { Frame::present(); return 0; }
+    };
+
+    static void append(const char* data, size_t count);
+    static void put_escape(char c);
+    static void resolve_attributes();
+    static void write_out(const char* data, size_t count);
+
+    static std::string buffer;
+    static std::string escape;   // partially received escape sequence
+    static std::string pending;  // SGR codes seen since the last visible byte
+    static std::string active;   // SGR codes in effect since the last reset
+    static std::streambuf* saved_cout;
+    static std::ostream* saved_cin_tie;
+    static std::ostream* saved_cerr_tie;
+    static size_t bytes_written;
+    static size_t writes;
+    static std::optional<std::chrono::steady_clock::time_point> screen_started;
+    static Presenter presenter_buffer;
+    static std::ostream presenter;
+    static Buffer frame_buffer;  // defined last so it is destroyed first
+};
+
+std::string Frame::buffer;
+std::string Frame::escape;
+std::string Frame::pending;
+std::string Frame::active;
+std::streambuf* Frame::saved_cout = nullptr;
+std::ostream* Frame::saved_cin_tie = nullptr;
+std::ostream* Frame::saved_cerr_tie = nullptr;
+size_t Frame::bytes_written = 0;
+size_t Frame::writes = 0;
+std::optional<std::chrono::steady_clock::time_point> Frame::screen_started;
+Frame::Presenter Frame::presenter_buffer;
+std::ostream Frame::presenter(&Frame::presenter_buffer);
+Frame::Buffer Frame::frame_buffer;
+
+void Frame::install() {
+    if (installed()) return;
+    std::cout.flush();
+    std::fflush(stdout);
+    buffer.reserve(16 * 1024);
+    saved_cout = std::cout.rdbuf(&frame_buffer);
+    saved_cin_tie = std::cin.tie(&presenter);
+    saved_cerr_tie = std::cerr.tie(&presenter);
+}
+
+void Frame::uninstall() {
+    if (!installed()) return;
+    present();
+    std::cout.rdbuf(saved_cout);
+    std::cin.tie(saved_cin_tie);
+    std::cerr.tie(saved_cerr_tie);
+    saved_cout = nullptr;
+}
+
+void Frame::present() {
+    if (!installed()) {
+        std::cout.flush();
+    } else {
+        if (!pending.empty()) resolve_attributes();
+        if (buffer.empty()) return;
+        write_out(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    if (screen_started) {
+        Metrics::observe(Metrics::RENDER, std::chrono::steady_clock::now() - *screen_started);
+        screen_started.reset();
+    }
+}
+
+Frame::Buffer::int_type Frame::Buffer::overflow(int_type ch) {
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        char c = traits_type::to_char_type(ch);
+        append(&c, 1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize Frame::Buffer::xsputn(const char* data, std::streamsize count) {
+    append(data, static_cast<size_t>(count));
+    return count;
+}
+
+void Frame::append(const char* data, size_t count) {
+    while (count > 0) {
+        if (!escape.empty()) {
+            put_escape(*data++);
+            --count;
+            continue;
+        }
+        const char* esc = static_cast<const char*>(std::memchr(data, '\033', count));
+        size_t run = esc ? static_cast<size_t>(esc - data) : count;
+        if (run > 0) {
+            if (!pending.empty()) resolve_attributes();
+            buffer.append(data, run);
+            data += run;
+            count -= run;
+        }
+        if (esc) {
+            escape.assign(1, '\033');
+            ++data;
+            --count;
+        }
+    }
+}
+
+void Frame::put_escape(char c) {
+    escape += c;
+    bool csi = escape[1] == '[';
+    if (csi && escape.size() > 2 && (c < 0x40 || c > 0x7E)) return;  // still in parameters
+    if (csi && escape.size() == 2) return;
+
+    if (csi && c == 'm') {
+        pending += escape;
+    } else {
+        // Cursor movement, clears and anything unrecognised pass through untouched
+        if (!pending.empty()) resolve_attributes();
+        buffer += escape;
+    }
+    escape.clear();
+}
+
+void Frame::resolve_attributes() {
+    std::string state = active;
+    size_t pos = 0;
+    while (pos < pending.size()) {
+        size_t end = pending.find('m', pos) + 1;
+        std::string_view code(pending.data() + pos, end - pos);
+        if (code == "\033[0m" || code == "\033[m") {
+            state.clear();
+        } else if (state.size() < code.size() ||
+                   state.compare(state.size() - code.size(), code.size(), code.data(), code.size()) != 0) {
+            state.append(code.data(), code.size());
+        }
+        pos = end;
+    }
+    pending.clear();
+
+    if (state == active) return;
+    if (state.compare(0, active.size(), active) == 0) {
+        buffer.append(state, active.size(), std::string::npos);
+    } else {
+        buffer += Colors::RESET;
+        buffer += state;
+    }
+    active.swap(state);
+}
+
+void Frame::write_out(const char* data, size_t count) {
+    bytes_written += count;
+#ifndef _WIN32
+    while (count > 0) {
+        ssize_t n = ::write(STDOUT_FILENO, data, count);
+        writes++;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        count -= static_cast<size_t>(n);
+    }
+#else
+    std::fwrite(data, 1, count, stdout);
+    std::fflush(stdout);
+    writes++;
+#endif
+}
+
+// Enhanced utility functions
+class Utils {
+public:
+    static std::string url_encode(std::string_view str);
+    // Appends the percent-encoded form of str to out; no temporaries
+    static void url_encode_to(std::string& out, std::string_view str);
+    static std::string trim(const std::string& str);
+    static std::string_view trim_view(std::string_view str);
+    static std::vector<std::string> split(const std::string& str, char delimiter);
+    // Fills tokens with trimmed views into str; they live as long as str does
+    static size_t split_view(std::string_view str, char delimiter, std::vector<std::string_view>& tokens);
+    static std::string format_time(const std::string& time_str);
+    // The numeric condition code wins; the text is matched only when the
+    // code is missing or unknown (older cache entries, other providers).
+    static Conditions::Category condition_category(int code, std::string_view condition);
+    static std::string_view get_weather_icon(int code, std::string_view condition);
+    static std::string_view get_condition_color(int code, std::string_view condition);
+    static std::string_view get_temperature_color(double temp);
+    static std::string_view get_aqi_color(int aqi);
+    // Runs task(cancel) on a worker thread and animates a spinner until it returns.
+    // Ctrl-C or Config::TIMEOUT raises the flag so the request aborts early.
+    template <typename Task>
+    static auto run_with_spinner(const std::string& message, Task task)
+        -> decltype(task(std::declval<const CancelFlag&>()));
+    static bool is_valid_ip(std::string_view ip);
+    static bool is_valid_ipv4(std::string_view ip);
+    static bool is_valid_ipv6(std::string_view ip);
+    // Network-order address bytes (bytes must hold 16); returns 4, 16 or 0 when invalid
+    static size_t parse_ip(std::string_view ip, unsigned char* bytes);
+    static bool parse_ipv4(std::string_view ip, unsigned char* bytes);
+    static bool parse_ipv6(std::string_view ip, unsigned char* bytes);
+    static std::string get_current_time();
+
+private:
+    static volatile std::sig_atomic_t interrupted;
+    static void on_interrupt(int) { interrupted = 1; }
+};
+
+volatile std::sig_atomic_t Utils::interrupted = 0;
+
+std::string Utils::url_encode(std::string_view str) {
+    std::string encoded_str;
+    url_encode_to(encoded_str, str);
+    return encoded_str;
+}
+
+void Utils::url_encode_to(std::string& out, std::string_view str) {
+    // RFC 3986 unreserved characters pass through; everything else is %XX
+    static constexpr struct Unreserved {
+        bool table[256] = {};
+        constexpr Unreserved() {
+            for (int c = '0'; c <= '9'; ++c) table[c] = true;
+            for (int c = 'A'; c <= 'Z'; ++c) table[c] = true;
+            for (int c = 'a'; c <= 'z'; ++c) table[c] = true;
+            table[static_cast<unsigned char>('-')] = true;
+            table[static_cast<unsigned char>('_')] = true;
+            table[static_cast<unsigned char>('.')] = true;
+            table[static_cast<unsigned char>('~')] = true;
+        }
+    } unreserved;
+    static constexpr char hex[] = "0123456789abcdef";
+
+    size_t escaped = 0;
+    for (char c : str) escaped += !unreserved.table[static_cast<unsigned char>(c)];
+    size_t pos = out.size();
+    out.resize(pos + str.size() + 2 * escaped);
+    char* dest = &out[pos];
+    for (char c : str) {
+        auto byte = static_cast<unsigned char>(c);
+        if (unreserved.table[byte]) {
+            *dest++ = c;
+        } else {
+            *dest++ = '%';
+            *dest++ = hex[byte >> 4];
+            *dest++ = hex[byte & 0x0f];
+        }
+    }
+}
+
+std::string Utils::trim(const std::string& str) {
+    return std::string(trim_view(str));
+}
+
+std::string_view Utils::trim_view(std::string_view str) {
+    size_t start = str.find_first_not_of(" \t\n\r\f\v");
+    if (start == std::string_view::npos) return {};
+    size_t end = str.find_last_not_of(" \t\n\r\f\v");
+    return str.substr(start, end - start + 1);
+}
+
+std::vector<std::string> Utils::split(const std::string& str, char delimiter) {
+    std::vector<std::string_view> views;
+    split_view(str, delimiter, views);
+    return std::vector<std::string>(views.begin(), views.end());
+}
+
+size_t Utils::split_view(std::string_view str, char delimiter, std::vector<std::string_view>& tokens) {
+    // Same fields as std::getline: a trailing delimiter does not add an empty token
+    tokens.clear();
+    size_t start = 0;
+    while (start < str.size()) {
+        size_t end = str.find(delimiter, start);
+        if (end == std::string_view::npos) end = str.size();
+        tokens.push_back(trim_view(str.substr(start, end - start)));
+        start = end + 1;
+    }
+    return tokens.size();
+}
+
+Conditions::Category Utils::condition_category(int code, std::string_view condition) {
+    Conditions::Category category = Conditions::from_code(code);
+    if (category != Conditions::UNKNOWN) return category;
+
+    // Condition texts are short; lowercase into a stack buffer instead of a copy
+    char buffer[64];
+    size_t length = std::min(condition.size(), sizeof(buffer));
+    for (size_t i = 0; i < length; ++i) buffer[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(condition[i])));
+    std::string_view text(buffer, length);
+    auto has = [text](std::string_view word) { return text.find(word) != std::string_view::npos; };
+
+    // Most specific words first: "Patchy light snow with thunder", "Freezing fog"
+    if (has("thunder") || has("storm")) return Conditions::THUNDER;
+    if (has("fog") || has("mist")) return Conditions::FOG;
+    if (has("sleet") || has("ice pellets") || has("freezing")) return Conditions::SLEET;
+    if (has("snow") || has("blizzard")) return Conditions::SNOW;
+    if (has("drizzle")) return Conditions::DRIZZLE;
+    if (has("rain") || has("shower")) return Conditions::RAIN;
+    if (has("partly")) return Conditions::PARTLY_CLOUDY;
+    if (has("cloud") || has("overcast")) return Conditions::CLOUDY;
+    if (has("sunny") || has("clear")) return Conditions::CLEAR;
+    return Conditions::UNKNOWN;
+}
+
+std::string_view Utils::get_weather_icon(int code, std::string_view condition) {
+    return Conditions::STYLES[condition_category(code, condition)].icon;
+}
+
+std::string_view Utils::get_condition_color(int code, std::string_view condition) {
+    return Conditions::STYLES[condition_category(code, condition)].color;
+}
+
+std::string_view Utils::get_temperature_color(double temp) {
+    if (temp >= 35) return Colors::RED;
+    else if (temp >= 25) return Colors::ORANGE;
+    else if (temp >= 15) return Colors::YELLOW;
+    else if (temp >= 5) return Colors::GREEN;
+    else if (temp >= -5) return Colors::CYAN;
+    else return Colors::BLUE;
+}
+
+std::string_view Utils::get_aqi_color(int aqi) {
+    switch(aqi) {
+        case 1: return Colors::GREEN;
+        case 2: return Colors::YELLOW;
+        case 3: return Colors::ORANGE;
+        case 4: return Colors::RED;
+        case 5: case 6: return Colors::PURPLE;
+        default: return Colors::GRAY;
+    }
+}
+
+template <typename Task>
+auto Utils::run_with_spinner(const std::string& message, Task task)
+    -> decltype(task(std::declval<const CancelFlag&>())) {
+    static const char* const frames[] = {"⠋", "⠙", "⠹", "⠸", "⠼", "⠴", "⠦", "⠧", "⠇", "⠏"};
+    const auto frame_interval = std::chrono::milliseconds(80);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(std::max(1, Config::TIMEOUT));
+
+    CancelFlag cancel{false};
+    auto result = std::async(std::launch::async, [&task, &cancel]() { return task(cancel); });
+
+    interrupted = 0;
+    auto previous_handler = std::signal(SIGINT, on_interrupt);
+
+    std::string notice;
+    size_t frame = 0;
+    bool drawn = false;
+    while (result.wait_for(frame_interval) != std::future_status::ready) {
+        if (!cancel.load()) {
+            if (interrupted) {
+                notice = "Cancelled";
+            } else if (std::chrono::steady_clock::now() >= deadline) {
+                notice = "Timed out after " + std::to_string(Config::TIMEOUT) + "s";
+            }
+            if (!notice.empty()) cancel.store(true);
+        }
+        std::cout << "\r" << Colors::CYAN << frames[frame] << " " << message
+                  << (cancel.load() ? " (cancelling)" : "") << Colors::RESET;
+        Frame::present();
+        frame = (frame + 1) % (sizeof(frames) / sizeof(frames[0]));
+        drawn = true;
+    }
+
+    std::signal(SIGINT, previous_handler == SIG_ERR ? SIG_DFL : previous_handler);
+    if (drawn) {
+        std::cout << "\r" << std::string(message.length() + 20, ' ') << "\r";
+        Frame::present();
+    }
+    if (!notice.empty()) std::cout << Colors::YELLOW << "⏹  " << notice << Colors::RESET << std::endl;
+    // The screen drawn from the result is timed until it reaches the terminal
+    Frame::begin_screen();
+    return result.get();
+}
+
+bool Utils::is_valid_ip(std::string_view ip) {
+    unsigned char bytes[16];
+    return parse_ip(ip, bytes) != 0;
+}
+
+bool Utils::is_valid_ipv4(std::string_view ip) {
+    unsigned char bytes[4];
+    return parse_ipv4(ip, bytes);
+}
+
+bool Utils::is_valid_ipv6(std::string_view ip) {
+    unsigned char bytes[16];
+    return parse_ipv6(ip, bytes);
+}
+
+size_t Utils::parse_ip(std::string_view ip, unsigned char* bytes) {
+    if (parse_ipv4(ip, bytes)) return 4;
+    if (parse_ipv6(ip, bytes)) return 16;
+    return 0;
+}
+
+bool Utils::parse_ipv4(std::string_view ip, unsigned char* bytes) {
+    // Four dotted decimal octets of one to three digits, each at most 255
+    int octets = 0;
+    size_t pos = 0;
+    while (octets < 4) {
+        int value = 0;
+        size_t digits = 0;
+        while (pos < ip.size() && digits < 4 && ip[pos] >= '0' && ip[pos] <= '9') {
+            value = value * 10 + (ip[pos++] - '0');
+            ++digits;
+        }
+        if (digits == 0 || digits > 3 || value > 255) return false;
+        bytes[octets] = static_cast<unsigned char>(value);
+        if (++octets == 4) break;
+        if (pos >= ip.size() || ip[pos++] != '.') return false;
+    }
+    return pos == ip.size();
+}
+
+bool Utils::parse_ipv6(std::string_view ip, unsigned char* bytes) {
+    // Up to eight groups of one to four hex digits, at most one "::" and an
+    // optional dotted IPv4 tail standing in for the last two groups
+    if (ip.size() < 2 || ip.size() > 45) return false;
+    uint16_t words[8] = {};
+    int groups = 0;
+    int gap = -1;  // group index where "::" was seen
+    size_t pos = 0;
+    if (ip[0] == ':') {
+        if (ip[1] != ':') return false;
+        gap = 0;
+        pos = 2;
+    }
+    while (pos < ip.size()) {
+        size_t start = pos;
+        unsigned value = 0;
+        while (pos < ip.size() && pos - start < 5 && std::isxdigit(static_cast<unsigned char>(ip[pos]))) {
+            char c = static_cast<char>(std::tolower(static_cast<unsigned char>(ip[pos++])));
+            value = value * 16 + static_cast<unsigned>(c <= '9' ? c - '0' : c - 'a' + 10);
+        }
+        if (pos < ip.size() && ip[pos] == '.') {
+            unsigned char tail[4];
+            if (groups > 6 || !parse_ipv4(ip.substr(start), tail)) return false;
+            words[groups++] = static_cast<uint16_t>(tail[0] << 8 | tail[1]);
+            words[groups++] = static_cast<uint16_t>(tail[2] << 8 | tail[3]);
+            break;
+        }
+        size_t digits = pos - start;
+        if (digits == 0 || digits > 4 || groups == 8) return false;
+        words[groups++] = static_cast<uint16_t>(value);
+        if (pos == ip.size()) break;
+        if (ip[pos++] != ':') return false;
+        if (pos < ip.size() && ip[pos] == ':') {
+            if (gap >= 0) return false;
+            gap = groups;
+            ++pos;
+        } else if (pos == ip.size()) {
+            return false;
+        }
+    }
+    if (gap >= 0 ? groups >= 8 : groups != 8) return false;
+
+    // Groups after "::" move to the end; the run in between is zero
+    if (gap >= 0) {
+        int tail = groups - gap;
+        for (int i = 0; i < tail; ++i) words[7 - i] = words[groups - 1 - i];
+        for (int i = gap; i < 8 - tail; ++i) words[i] = 0;
+    }
+    for (int i = 0; i < 8; ++i) {
+        bytes[2 * i] = static_cast<unsigned char>(words[i] >> 8);
+        bytes[2 * i + 1] = static_cast<unsigned char>(words[i] & 0xff);
+    }
+    return true;
+}
+
+std::string Utils::get_current_time() {
+    auto now = std::chrono::system_clock::now();
+    auto time_t = std::chrono::system_clock::to_time_t(now);
+    std::stringstream ss;
+    ss << std::put_time(std::localtime(&time_t), "%Y-%m-%d %H:%M:%S");
+    return ss.str();
+}
+
+// Typed weather domain model, decoded once per response
+struct Location {
+    std::string name;
+    std::string region;
+    std::string country;
+    double lat = 0;
+    double lon = 0;
+    std::string tz_id;
+    std::string localtime;
+    double reuse_distance_km = -1;  // set when answered from a cached place nearby
+};
+
+struct AirQuality {
+    bool available = false;
+    double co = 0;
+    double no2 = 0;
+    double o3 = 0;
+    double so2 = 0;
+    double pm2_5 = 0;
+    double pm10 = 0;
+    int us_epa_index = 0;
+    int gb_defra_index = 0;
+};
+
+struct CurrentConditions {
+    bool available = false;
+    std::string last_updated;
+    double temp_c = 0;
+    double feelslike_c = 0;
+    std::string condition_text;
+    int condition_code = 0;
+    bool is_day = true;
+    double wind_kph = 0;
+    std::string wind_dir;
+    double gust_kph = 0;
+    double pressure_mb = 0;
+    double precip_mm = 0;
+    int humidity = 0;
+    int cloud = 0;
+    double vis_km = 0;
+    double uv = 0;
+};
+
+struct HourlyPoint {
+    long long time_epoch = 0;
+    std::string time;  // "YYYY-MM-DD HH:MM" local time
+    double temp_c = 0;
+    double feelslike_c = 0;
+    std::string condition_text;
+    int condition_code = 0;
+    double wind_kph = 0;
+    double precip_mm = 0;
+    int humidity = 0;
+    int chance_of_rain = 0;
+    int chance_of_snow = 0;
+};
+
+struct ForecastDay {
+    std::string date;
+    double maxtemp_c = 0;
+    double mintemp_c = 0;
+    double avgtemp_c = 0;
+    double maxwind_kph = 0;
+    double totalprecip_mm = 0;
+    int avghumidity = 0;
+    int daily_chance_of_rain = 0;
+    int daily_chance_of_snow = 0;
+    double uv = 0;
+    std::string condition_text;
+    int condition_code = 0;
+
+    std::string sunrise;
+    std::string sunset;
+    std::string moonrise;
+    std::string moonset;
+    std::string moon_phase;
+    int moon_illumination = 0;
+
+    // Range of this day's entries in WeatherReport::hours
+    size_t first_hour = 0;
+    size_t hour_count = 0;
+};
+
+struct Alert {
+    std::string headline;
+    std::string severity;
+    std::string urgency;
+    std::string areas;
+    std::string category;
+    std::string event;
+    std::string effective;
+    std::string expires;
+    std::string desc;
+    std::string instruction;
+};
+
+struct WeatherReport {
+    Location location;
+    CurrentConditions current;
+    AirQuality air_quality;
+    std::vector<ForecastDay> days;
+    std::vector<HourlyPoint> hours;
+    std::vector<Alert> alerts;
+    std::string error;  // API error message, empty on success
+};
+
+struct IpLookup {
+    std::string ip;
+    std::string type;
+    std::string country_name;
+    std::string region;
+    std::string city;
+    double lat = 0;
+    double lon = 0;
+    std::string tz_id;
+    std::string localtime;
+};
+
+// Builds the domain model from a WeatherAPI DOM; absent fields keep their defaults
+class WeatherDecoder {
+public:
+    static WeatherReport decode(const json& data);
+    static IpLookup decode_ip(const json& data);
+
+    static Location decode_location(const json& node);
+    static CurrentConditions decode_current(const json& node);
+    static AirQuality decode_air_quality(const json& node);
+    static HourlyPoint decode_hour(const json& node);
+    static ForecastDay decode_day(const json& node);
+    static Alert decode_alert(const json& node);
+
+private:
+    static const json* child(const json& node, const char* key);
+    static double number(const json& node, const char* key);
+    static int integer(const json& node, const char* key);
+    static std::string text(const json& node, const char* key);
+};
+
+const json* WeatherDecoder::child(const json& node, const char* key) {
+    if (!node.is_object()) return nullptr;
+    auto it = node.find(key);
+    return it == node.end() ? nullptr : &*it;
+}
+
+double WeatherDecoder::number(const json& node, const char* key) {
+    const json* value = child(node, key);
+    if (!value) return 0;
+    if (value->is_number()) return value->get<double>();
+    // A few fields (e.g. moon_illumination) are sometimes sent as strings
+    if (value->is_string()) {
+        try {
+            return std::stod(value->get_ref<const std::string&>());
+        } catch (const std::exception&) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+int WeatherDecoder::integer(const json& node, const char* key) {
+    return static_cast<int>(number(node, key));
+}
+
+std::string WeatherDecoder::text(const json& node, const char* key) {
+    const json* value = child(node, key);
+    return value && value->is_string() ? value->get<std::string>() : std::string();
+}
+
+Location WeatherDecoder::decode_location(const json& node) {
+    Location location;
+    location.name = text(node, "name");
+    location.region = text(node, "region");
+    location.country = text(node, "country");
+    location.lat = number(node, "lat");
+    location.lon = number(node, "lon");
+    location.tz_id = text(node, "tz_id");
+    location.localtime = text(node, "localtime");
+    if (const json* reuse = child(node, "reuse_distance_km")) location.reuse_distance_km = reuse->get<double>();
+    return location;
+}
+
+AirQuality WeatherDecoder::decode_air_quality(const json& node) {
+    AirQuality aqi;
+    aqi.available = node.is_object();
+    aqi.co = number(node, "co");
+    aqi.no2 = number(node, "no2");
+    aqi.o3 = number(node, "o3");
+    aqi.so2 = number(node, "so2");
+    aqi.pm2_5 = number(node, "pm2_5");
+    aqi.pm10 = number(node, "pm10");
+    aqi.us_epa_index = integer(node, "us-epa-index");
+    aqi.gb_defra_index = integer(node, "gb-defra-index");
+    return aqi;
+}
+
+CurrentConditions WeatherDecoder::decode_current(const json& node) {
+    CurrentConditions current;
+    current.available = node.is_object();
+    current.last_updated = text(node, "last_updated");
+    current.temp_c = number(node, "temp_c");
+    current.feelslike_c = number(node, "feelslike_c");
+    if (const json* condition = child(node, "condition")) {
+        current.condition_text = text(*condition, "text");
+        current.condition_code = integer(*condition, "code");
+    }
+    current.is_day = integer(node, "is_day") != 0;
+    current.wind_kph = number(node, "wind_kph");
+    current.wind_dir = text(node, "wind_dir");
+    current.gust_kph = number(node, "gust_kph");
+    current.pressure_mb = number(node, "pressure_mb");
+    current.precip_mm = number(node, "precip_mm");
+    current.humidity = integer(node, "humidity");
+    current.cloud = integer(node, "cloud");
+    current.vis_km = number(node, "vis_km");
+    current.uv = number(node, "uv");
+    return current;
+}
+
+HourlyPoint WeatherDecoder::decode_hour(const json& node) {
+    HourlyPoint hour;
+    hour.time_epoch = static_cast<long long>(number(node, "time_epoch"));
+    hour.time = text(node, "time");
+    hour.temp_c = number(node, "temp_c");
+    hour.feelslike_c = number(node, "feelslike_c");
+    if (const json* condition = child(node, "condition")) {
+        hour.condition_text = text(*condition, "text");
+        hour.condition_code = integer(*condition, "code");
+    }
+    hour.wind_kph = number(node, "wind_kph");
+    hour.precip_mm = number(node, "precip_mm");
+    hour.humidity = integer(node, "humidity");
+    hour.chance_of_rain = integer(node, "chance_of_rain");
+    hour.chance_of_snow = integer(node, "chance_of_snow");
+    return hour;
+}
+
+ForecastDay WeatherDecoder::decode_day(const json& node) {
+    ForecastDay day;
+    day.date = text(node, "date");
+    if (const json* summary = child(node, "day")) {
+        day.maxtemp_c = number(*summary, "maxtemp_c");
+        day.mintemp_c = number(*summary, "mintemp_c");
+        day.avgtemp_c = number(*summary, "avgtemp_c");
+        day.maxwind_kph = number(*summary, "maxwind_kph");
+        day.totalprecip_mm = number(*summary, "totalprecip_mm");
+        day.avghumidity = integer(*summary, "avghumidity");
+        day.daily_chance_of_rain = integer(*summary, "daily_chance_of_rain");
+        day.daily_chance_of_snow = integer(*summary, "daily_chance_of_snow");
+        day.uv = number(*summary, "uv");
+        if (const json* condition = child(*summary, "condition")) {
+            day.condition_text = text(*condition, "text");
+            day.condition_code = integer(*condition, "code");
+        }
+    }
+    if (const json* astro = child(node, "astro")) {
+        day.sunrise = text(*astro, "sunrise");
+        day.sunset = text(*astro, "sunset");
+        day.moonrise = text(*astro, "moonrise");
+        day.moonset = text(*astro, "moonset");
+        day.moon_phase = text(*astro, "moon_phase");
+        day.moon_illumination = integer(*astro, "moon_illumination");
+    }
+    return day;
+}
+
+Alert WeatherDecoder::decode_alert(const json& node) {
+    Alert alert;
+    alert.headline = text(node, "headline");
+    alert.severity = text(node, "severity");
+    alert.urgency = text(node, "urgency");
+    alert.areas = text(node, "areas");
+    alert.category = text(node, "category");
+    alert.event = text(node, "event");
+    alert.effective = text(node, "effective");
+    alert.expires = text(node, "expires");
+    alert.desc = text(node, "desc");
+    alert.instruction = text(node, "instruction");
+    return alert;
+}
+
+WeatherReport WeatherDecoder::decode(const json& data) {
+    WeatherReport report;
+    if (const json* error = child(data, "error")) {
+        report.error = text(*error, "message");
+        if (report.error.empty()) report.error = "unknown API error";
+    }
+    if (const json* location = child(data, "location")) {
+        report.location = decode_location(*location);
+    }
+    if (const json* current = child(data, "current")) {
+        report.current = decode_current(*current);
+        if (const json* aqi = child(*current, "air_quality")) {
+            report.air_quality = decode_air_quality(*aqi);
+        }
+    }
+
+    const json* forecast = child(data, "forecast");
+    const json* forecast_days = forecast ? child(*forecast, "forecastday") : nullptr;
+    if (forecast_days && forecast_days->is_array()) {
+        report.days.reserve(forecast_days->size());
+        report.hours.reserve(forecast_days->size() * 24);
+        for (const auto& node : *forecast_days) {
+            ForecastDay day = decode_day(node);
+            day.first_hour = report.hours.size();
+            if (const json* hours = child(node, "hour")) {
+                for (const auto& hour : *hours) report.hours.push_back(decode_hour(hour));
+            }
+            day.hour_count = report.hours.size() - day.first_hour;
+            report.days.push_back(std::move(day));
+        }
+    }
+
+    const json* alerts = child(data, "alerts");
+    const json* alert_list = alerts ? child(*alerts, "alert") : nullptr;
+    if (alert_list && alert_list->is_array()) {
+        for (const auto& node : *alert_list) report.alerts.push_back(decode_alert(node));
+    }
+    return report;
+}
+
+IpLookup WeatherDecoder::decode_ip(const json& data) {
+    IpLookup lookup;
+    lookup.ip = text(data, "ip");
+    lookup.type = text(data, "type");
+    lookup.country_name = text(data, "country_name");
+    lookup.region = text(data, "region");
+    lookup.city = text(data, "city");
+    lookup.lat = number(data, "lat");
+    lookup.lon = number(data, "lon");
+    lookup.tz_id = text(data, "tz_id");
+    lookup.localtime = text(data, "localtime");
+    return lookup;
+}
+
+// Fills a WeatherReport straight from nlohmann SAX events without building a DOM.
+// Subtrees the model never reads are walked but not stored.
+class WeatherSaxDecoder : public nlohmann::json_sax<json> {
+public:
+    // Throws json::parse_error on malformed input, like json::parse
+    static WeatherReport decode(const std::string& body);
+
+    bool null() override { return true; }
+    bool boolean(bool value) override { return number(value ? 1 : 0); }
+    bool number_integer(number_integer_t value) override { return number(static_cast<double>(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<double>(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return number(value); }
+    bool string(string_t& value) override;
+    bool binary(binary_t&) override { return true; }
+    bool start_object(std::size_t) override;
+    bool key(string_t& value) override;
+    bool end_object() override;
+    bool start_array(std::size_t) override;
+    bool end_array() override;
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override;
+
+private:
+    enum class Scope {
+        ROOT, LOCATION, CURRENT, CURRENT_CONDITION, AIR_QUALITY,
+        FORECAST, FORECAST_DAYS, FORECAST_DAY, DAY_SUMMARY, DAY_CONDITION, ASTRO,
+        HOURS, HOUR, HOUR_CONDITION, ALERTS, ALERT_LIST, ALERT, ERROR, SKIP
+    };
+
+    explicit WeatherSaxDecoder(WeatherReport& report) : report_(report) {}
+
+    Scope object_scope() const;
+    Scope array_scope() const;
+    bool number(double value);
+
+    WeatherReport& report_;
+    std::vector<Scope> scopes_;
+    std::string key_;
+};
+
+WeatherReport WeatherSaxDecoder::decode(const std::string& body) {
+    WeatherReport report;
+    WeatherSaxDecoder decoder(report);
+    decoder.scopes_.reserve(8);
+    json::sax_parse(body, &decoder);
+    return report;
+}
+
+WeatherSaxDecoder::Scope WeatherSaxDecoder::object_scope() const {
+    if (scopes_.empty()) return Scope::ROOT;
+    switch (scopes_.back()) {
+        case Scope::ROOT:
+            if (key_ == "location") return Scope::LOCATION;
+            if (key_ == "current") return Scope::CURRENT;
+            if (key_ == "forecast") return Scope::FORECAST;
+            if (key_ == "alerts") return Scope::ALERTS;
+            if (key_ == "error") return Scope::ERROR;
+            break;
+        case Scope::CURRENT:
+            if (key_ == "condition") return Scope::CURRENT_CONDITION;
+            if (key_ == "air_quality") return Scope::AIR_QUALITY;
+            break;
+        case Scope::FORECAST_DAYS: return Scope::FORECAST_DAY;
+        case Scope::FORECAST_DAY:
+            if (key_ == "day") return Scope::DAY_SUMMARY;
+            if (key_ == "astro") return Scope::ASTRO;
+            break;
+        case Scope::DAY_SUMMARY:
+            if (key_ == "condition") return Scope::DAY_CONDITION;
+            break;
+        case Scope::HOURS: return Scope::HOUR;
+        case Scope::HOUR:
+            if (key_ == "condition") return Scope::HOUR_CONDITION;
+            break;
+        case Scope::ALERT_LIST: return Scope::ALERT;
+        default: break;
+    }
+    return Scope::SKIP;
+}
+
+WeatherSaxDecoder::Scope WeatherSaxDecoder::array_scope() const {
+    if (scopes_.empty()) return Scope::SKIP;
+    switch (scopes_.back()) {
+        case Scope::FORECAST:
+            if (key_ == "forecastday") return Scope::FORECAST_DAYS;
+            break;
+        case Scope::FORECAST_DAY:
+            if (key_ == "hour") return Scope::HOURS;
+            break;
+        case Scope::ALERTS:
+            if (key_ == "alert") return Scope::ALERT_LIST;
+            break;
+        default: break;
+    }
+    return Scope::SKIP;
+}
+
+bool WeatherSaxDecoder::start_object(std::size_t) {
+    Scope scope = !scopes_.empty() && scopes_.back() == Scope::SKIP ? Scope::SKIP : object_scope();
+    switch (scope) {
+        case Scope::CURRENT: report_.current.available = true; break;
+        case Scope::AIR_QUALITY: report_.air_quality.available = true; break;
+        case Scope::FORECAST_DAY:
+            report_.days.emplace_back();
+            report_.days.back().first_hour = report_.hours.size();
+            break;
+        case Scope::HOUR: report_.hours.emplace_back(); break;
+        case Scope::ALERT: report_.alerts.emplace_back(); break;
+        case Scope::ERROR: report_.error = "unknown API error"; break;
+        default: break;
+    }
+    scopes_.push_back(scope);
+    return true;
+}
+
+bool WeatherSaxDecoder::end_object() {
+    if (scopes_.back() == Scope::FORECAST_DAY) {
+        auto& day = report_.days.back();
+        day.hour_count = report_.hours.size() - day.first_hour;
+    }
+    scopes_.pop_back();
+    return true;
+}
+
+bool WeatherSaxDecoder::start_array(std::size_t) {
+    scopes_.push_back(!scopes_.empty() && scopes_.back() == Scope::SKIP ? Scope::SKIP : array_scope());
+    return true;
+}
+
+bool WeatherSaxDecoder::end_array() {
+    scopes_.pop_back();
+    return true;
+}
+
+bool WeatherSaxDecoder::key(string_t& value) {
+    if (scopes_.back() != Scope::SKIP) key_.assign(value);
+    return true;
+}
+
+bool WeatherSaxDecoder::parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) {
+    throw ex;
+}
+
+bool WeatherSaxDecoder::number(double value) {
+    if (scopes_.empty()) return true;
+    auto set = [&](const char* name, double& field) {
+        if (key_ != name) return false;
+        field = value;
+        return true;
+    };
+    auto set_int = [&](const char* name, int& field) {
+        if (key_ != name) return false;
+        field = static_cast<int>(value);
+        return true;
+    };
+
+    switch (scopes_.back()) {
+        case Scope::LOCATION: {
+            auto& location = report_.location;
+            set("lat", location.lat) || set("lon", location.lon);
+            break;
+        }
+        case Scope::CURRENT: {
+            auto& current = report_.current;
+            if (key_ == "is_day") {
+                current.is_day = value != 0;
+                break;
+            }
+            set("temp_c", current.temp_c) || set("feelslike_c", current.feelslike_c) ||
+                set("wind_kph", current.wind_kph) || set("gust_kph", current.gust_kph) ||
+                set("pressure_mb", current.pressure_mb) || set("precip_mm", current.precip_mm) ||
+                set_int("humidity", current.humidity) || set_int("cloud", current.cloud) ||
+                set("vis_km", current.vis_km) || set("uv", current.uv);
+            break;
+        }
+        case Scope::CURRENT_CONDITION: set_int("code", report_.current.condition_code); break;
+        case Scope::AIR_QUALITY: {
+            auto& aqi = report_.air_quality;
+            set("co", aqi.co) || set("no2", aqi.no2) || set("o3", aqi.o3) || set("so2", aqi.so2) ||
+                set("pm2_5", aqi.pm2_5) || set("pm10", aqi.pm10) ||
+                set_int("us-epa-index", aqi.us_epa_index) || set_int("gb-defra-index", aqi.gb_defra_index);
+            break;
+        }
+        case Scope::DAY_SUMMARY: {
+            auto& day = report_.days.back();
+            set("maxtemp_c", day.maxtemp_c) || set("mintemp_c", day.mintemp_c) ||
+                set("avgtemp_c", day.avgtemp_c) || set("maxwind_kph", day.maxwind_kph) ||
+                set("totalprecip_mm", day.totalprecip_mm) || set_int("avghumidity", day.avghumidity) ||
+                set_int("daily_chance_of_rain", day.daily_chance_of_rain) ||
+                set_int("daily_chance_of_snow", day.daily_chance_of_snow) || set("uv", day.uv);
+            break;
+        }
+        case Scope::DAY_CONDITION: set_int("code", report_.days.back().condition_code); break;
+        case Scope::ASTRO: set_int("moon_illumination", report_.days.back().moon_illumination); break;
+        case Scope::HOUR: {
+            auto& hour = report_.hours.back();
+            if (key_ == "time_epoch") {
+                hour.time_epoch = static_cast<long long>(value);
+                break;
+            }
+            set("temp_c", hour.temp_c) || set("feelslike_c", hour.feelslike_c) ||
+                set("wind_kph", hour.wind_kph) || set("precip_mm", hour.precip_mm) ||
+                set_int("humidity", hour.humidity) || set_int("chance_of_rain", hour.chance_of_rain) ||
+                set_int("chance_of_snow", hour.chance_of_snow);
+            break;
+        }
+        case Scope::HOUR_CONDITION: set_int("code", report_.hours.back().condition_code); break;
+        default: break;
+    }
+    return true;
+}
+
+bool WeatherSaxDecoder::string(string_t& value) {
+    if (scopes_.empty() || scopes_.back() == Scope::SKIP) return true;
+    auto take = [&](const char* name, std::string& field) {
+        if (key_ != name) return false;
+        field = std::move(value);
+        return true;
+    };
+
+    bool stored = false;
+    switch (scopes_.back()) {
+        case Scope::LOCATION: {
+            auto& location = report_.location;
+            stored = take("name", location.name) || take("region", location.region) ||
+                     take("country", location.country) || take("tz_id", location.tz_id) ||
+                     take("localtime", location.localtime);
+            break;
+        }
+        case Scope::CURRENT:
+            stored = take("last_updated", report_.current.last_updated) || take("wind_dir", report_.current.wind_dir);
+            break;
+        case Scope::CURRENT_CONDITION: stored = take("text", report_.current.condition_text); break;
+        case Scope::FORECAST_DAY: stored = take("date", report_.days.back().date); break;
+        case Scope::DAY_CONDITION: stored = take("text", report_.days.back().condition_text); break;
+        case Scope::ASTRO: {
+            auto& day = report_.days.back();
+            stored = take("sunrise", day.sunrise) || take("sunset", day.sunset) ||
+                     take("moonrise", day.moonrise) || take("moonset", day.moonset) ||
+                     take("moon_phase", day.moon_phase);
+            break;
+        }
+        case Scope::HOUR: stored = take("time", report_.hours.back().time); break;
+        case Scope::HOUR_CONDITION: stored = take("text", report_.hours.back().condition_text); break;
+        case Scope::ALERT: {
+            auto& alert = report_.alerts.back();
+            stored = take("headline", alert.headline) || take("severity", alert.severity) ||
+                     take("urgency", alert.urgency) || take("areas", alert.areas) ||
+                     take("category", alert.category) || take("event", alert.event) ||
+                     take("effective", alert.effective) || take("expires", alert.expires) ||
+                     take("desc", alert.desc) || take("instruction", alert.instruction);
+            break;
+        }
+        case Scope::ERROR: stored = take("message", report_.error); break;
+        default: break;
+    }
+    if (stored) return true;
+
+    // A few numeric fields (e.g. moon_illumination) are sometimes sent as strings
+    char* end = nullptr;
+    double parsed = std::strtod(value.c_str(), &end);
+    return end == value.c_str() ? true : number(parsed);
+}
+
+// Enhanced display functions
+class Display {
+public:
+    static void banner();
+    static void section_header(const std::string& title);
+    static void key_value(const std::string& key, const std::string& value, std::string_view color = Colors::CYAN);
+    static void progress_bar(int percentage, const std::string& label = "");
+    static void weather_card(const WeatherReport& report, const std::string& location);
+    static void hourly_forecast(const WeatherReport& report);
+    static void seven_day_forecast(const WeatherReport& report);
+    static void menu();
+    static void clear_screen();
+    static void error_message(const std::string& message);
+    static void success_message(const std::string& message);
+    static void warning_message(const std::string& message);
+    static void info_message(const std::string& message);
+    // Box-drawing glyphs are multi-byte UTF-8, so they repeat as strings
+    static std::string horizontal_rule(size_t width, const char* glyph = "─");
+};
+
+void Display::banner() {
+    std::cout << Colors::BG_BLUE << Colors::PURPLE << R"(
+  ╔══════════════════════════════════════════════════════════════╗
+  ║  ╦ ╦┌─┐┌─┐┌─┐┬ ┬┌─┐┬─┐  ╔═╗┬  ┬  ╔═╗┬─┐┌─┐  ┌┬┐ ┬ ┬  ┬┌─┐  ║
+  ║  ║║║├┤ ├─┤│  ├─┤├┤ ├┬┘  ║  │  ║  ╠═╝├┬┘│ │   │ ┬│└┬┘ │ │  ║
+  ║  ╚╩╝└─┘┴ ┴└─┘┴ ┴└─┘┴└─  ╚═╝┴─┘┴  ╩  ┴└─└─┘  ─┴─ ┴ ┴  ┴└─┘  ║
+  ╚══════════════════════════════════════════════════════════════╝
+)" << Colors::RESET << std::endl;
+    std::cout << Colors::BG_BLUE << Colors::CYAN << "      🌍 Professional Weather Intelligence Platform v2.0      " << Colors::RESET << std::endl;
+    std::cout << Colors::BG_BLUE << Colors::YELLOW << "      ──────────────────────────────────────────────────      " << Colors::RESET << "\n\n";
+    std::cout << Colors::DIM << "Current time: " << Utils::get_current_time() << Colors::RESET << "\n\n";
+}
+
+void Display::section_header(const std::string& title) {
+    std::string border = horizontal_rule(title.length() + 4, "═");
+    std::cout << "\n" << Colors::BG_DARK << Colors::BOLD << Colors::BLUE;
+    std::cout << "╔" << border << "╗" << std::endl;
+    std::cout << "║ " << title << " ║" << std::endl;
+    std::cout << "╚" << border << "╝" << Colors::RESET << std::endl;
+}
+
+void Display::key_value(const std::string& key, const std::string& value, std::string_view color) {
+    std::cout << " " << Colors::BOLD << Colors::GRAY << std::setw(18) << std::left << key + ":" 
+              << Colors::RESET << color << value << Colors::RESET << std::endl;
+}
+
+void Display::progress_bar(int percentage, const std::string& label) {
+    const int bar_width = 50;
+    int filled = (percentage * bar_width) / 100;
+    
+    filled = std::clamp(filled, 0, bar_width);
+    
+    // One color switch per segment rather than a color/reset pair per cell
+    std::string bar = "[";
+    bar += Colors::GREEN;
+    for (int i = 0; i < filled; ++i) bar += "█";
+    bar += Colors::DARK_GRAY;
+    for (int i = filled; i < bar_width; ++i) bar += "░";
+    bar += Colors::RESET;
+    
+    std::cout << " " << Colors::BOLD << label << ": " << Colors::RESET << bar << "] " << Colors::BOLD << percentage << "%" << Colors::RESET << std::endl;
+}
+
+void Display::weather_card(const WeatherReport& report, const std::string& location) {
+    if (!report.current.available) return;
+    
+    const auto& current = report.current;
+    const std::string& condition = current.condition_text;
+    double temp = current.temp_c;
+    
+    std::cout << "\n╭─────────────────────────────────────╮" << std::endl;
+    std::cout << "│ " << Colors::BOLD << Colors::CYAN << std::setw(33) << std::left << location << Colors::RESET << " │" << std::endl;
+    std::cout << "├─────────────────────────────────────┤" << std::endl;
+    std::cout << "│ " << Utils::get_weather_icon(current.condition_code, condition) << " "
+              << Utils::get_condition_color(current.condition_code, condition) << condition << Colors::RESET
+              << std::setw(25) << " " << "│" << std::endl;
+    std::cout << "│ " << Colors::BOLD << Utils::get_temperature_color(temp) << std::setw(33) << std::left 
+              << (std::to_string(static_cast<int>(temp)) + "°C") << Colors::RESET << " │" << std::endl;
+    std::cout << "│ Feels like " << Utils::get_temperature_color(current.feelslike_c) 
+              << static_cast<int>(current.feelslike_c) << "°C" << Colors::RESET << std::setw(18) << " " << "│" << std::endl;
+    std::cout << "╰─────────────────────────────────────╯" << std::endl;
+}
+
+void Display::hourly_forecast(const WeatherReport& report) {
+    if (report.days.empty()) return;
+    
+    section_header("24-HOUR FORECAST");
+    
+    const auto& today = report.days[0];
+    std::cout << "\n";
+    
+    // Header
+    std::cout << Colors::BOLD << std::setw(6) << "Time" << std::setw(12) << "Condition" 
+              << std::setw(8) << "Temp" << std::setw(8) << "Rain%" << std::setw(10) << "Wind" << Colors::RESET << std::endl;
+    std::cout << horizontal_rule(44) << std::endl;
+    
+    // Show next 12 hours
+    for (size_t i = 0; i < std::min<size_t>(12, today.hour_count); i++) {
+        const auto& hour = report.hours[today.first_hour + i];
+        std::string time = hour.time.size() >= 16 ? hour.time.substr(11, 5) : hour.time; // Extract HH:MM
+        const std::string& condition = hour.condition_text;
+        double temp = hour.temp_c;
+        
+        std::cout << Colors::CYAN << std::setw(6) << time << Colors::RESET
+                  << Utils::get_condition_color(hour.condition_code, condition)
+                  << std::setw(12) << (condition.length() > 10 ? condition.substr(0, 10) : condition) << Colors::RESET
+                  << Utils::get_temperature_color(temp) << std::setw(6) << static_cast<int>(temp) << "°" << Colors::RESET
+                  << Colors::BLUE << std::setw(6) << hour.chance_of_rain << "%" << Colors::RESET
+                  << Colors::GRAY << std::setw(8) << static_cast<int>(hour.wind_kph) << "kph" << Colors::RESET << std::endl;
+    }
+}
+
+void Display::seven_day_forecast(const WeatherReport& report) {
+    if (report.days.empty()) return;
+    
+    section_header("7-DAY FORECAST");
+    
+    std::cout << "\n" << Colors::BOLD;
+    std::cout << std::setw(12) << "Date" << std::setw(15) << "Condition" 
+              << std::setw(8) << "High" << std::setw(8) << "Low" 
+              << std::setw(8) << "Rain%" << std::setw(10) << "Wind" << Colors::RESET << std::endl;
+    std::cout << horizontal_rule(61) << std::endl;
+    
+    for (const auto& day : report.days) {
+        std::string date = day.date.size() > 5 ? day.date.substr(5) : day.date; // Remove year
+        const std::string& condition = day.condition_text;
+        
+        std::cout << Colors::CYAN << std::setw(12) << date << Colors::RESET
+                  << Utils::get_condition_color(day.condition_code, condition)
+                  << std::setw(15) << (condition.length() > 13 ? condition.substr(0, 13) : condition) << Colors::RESET
+                  << Utils::get_temperature_color(day.maxtemp_c) << std::setw(6) << static_cast<int>(day.maxtemp_c) << "°" << Colors::RESET
+                  << Utils::get_temperature_color(day.mintemp_c) << std::setw(6) << static_cast<int>(day.mintemp_c) << "°" << Colors::RESET
+                  << Colors::BLUE << std::setw(6) << day.daily_chance_of_rain << "%" << Colors::RESET
+                  << Colors::GRAY << std::setw(8) << static_cast<int>(day.maxwind_kph) << "kph" << Colors::RESET << std::endl;
+    }
+}
+
+void Display::menu() {
+    std::cout << "\n╭─────────────────────── MAIN MENU ───────────────────────╮" << std::endl;
+    std::cout << "│                                                         │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "1." << Colors::RESET << " 🌤️  Current Weather & Today's Forecast              │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "2." << Colors::RESET << " 📅  7-Day Extended Forecast                        │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "3." << Colors::RESET << " 🕒  24-Hour Detailed Forecast                      │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "4." << Colors::RESET << " 💨  Air Quality Index & Pollution Data            │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "5." << Colors::RESET << " ⚠️   Weather Alerts & Warnings                     │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "6." << Colors::RESET << " 🌿  Pollen & Allergen Information                 │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "7." << Colors::RESET << " 🌍  IP Geolocation & Weather                       │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "8." << Colors::RESET << " ⚙️   Settings & Configuration                       │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "9." << Colors::RESET << " 📄  Export Weather Report                          │" << std::endl;
+    std::cout << "│ " << Colors::BOLD << "0." << Colors::RESET << " 🚪  Exit Application                               │" << std::endl;
+    std::cout << "│                                                         │" << std::endl;
+    std::cout << "╰─────────────────────────────────────────────────────────╯" << std::endl;
+    std::cout << "\n" << Colors::BOLD << Colors::PURPLE << "Select an option (0-9): " << Colors::RESET;
+}
+
+std::string Display::horizontal_rule(size_t width, const char* glyph) {
+    std::string rule;
+    rule.reserve(width * std::strlen(glyph));
+    for (size_t i = 0; i < width; ++i) rule += glyph;
+    return rule;
+}
+
+void Display::clear_screen() {
+    std::cout << "\033[2J\033[1;1H";
+}
+
+void Display::error_message(const std::string& message) {
+    std::cout << "\n" << Colors::BG_RED << Colors::WHITE << " ❌ ERROR " << Colors::RESET 
+              << " " << Colors::RED << message << Colors::RESET << std::endl;
+}
+
+void Display::success_message(const std::string& message) {
+    std::cout << "\n" << Colors::BG_GREEN << Colors::WHITE << " ✅ SUCCESS " << Colors::RESET 
+              << " " << Colors::GREEN << message << Colors::RESET << std::endl;
+}
+
+void Display::warning_message(const std::string& message) {
+    std::cout << "\n" << Colors::BG_YELLOW << Colors::WHITE << " ⚠️  WARNING " << Colors::RESET 
+              << " " << Colors::YELLOW << message << Colors::RESET << std::endl;
+}
+
+void Display::info_message(const std::string& message) {
+    std::cout << "\n" << Colors::CYAN << "ℹ️  " << message << Colors::RESET << std::endl;
+}
+
+// Enhanced weather service class
+class WeatherService {
+public:
+    static std::string current_url(const std::string& location);
+    static std::string forecast_url(const std::string& location, int days);
+    static std::optional<WeatherReport> get_current_weather(const std::string& location,
+                                                            const CancelFlag* cancel = nullptr);
+    static std::optional<WeatherReport> get_forecast(const std::string& location, int days = 7,
+                                                     const CancelFlag* cancel = nullptr);
+    static std::optional<WeatherReport> get_hourly_forecast(const std::string& location,
+                                                            const CancelFlag* cancel = nullptr);
+    static std::optional<WeatherReport> get_air_quality(const std::string& location,
+                                                        const CancelFlag* cancel = nullptr);
+    // use_cache=false as for get_ip_lookup: --monitor-alerts must see the feed as it is now
+    static std::optional<WeatherReport> get_alerts(const std::string& location,
+                                                   const CancelFlag* cancel = nullptr, bool use_cache = true);
+    // use_cache=false skips the memory and disk caches in both directions
+    static std::optional<IpLookup> get_ip_lookup(const std::string& ip, const CancelFlag* cancel = nullptr,
+                                                 bool use_cache = true);
+    static bool export_weather_report(const std::string& location, const std::string& filename,
+                                      const CancelFlag* cancel = nullptr);
+
+private:
+    static std::optional<WeatherReport> fetch_report(const std::string& url, const CancelFlag* cancel,
+                                                     bool use_cache = true);
+};
+
+std::string WeatherService::current_url(const std::string& location) {
+    std::string url;
+    url.reserve(Config::BASE_URL.size() + Config::API_KEY.size() + 3 * location.size() + 40);
+    url += Config::BASE_URL;
+    url += "current.json?key=";
+    url += Config::API_KEY;
+    url += "&q=";
+    Utils::url_encode_to(url, location);
+    url += "&aqi=yes";
+    return url;
+}
+
+std::string WeatherService::forecast_url(const std::string& location, int days) {
+    std::string url;
+    url.reserve(Config::BASE_URL.size() + Config::API_KEY.size() + 3 * location.size() + 60);
+    url += Config::BASE_URL;
+    url += "forecast.json?key=";
+    url += Config::API_KEY;
+    url += "&q=";
+    Utils::url_encode_to(url, location);
+    url += "&days=";
+    url += std::to_string(days);
+    url += "&aqi=yes&alerts=yes";
+    return url;
+}
+
+std::optional<WeatherReport> WeatherService::fetch_report(const std::string& url, const CancelFlag* cancel,
+                                                          bool use_cache) {
+    JsonPtr data = HttpClient::fetch(url, use_cache, 3, cancel);
+    if (!data) return std::nullopt;
+    Metrics::Timer timer(Metrics::DECODE);
+    return WeatherDecoder::decode(*data);
+}
+
+std::optional<WeatherReport> WeatherService::get_current_weather(const std::string& location,
+                                                                 const CancelFlag* cancel) {
+    return fetch_report(current_url(location), cancel);
+}
+
+std::optional<WeatherReport> WeatherService::get_forecast(const std::string& location, int days,
+                                                          const CancelFlag* cancel) {
+    return fetch_report(forecast_url(location, days), cancel);
+}
+
+std::optional<WeatherReport> WeatherService::get_hourly_forecast(const std::string& location,
+                                                                 const CancelFlag* cancel) {
+    return get_forecast(location, 2, cancel); // Get 2 days for 48-hour forecast
+}
+
+std::optional<WeatherReport> WeatherService::get_air_quality(const std::string& location,
+                                                             const CancelFlag* cancel) {
+    return get_current_weather(location, cancel);
+}
+
+std::optional<WeatherReport> WeatherService::get_alerts(const std::string& location, const CancelFlag* cancel,
+                                                        bool use_cache) {
+    std::string url = Config::BASE_URL + "forecast.json?key=" + Config::API_KEY + 
+                     "&q=" + Utils::url_encode(location) + "&alerts=yes";
+    return fetch_report(url, cancel, use_cache);
+}
+
+std::optional<IpLookup> WeatherService::get_ip_lookup(const std::string& ip, const CancelFlag* cancel,
+                                                      bool use_cache) {
+    std::string url = Config::BASE_URL + "ip.json?key=" + Config::API_KEY + "&q=" + ip;
+    JsonPtr data = HttpClient::fetch(url, use_cache, 3, cancel);
+    if (!data) return std::nullopt;
+    return WeatherDecoder::decode_ip(*data);
+}
+
+bool WeatherService::export_weather_report(const std::string& location, const std::string& filename,
+                                           const CancelFlag* cancel) {
+    auto report = get_forecast(location, 7, cancel);
+    if (!report) return false;
+    
+    std::ofstream file(filename);
+    if (!file.is_open()) return false;
+    
+    file << "Weather Report for " << location << '\n';
+    file << "Generated: " << Utils::get_current_time() << '\n';
+    file << "=================================================" << '\n';
+    
+    if (report->current.available) {
+        const auto& current = report->current;
+        file << "\nCURRENT CONDITIONS:" << '\n';
+        file << "Temperature: " << current.temp_c << "°C" << '\n';
+        file << "Condition: " << current.condition_text << '\n';
+        file << "Feels Like: " << current.feelslike_c << "°C" << '\n';
+        file << "Humidity: " << current.humidity << "%" << '\n';
+        file << "Wind: " << current.wind_kph << " km/h " << current.wind_dir << '\n';
+    }
+    
+    if (!report->days.empty()) {
+        file << "\n7-DAY FORECAST:" << '\n';
+        for (const auto& day : report->days) {
+            file << day.date << ": " 
+                 << day.condition_text << " | "
+                 << "High: " << day.maxtemp_c << "°C | "
+                 << "Low: " << day.mintemp_c << "°C" << '\n';
+        }
+    }
+    
+    return true;
+}
+
+// Concurrent batch lookups driven through a single curl multi handle
+class BatchProcessor {
+public:
+    struct Options {
+        std::string input_file;
+        int concurrency = 16;
+        bool ordered = false;
+        int retries = 3;
+    };
+
+    static int run(const Options& options);
+
+private:
+    struct Job {
+        std::string location;
+        std::string url;
+        std::string body;
+        int attempts = 0;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point retry_at;
+        double latency_ms = 0;
+        bool ok = false;
+        bool done = false;
+        bool probe = false;  // in flight as the circuit breaker's half-open probe
+        std::string line;
+    };
+
+    static std::vector<std::string> read_locations(const std::string& path);
+    static void finish_job(Job& job, CURLcode res, long http_code, const std::string& error = "");
+    static double percentile(std::vector<double> samples, double pct);
+};
+
+std::vector<std::string> BatchProcessor::read_locations(const std::string& path) {
+    std::vector<std::string> locations;
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (path != "-") {
+        file.open(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open batch file: " + path);
+        }
+        in = &file;
+    }
+
+    std::string line;
+    while (std::getline(*in, line)) {
+        line = Utils::trim(line);
+        if (line.empty() || line[0] == '#') continue;
+        locations.push_back(line);
+    }
+    return locations;
+}
+
+void BatchProcessor::finish_job(Job& job, CURLcode res, long http_code, const std::string& error) {
+    job.done = true;
+    job.latency_ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - job.started).count();
+
+    std::ostringstream out;
+    out << job.location << '\t';
+
+    if (!error.empty()) {
+        out << "ERROR\t" << error;
+    } else if (res != CURLE_OK) {
+        out << "ERROR\t" << curl_easy_strerror(res);
+    } else {
+        try {
+            WeatherReport report;
+            {
+                Metrics::Timer timer(Metrics::PARSE);
+                report = WeatherSaxDecoder::decode(job.body);
+            }
+            if (!report.error.empty()) {
+                out << "ERROR\t" << report.error;
+            } else if (http_code != 200) {
+                out << "ERROR\tHTTP " << http_code;
+            } else {
+                out << report.location.name << ", " << report.location.country << '\t'
+                    << std::fixed << std::setprecision(1) << report.current.temp_c << '\t'
+                    << report.current.condition_text;
+                job.ok = true;
+            }
+        } catch (const json::exception& e) {
+            out << "ERROR\tJSON parsing error: " << e.what();
+        }
+    }
+
+    out << '\t' << static_cast<long>(job.latency_ms) << "ms\n";
+    job.line = out.str();
+    job.body.clear();
+    job.body.shrink_to_fit();
+}
+
+double BatchProcessor::percentile(std::vector<double> samples, double pct) {
+    if (samples.empty()) return 0;
+    size_t rank = static_cast<size_t>(pct / 100.0 * static_cast<double>(samples.size() - 1) + 0.5);
+    std::nth_element(samples.begin(), samples.begin() + static_cast<std::ptrdiff_t>(rank), samples.end());
+    return samples[rank];
+}
+
+int BatchProcessor::run(const Options& options) {
+    std::vector<Job> jobs;
+    for (auto& location : read_locations(options.input_file)) {
+        Job job;
+        job.url = WeatherService::current_url(location);
+        job.location = std::move(location);
+        jobs.push_back(std::move(job));
+    }
+    if (jobs.empty()) {
+        std::cerr << "No locations to process" << std::endl;
+        return 1;
+    }
+
+    const size_t limit = static_cast<size_t>(std::max(1, options.concurrency));
+    CURLM* multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERROR("Failed to initialize curl multi handle");
+        return 1;
+    }
+    curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>(limit));
+    curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, static_cast<long>(limit));
+
+    // Pooled handles are recycled between jobs so connections stay warm
+    std::vector<ConnectionPool::Lease> leases;
+    std::vector<CURL*> idle_handles;
+    size_t next_job = 0, next_emit = 0, in_flight = 0;
+
+    // Failed attempts wait here for their retry time instead of blocking the loop
+    using Retry = std::pair<std::chrono::steady_clock::time_point, size_t>;
+    std::priority_queue<Retry, std::vector<Retry>, std::greater<Retry>> retries;
+    const std::string host = CircuitBreaker::host_of(Config::BASE_URL);
+
+    auto emit_ready = [&]() {
+        if (options.ordered) {
+            while (next_emit < jobs.size() && jobs[next_emit].done) {
+                std::cout << jobs[next_emit++].line;
+            }
+        }
+    };
+
+    auto complete_job = [&](Job& job, CURLcode res, long http_code, const std::string& error) {
+        finish_job(job, res, http_code, error);
+        if (!job.ok) Metrics::add(Metrics::HTTP_FAILURES);
+        if (!options.ordered) std::cout << job.line;
+        emit_ready();
+    };
+
+    // False only when no handle is available; a job refused by the circuit breaker completes at once
+    auto start_job = [&](size_t index) {
+        Job& job = jobs[index];
+        if (job.attempts == 0) job.started = std::chrono::steady_clock::now();
+
+        // The handle comes first: a probe the breaker hands out must really be sent
+        CURL* curl;
+        if (!idle_handles.empty()) {
+            curl = idle_handles.back();
+            idle_handles.pop_back();
+        } else {
+            ConnectionPool::Lease lease = ConnectionPool::acquire();
+            if (!lease) return false;
+            curl = lease.get();
+            leases.push_back(std::move(lease));
+        }
+
+        std::chrono::seconds retry_in(0);
+        if (!CircuitBreaker::allow(host, &retry_in, &job.probe)) {
+            idle_handles.push_back(curl);
+            Metrics::add(Metrics::CIRCUIT_REJECTED);
+            complete_job(job, CURLE_COULDNT_CONNECT, 0,
+                         "upstream failing, not retrying for " + std::to_string(retry_in.count()) + "s");
+            return true;
+        }
+        job.body.clear();
+        if (job.attempts++ > 0) Metrics::add(Metrics::HTTP_RETRIES);
+        Metrics::add(Metrics::HTTP_REQUESTS);
+        HttpClient::configure_handle(curl, job.url, &job.body);
+        curl_easy_setopt(curl, CURLOPT_PRIVATE, reinterpret_cast<char*>(index));
+        curl_multi_add_handle(multi, curl);
+        in_flight++;
+        return true;
+    };
+
+    // Due retries go first so a recovering upstream sees them before new work
+    auto fill_slots = [&]() {
+        auto now = std::chrono::steady_clock::now();
+        while (!retries.empty() && retries.top().first <= now && in_flight < limit) {
+            size_t index = retries.top().second;
+            retries.pop();
+            if (!start_job(index)) {
+                retries.push({now, index});
+                return;
+            }
+        }
+        while (next_job < jobs.size() && in_flight < limit && start_job(next_job)) next_job++;
+    };
+
+    auto batch_start = std::chrono::steady_clock::now();
+    fill_slots();
+
+    while (in_flight > 0 || !retries.empty()) {
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        int pending = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &pending)) {
+            if (msg->msg != CURLMSG_DONE) continue;
+
+            CURL* curl = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            char* priv = nullptr;
+            long http_code = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, &priv);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+            auto retry_after = RetryPolicy::retry_after(curl);
+            Metrics::record_transfer(curl);
+            curl_multi_remove_handle(multi, curl);
+            idle_handles.push_back(curl);
+            in_flight--;
+
+            size_t index = reinterpret_cast<size_t>(priv);
+            Job& job = jobs[index];
+            RetryPolicy::Verdict verdict = RetryPolicy::classify(res, http_code);
+            if (RetryPolicy::upstream_fault(res, http_code)) CircuitBreaker::record_failure(host, retry_after);
+            else if (res == CURLE_OK) CircuitBreaker::record_success(host);
+            else if (job.probe) CircuitBreaker::release_probe(host);  // failed locally: no verdict
+            job.probe = false;
+
+            if (verdict == RetryPolicy::Verdict::RETRY && job.attempts < options.retries &&
+                !CircuitBreaker::is_open(host)) {
+                if (auto wait = RetryPolicy::delay(job.attempts, retry_after)) {
+                    LOG_WARNING("Batch request attempt " + std::to_string(job.attempts) + " failed for " +
+                                job.location + " (" + (res != CURLE_OK ? curl_easy_strerror(res) :
+                                "HTTP " + std::to_string(http_code)) + "), retrying in " +
+                                std::to_string(wait->count()) + "ms");
+                    retries.push({std::chrono::steady_clock::now() + *wait, index});
+                    continue;
+                }
+            }
+            complete_job(job, res, http_code, "");
+        }
+        fill_slots();
+
+        long timeout_ms = 1000;
+        if (!retries.empty()) {
+            auto until_due = std::chrono::duration_cast<std::chrono::milliseconds>(
+                retries.top().first - std::chrono::steady_clock::now());
+            timeout_ms = std::clamp<long>(static_cast<long>(until_due.count()), 0, timeout_ms);
+        }
+        if (in_flight > 0 || !retries.empty()) {
+            curl_multi_poll(multi, nullptr, 0, static_cast<int>(timeout_ms), nullptr);
+        }
+    }
+    std::cout << std::flush;
+
+    curl_multi_cleanup(multi);
+    leases.clear();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+    std::vector<double> latencies;
+    size_t succeeded = 0;
+    for (const auto& job : jobs) {
+        latencies.push_back(job.latency_ms);
+        if (job.ok) succeeded++;
+    }
+
+    std::cerr << std::fixed << std::setprecision(1)
+              << "batch: " << jobs.size() << " locations, " << succeeded << " ok, "
+              << (jobs.size() - succeeded) << " failed in " << elapsed << "s ("
+              << static_cast<double>(jobs.size()) / std::max(elapsed, 1e-9) << " req/s), p50 "
+              << percentile(latencies, 50) << "ms, p99 " << percentile(latencies, 99)
+              << "ms, concurrency " << limit << std::endl;
+
+    return succeeded == jobs.size() ? 0 : 1;
+}
+
+// Thin client for a running --serve daemon: one JSON request line out, one
+// JSON response line back over its Unix socket
+class DaemonClient {
+public:
+    using Message = nlohmann::ordered_json;
+
+    // Only the daemon creates the private /tmp directory; a client just checks it
+    static std::string default_socket_path(bool create);
+    static bool connect(const std::string& path);
+    static bool connected() { return fd >= 0; }
+    static void disconnect();
+    // False when the daemon went away or answered something unreadable
+    static bool request(const Message& message, Message& response);
+
+private:
+    static int fd;
+    static std::string received;  // bytes past the last complete response
+
+    static bool send_all(const std::string& data);
+    static bool read_line(std::string& line);
+    static bool peer_is_same_user(int sock);
+    static int timeout_ms();
+};
+
+int DaemonClient::fd = -1;
+std::string DaemonClient::received;
+
+std::string DaemonClient::default_socket_path(bool create) {
+    if (const char* path = std::getenv("WEATHER_CLI_SOCKET")) return path;
+    if (const char* runtime = std::getenv("XDG_RUNTIME_DIR")) return std::string(runtime) + "/weather-cli.sock";
+#ifndef _WIN32
+    // /tmp is shared, so the socket lives in a directory only this user can
+    // enter, and one that somebody else created first is refused
+    std::string dir = "/tmp/weather-cli-" + std::to_string(getuid());
+    if (create && ::mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) return "";
+    struct stat info {};
+    if (::lstat(dir.c_str(), &info) != 0) return "";  // no daemon has been started
+    if (!S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+        LOG_WARNING(dir + " is not a private directory; no daemon socket will be used");
+        return "";
+    }
+    return dir + "/weather-cli.sock";
+#else
+    return "";
+#endif
+}
+
+// The daemon runs its own retries, within about twice the request timeout
+int DaemonClient::timeout_ms() {
+    return std::max(1, Config::TIMEOUT) * 2 * 1000 + 2000;
+}
+
+#ifndef _WIN32
+bool DaemonClient::connect(const std::string& path) {
+    disconnect();
+    sockaddr_un address{};
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) return false;
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) return false;
+    if (::connect(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(sock);
+        return false;
+    }
+    // Replies are printed as weather data, so only trust a daemon of our own
+    if (!peer_is_same_user(sock)) {
+        LOG_WARNING("Ignoring daemon at " + path + ": it runs as another user");
+        ::close(sock);
+        return false;
+    }
+    fd = sock;
+    LOG_DEBUG("Connected to daemon at " + path);
+    return true;
+}
+
+bool DaemonClient::peer_is_same_user(int sock) {
+#ifdef SO_PEERCRED
+    ucred peer{};
+    socklen_t length = sizeof(peer);
+    return ::getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &peer, &length) == 0 && peer.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return ::getpeereid(sock, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+void DaemonClient::disconnect() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    received.clear();
+}
+
+bool DaemonClient::send_all(const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool DaemonClient::read_line(std::string& line) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms());
+    char chunk[16384];
+    size_t newline;
+    while ((newline = received.find('\n')) == std::string::npos) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (remaining.count() <= 0) return false;
+        pollfd readable{fd, POLLIN, 0};
+        int ready = ::poll(&readable, 1, static_cast<int>(remaining.count()));
+        if (ready < 0 && errno == EINTR) continue;
+        if (ready <= 0) return false;
+        ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        received.append(chunk, static_cast<size_t>(n));
+    }
+    line.assign(received, 0, newline);
+    received.erase(0, newline + 1);
+    return true;
+}
+
+bool DaemonClient::request(const Message& message, Message& response) {
+    if (fd < 0) return false;
+    std::string line;
+    if (!send_all(message.dump() + "\n") || !read_line(line)) {
+        LOG_WARNING("Lost connection to the weather daemon");
+        disconnect();
+        return false;
+    }
+    try {
+        response = Message::parse(line);
+    } catch (const json::parse_error& e) {
+        LOG_WARNING("Unreadable daemon response: " + std::string(e.what()));
+        return false;
+    }
+    return response.is_object();
+}
+#else
+bool DaemonClient::connect(const std::string&) { return false; }
+void DaemonClient::disconnect() {}
+bool DaemonClient::send_all(const std::string&) { return false; }
+bool DaemonClient::read_line(std::string&) { return false; }
+bool DaemonClient::request(const Message&, Message&) { return false; }
+#endif
+
+// Machine-readable lookups for scripts: flat records on stdout, no banner,
+// colors, animations or prompts
+class RecordOutput {
+public:
+    enum class Format { JSON, NDJSON, CSV };
+    enum class Query { CURRENT, FORECAST, HOURLY, AQI, ALERTS, IP };
+
+    struct Options {
+        Format format = Format::JSON;
+        Query query = Query::CURRENT;
+        int days = 0;                      // 0 picks the per-query default
+        std::vector<std::string> targets;  // empty reads one target per stdin line
+    };
+
+    using Record = nlohmann::ordered_json;
+
+    static bool parse_format(const std::string& name, Format& format);
+    static bool parse_query(const std::string& name, Query& query);
+    static const char* query_name(Query query);
+    // Uses the daemon when DaemonClient is connected, otherwise looks up locally
+    static int run(Options options);
+    static bool lookup(const Options& options, const std::string& target, std::vector<Record>& records,
+                       std::string& error);
+    // Appends one record in options.format; the first CSV record also writes the header
+    static void write_record(const Options& options, const Record& record, std::string& out, bool& first);
+
+private:
+    static constexpr size_t FLUSH_BYTES = 64 * 1024;
+
+    static bool remote_lookup(const Options& options, const std::string& target, std::vector<Record>& records,
+                              std::string& error);
+    static Record location_record(const std::string& target, const WeatherReport& report);
+    static void append_csv_field(std::string& out, const Record& value);
+    static void flush(std::string& out);
+};
+
+bool RecordOutput::parse_format(const std::string& name, Format& format) {
+    if (name == "json") format = Format::JSON;
+    else if (name == "ndjson") format = Format::NDJSON;
+    else if (name == "csv") format = Format::CSV;
+    else return false;
+    return true;
+}
+
+bool RecordOutput::parse_query(const std::string& name, Query& query) {
+    if (name == "current") query = Query::CURRENT;
+    else if (name == "forecast") query = Query::FORECAST;
+    else if (name == "hourly") query = Query::HOURLY;
+    else if (name == "aqi") query = Query::AQI;
+    else if (name == "alerts") query = Query::ALERTS;
+    else if (name == "ip") query = Query::IP;
+    else return false;
+    return true;
+}
+
+const char* RecordOutput::query_name(Query query) {
+    switch (query) {
+        case Query::CURRENT: return "current";
+        case Query::FORECAST: return "forecast";
+        case Query::HOURLY: return "hourly";
+        case Query::AQI: return "aqi";
+        case Query::ALERTS: return "alerts";
+        case Query::IP: return "ip";
+    }
+    return "current";
+}
+
+RecordOutput::Record RecordOutput::location_record(const std::string& target, const WeatherReport& report) {
+    Record record;
+    record["query"] = target;
+    record["name"] = report.location.name;
+    record["region"] = report.location.region;
+    record["country"] = report.location.country;
+    // Distance to the cached place that answered a coordinate query, null for its own data
+    record["reuse_distance_km"] = report.location.reuse_distance_km >= 0 ? Record(report.location.reuse_distance_km)
+                                                                         : Record(nullptr);
+    return record;
+}
+
+bool RecordOutput::lookup(const Options& options, const std::string& target, std::vector<Record>& records,
+                          std::string& error) {
+    if (options.query == Query::IP) {
+        if (target != "auto" && !Utils::is_valid_ip(target)) {
+            error = "invalid IP address";
+            return false;
+        }
+        auto lookup = WeatherService::get_ip_lookup(target);
+        if (!lookup) {
+            error = "lookup failed";
+            return false;
+        }
+        Record record;
+        record["query"] = target;
+        record["ip"] = lookup->ip;
+        record["type"] = lookup->type;
+        record["city"] = lookup->city;
+        record["region"] = lookup->region;
+        record["country"] = lookup->country_name;
+        record["lat"] = lookup->lat;
+        record["lon"] = lookup->lon;
+        record["tz_id"] = lookup->tz_id;
+        record["localtime"] = lookup->localtime;
+        records.push_back(std::move(record));
+        return true;
+    }
+
+    std::optional<WeatherReport> report;
+    switch (options.query) {
+        case Query::CURRENT:
+        case Query::AQI:
+            report = WeatherService::get_current_weather(target);
+            break;
+        case Query::FORECAST:
+            report = WeatherService::get_forecast(target, options.days > 0 ? options.days : 3);
+            break;
+        case Query::HOURLY:
+            report = WeatherService::get_forecast(target, options.days > 0 ? options.days : 2);
+            break;
+        case Query::ALERTS:
+            report = WeatherService::get_alerts(target);
+            break;
+        case Query::IP:
+            break;
+    }
+    if (!report) {
+        error = "lookup failed";
+        return false;
+    }
+
+    switch (options.query) {
+        case Query::CURRENT: {
+            const auto& current = report->current;
+            Record record = location_record(target, *report);
+            record["localtime"] = report->location.localtime;
+            record["last_updated"] = current.last_updated;
+            record["temp_c"] = current.temp_c;
+            record["feelslike_c"] = current.feelslike_c;
+            record["condition"] = current.condition_text;
+            record["condition_code"] = current.condition_code;
+            record["is_day"] = current.is_day ? 1 : 0;
+            record["humidity"] = current.humidity;
+            record["cloud"] = current.cloud;
+            record["wind_kph"] = current.wind_kph;
+            record["wind_dir"] = current.wind_dir;
+            record["gust_kph"] = current.gust_kph;
+            record["pressure_mb"] = current.pressure_mb;
+            record["precip_mm"] = current.precip_mm;
+            record["vis_km"] = current.vis_km;
+            record["uv"] = current.uv;
+            records.push_back(std::move(record));
+            break;
+        }
+        case Query::AQI: {
+            if (!report->air_quality.available) {
+                error = "air quality data not available";
+                return false;
+            }
+            const auto& aqi = report->air_quality;
+            Record record = location_record(target, *report);
+            record["us_epa_index"] = aqi.us_epa_index;
+            record["gb_defra_index"] = aqi.gb_defra_index;
+            record["co"] = aqi.co;
+            record["no2"] = aqi.no2;
+            record["o3"] = aqi.o3;
+            record["so2"] = aqi.so2;
+            record["pm2_5"] = aqi.pm2_5;
+            record["pm10"] = aqi.pm10;
+            records.push_back(std::move(record));
+            break;
+        }
+        case Query::FORECAST:
+            for (const auto& day : report->days) {
+                Record record = location_record(target, *report);
+                record["date"] = day.date;
+                record["condition"] = day.condition_text;
+                record["condition_code"] = day.condition_code;
+                record["maxtemp_c"] = day.maxtemp_c;
+                record["mintemp_c"] = day.mintemp_c;
+                record["avgtemp_c"] = day.avgtemp_c;
+                record["maxwind_kph"] = day.maxwind_kph;
+                record["totalprecip_mm"] = day.totalprecip_mm;
+                record["avghumidity"] = day.avghumidity;
+                record["chance_of_rain"] = day.daily_chance_of_rain;
+                record["chance_of_snow"] = day.daily_chance_of_snow;
+                record["uv"] = day.uv;
+                record["sunrise"] = day.sunrise;
+                record["sunset"] = day.sunset;
+                record["moon_phase"] = day.moon_phase;
+                records.push_back(std::move(record));
+            }
+            break;
+        case Query::HOURLY:
+            for (const auto& hour : report->hours) {
+                Record record = location_record(target, *report);
+                record["time"] = hour.time;
+                record["time_epoch"] = hour.time_epoch;
+                record["temp_c"] = hour.temp_c;
+                record["feelslike_c"] = hour.feelslike_c;
+                record["condition"] = hour.condition_text;
+                record["condition_code"] = hour.condition_code;
+                record["wind_kph"] = hour.wind_kph;
+                record["precip_mm"] = hour.precip_mm;
+                record["humidity"] = hour.humidity;
+                record["chance_of_rain"] = hour.chance_of_rain;
+                record["chance_of_snow"] = hour.chance_of_snow;
+                records.push_back(std::move(record));
+            }
+            break;
+        case Query::ALERTS:
+            for (const auto& alert : report->alerts) {
+                Record record = location_record(target, *report);
+                record["headline"] = alert.headline;
+                record["severity"] = alert.severity;
+                record["urgency"] = alert.urgency;
+                record["areas"] = alert.areas;
+                record["category"] = alert.category;
+                record["event"] = alert.event;
+                record["effective"] = alert.effective;
+                record["expires"] = alert.expires;
+                record["desc"] = alert.desc;
+                record["instruction"] = alert.instruction;
+                records.push_back(std::move(record));
+            }
+            break;
+        case Query::IP:
+            break;
+    }
+    return true;
+}
+
+bool RecordOutput::remote_lookup(const Options& options, const std::string& target, std::vector<Record>& records,
+                                 std::string& error) {
+    DaemonClient::Message request;
+    request["query"] = query_name(options.query);
+    request["target"] = target;
+    if (options.days > 0) request["days"] = options.days;
+
+    DaemonClient::Message response;
+    if (!DaemonClient::request(request, response)) {
+        error = "weather daemon unavailable";
+        return false;
+    }
+    if (!response.value("ok", false)) {
+        error = response.value("error", std::string("lookup failed"));
+        return false;
+    }
+    auto found = response.find("records");
+    if (found == response.end() || !found->is_array()) {
+        error = "malformed daemon response";
+        return false;
+    }
+    for (auto& record : *found) records.push_back(std::move(record));
+    return true;
+}
+
+void RecordOutput::append_csv_field(std::string& out, const Record& value) {
+    if (value.is_null()) return;  // an empty field
+    if (!value.is_string()) {
+        out += value.dump();
+        return;
+    }
+    const auto& text = value.get_ref<const std::string&>();
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        out += text;
+        return;
+    }
+    out += '"';
+    for (char c : text) {
+        if (c == '"') out += '"';
+        out += c;
+    }
+    out += '"';
+}
+
+void RecordOutput::write_record(const Options& options, const Record& record, std::string& out, bool& first) {
+    switch (options.format) {
+        case Format::JSON:
+            out += first ? "[" : ",";
+            out += record.dump();
+            break;
+        case Format::NDJSON:
+            out += record.dump();
+            out += '\n';
+            break;
+        case Format::CSV: {
+            // Every record of a query has the same columns, so the first one names them
+            if (first) {
+                bool separator = false;
+                for (const auto& column : record.items()) {
+                    if (separator) out += ',';
+                    out += column.key();
+                    separator = true;
+                }
+                out += '\n';
+            }
+            bool separator = false;
+            for (const auto& column : record.items()) {
+                if (separator) out += ',';
+                append_csv_field(out, column.value());
+                separator = true;
+            }
+            out += '\n';
+            break;
+        }
+    }
+    first = false;
+}
+
+void RecordOutput::flush(std::string& out) {
+    if (out.empty()) return;
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    out.clear();
+}
+
+int RecordOutput::run(Options options) {
+    if (options.targets.empty()) {
+        std::string line;
+        while (std::getline(std::cin, line)) {
+            line = Utils::trim(line);
+            if (!line.empty() && line[0] != '#') options.targets.push_back(line);
+        }
+    }
+    if (options.targets.empty()) {
+        std::cerr << "No location given" << std::endl;
+        return 2;
+    }
+
+    std::string out;
+    out.reserve(FLUSH_BYTES);
+    bool first = true;
+    int failures = 0;
+    std::vector<Record> records;
+
+    for (const auto& target : options.targets) {
+        records.clear();
+        std::string error;
+        bool found = DaemonClient::connected() ? remote_lookup(options, target, records, error)
+                                               : lookup(options, target, records, error);
+        if (!found) {
+            ++failures;
+            std::cerr << target << ": " << error << std::endl;
+            // CSV rows cannot carry an error column, so failures only go to stderr
+            if (options.format != Format::CSV) {
+                Record record;
+                record["query"] = target;
+                record["error"] = error;
+                write_record(options, record, out, first);
+            }
+            continue;
+        }
+        Metrics::Timer timer(Metrics::RENDER);
+        for (const auto& record : records) {
+            write_record(options, record, out, first);
+        }
+        if (out.size() >= FLUSH_BYTES) flush(out);
+    }
+
+    if (options.format == Format::JSON) out += first ? "[]\n" : "]\n";
+    flush(out);
+    std::fflush(stdout);
+    return failures == 0 ? 0 : 1;
+}
+
+// --ip-batch: enriches address lists such as access logs. Input is streamed and
+// the first field of each line is taken as the address; every distinct address,
+// or /24 and /48 network with --collapse, is looked up once by a pool of workers
+// and written as one NDJSON record when it completes. --with-weather joins
+// current conditions, fetched once per resolved city.
+class IpBatchProcessor {
+public:
+    struct Options {
+        std::string input_file;  // "-" reads stdin
+        int concurrency = 16;
+        int ipv4_prefix = 32;
+        int ipv6_prefix = 128;
+        bool with_weather = false;
+    };
+
+    static int run(const Options& options);
+    // Deduplication key (address bytes masked to the prefix) and the network it
+    // names; false when ip is not an address
+    static bool network_key(std::string_view ip, const Options& options, std::string& key, std::string& network);
+
+private:
+    static constexpr size_t FLUSH_BYTES = 64 * 1024;
+    static constexpr size_t QUEUE_PER_WORKER = 4;
+
+    struct Lookup {
+        std::string ip;       // first address seen in the network
+        std::string network;  // CIDR when collapsing, otherwise the address
+    };
+
+    struct City {
+        bool done = false;
+        RecordOutput::Record weather;                // null when the lookup failed
+        std::vector<RecordOutput::Record> waiting;   // resolved while the weather was in flight
+    };
+
+    struct State {
+        const Options* options = nullptr;
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable space_ready;
+        std::deque<Lookup> work;
+        bool input_done = false;
+        std::unordered_map<std::string, City> cities;
+        std::string out;
+        size_t resolved = 0;
+        size_t failed = 0;
+        size_t weather_lookups = 0;
+    };
+
+    static void worker(State& state);
+    static void resolve(State& state, const Lookup& lookup);
+    static RecordOutput::Record weather_record(const WeatherReport& report);
+    static void emit(State& state, const RecordOutput::Record& record);
+    static std::string format_network(const unsigned char* bytes, size_t length, int prefix);
+};
+
+bool IpBatchProcessor::network_key(std::string_view ip, const Options& options, std::string& key,
+                                   std::string& network) {
+    unsigned char bytes[16];
+    size_t length = Utils::parse_ip(ip, bytes);
+    if (length == 0) return false;
+
+    int prefix = std::clamp(length == 4 ? options.ipv4_prefix : options.ipv6_prefix, 0, static_cast<int>(length * 8));
+    for (size_t i = 0; i < length; ++i) {
+        int keep = std::clamp(prefix - static_cast<int>(i * 8), 0, 8);
+        bytes[i] &= static_cast<unsigned char>(0xff00 >> keep);
+    }
+    key.assign(reinterpret_cast<const char*>(bytes), length);
+    if (prefix == static_cast<int>(length * 8)) network.assign(ip);
+    else network = format_network(bytes, length, prefix);
+    return true;
+}
+
+std::string IpBatchProcessor::format_network(const unsigned char* bytes, size_t length, int prefix) {
+    std::string text;
+    if (length == 4) {
+        for (size_t i = 0; i < 4; ++i) {
+            if (i > 0) text += '.';
+            text += std::to_string(bytes[i]);
+        }
+    } else {
+        // RFC 5952: lowercase hex, the longest run of two or more zero groups becomes "::"
+        uint16_t words[8];
+        for (int i = 0; i < 8; ++i) words[i] = static_cast<uint16_t>(bytes[2 * i] << 8 | bytes[2 * i + 1]);
+        int best = -1, best_length = 1;
+        for (int i = 0; i < 8;) {
+            int j = i;
+            while (j < 8 && words[j] == 0) ++j;
+            if (j - i > best_length) {
+                best = i;
+                best_length = j - i;
+            }
+            i = j > i ? j : i + 1;
+        }
+        char group[8];
+        for (int i = 0; i < 8; ++i) {
+            if (i == best) {
+                text += "::";
+                i += best_length - 1;
+                continue;
+            }
+            if (!text.empty() && text.back() != ':') text += ':';
+            std::snprintf(group, sizeof(group), "%x", words[i]);
+            text += group;
+        }
+    }
+    text += '/';
+    text += std::to_string(prefix);
+    return text;
+}
+
+RecordOutput::Record IpBatchProcessor::weather_record(const WeatherReport& report) {
+    const auto& current = report.current;
+    RecordOutput::Record weather;
+    weather["last_updated"] = current.last_updated;
+    weather["temp_c"] = current.temp_c;
+    weather["feelslike_c"] = current.feelslike_c;
+    weather["condition"] = current.condition_text;
+    weather["condition_code"] = current.condition_code;
+    weather["is_day"] = current.is_day ? 1 : 0;
+    weather["humidity"] = current.humidity;
+    weather["wind_kph"] = current.wind_kph;
+    weather["precip_mm"] = current.precip_mm;
+    if (report.location.reuse_distance_km >= 0) weather["reuse_distance_km"] = report.location.reuse_distance_km;
+    return weather;
+}
+
+// Must be called with state.mutex held
+void IpBatchProcessor::emit(State& state, const RecordOutput::Record& record) {
+    state.out += record.dump();
+    state.out += '\n';
+    if (state.out.size() >= FLUSH_BYTES) {
+        std::fwrite(state.out.data(), 1, state.out.size(), stdout);
+        state.out.clear();
+    }
+}
+
+void IpBatchProcessor::resolve(State& state, const Lookup& lookup) {
+    RecordOutput::Record record;
+    record["network"] = lookup.network;
+    record["ip"] = lookup.ip;
+
+    // Addresses in a log rarely repeat across runs, and the dedup set already covers
+    // this one: caching each would only fill the disk and evict useful entries
+    auto result = WeatherService::get_ip_lookup(lookup.ip, nullptr, false);
+    if (!result) {
+        record["error"] = "lookup failed";
+        std::lock_guard<std::mutex> lock(state.mutex);
+        ++state.failed;
+        emit(state, record);
+        return;
+    }
+    record["type"] = result->type;
+    record["city"] = result->city;
+    record["region"] = result->region;
+    record["country"] = result->country_name;
+    record["lat"] = result->lat;
+    record["lon"] = result->lon;
+    record["tz_id"] = result->tz_id;
+
+    const std::string city_key = result->city + '\n' + result->region + '\n' + result->country_name;
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        ++state.resolved;
+        if (!state.options->with_weather || result->city.empty()) {
+            emit(state, record);
+            return;
+        }
+        // Only the first address of a city fetches its weather; later ones reuse or wait for it
+        auto [it, inserted] = state.cities.try_emplace(city_key);
+        if (!inserted) {
+            if (it->second.done) {
+                record["weather"] = it->second.weather;
+                emit(state, record);
+            } else {
+                it->second.waiting.push_back(std::move(record));
+            }
+            return;
+        }
+    }
+
+    auto report = WeatherService::get_current_weather(std::to_string(result->lat) + "," + std::to_string(result->lon));
+    RecordOutput::Record weather = report && report->current.available ? weather_record(*report) : RecordOutput::Record();
+
+    std::lock_guard<std::mutex> lock(state.mutex);
+    ++state.weather_lookups;
+    City& city = state.cities[city_key];
+    city.done = true;
+    city.weather = weather;
+    record["weather"] = weather;
+    emit(state, record);
+    for (auto& waiting : city.waiting) {
+        waiting["weather"] = weather;
+        emit(state, waiting);
+    }
+    std::vector<RecordOutput::Record>().swap(city.waiting);
+}
+
+void IpBatchProcessor::worker(State& state) {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true) {
+        state.work_ready.wait(lock, [&state] { return state.input_done || !state.work.empty(); });
+        if (state.work.empty()) return;
+        Lookup lookup = std::move(state.work.front());
+        state.work.pop_front();
+        state.space_ready.notify_one();
+        lock.unlock();
+
+        resolve(state, lookup);
+
+        lock.lock();
+    }
+}
+
+int IpBatchProcessor::run(const Options& options) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (options.input_file != "-") {
+        file.open(options.input_file);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open IP batch file: " + options.input_file);
+        }
+        in = &file;
+    }
+
+    State state;
+    state.options = &options;
+    state.out.reserve(FLUSH_BYTES);
+    const size_t workers = static_cast<size_t>(std::max(1, options.concurrency));
+    const size_t queue_limit = workers * QUEUE_PER_WORKER;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; ++i) threads.emplace_back(worker, std::ref(state));
+
+    // Only keys are kept per distinct network, so memory tracks unique inputs rather than lines
+    std::unordered_set<std::string> seen;
+    size_t lines = 0, invalid = 0;
+    std::string line, key, network;
+    auto batch_start = std::chrono::steady_clock::now();
+    while (std::getline(*in, line)) {
+        std::string_view text = Utils::trim_view(line);
+        if (text.empty() || text[0] == '#') continue;
+        ++lines;
+        std::string_view ip = text.substr(0, text.find_first_of(" \t,"));
+        if (!network_key(ip, options, key, network)) {
+            ++invalid;
+            continue;
+        }
+        if (!seen.insert(key).second) continue;
+
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.space_ready.wait(lock, [&] { return state.work.size() < queue_limit; });
+        state.work.push_back({std::string(ip), network});
+        state.work_ready.notify_one();
+    }
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.input_done = true;
+    }
+    state.work_ready.notify_all();
+    for (auto& thread : threads) thread.join();
+
+    std::fwrite(state.out.data(), 1, state.out.size(), stdout);
+    std::fflush(stdout);
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - batch_start).count();
+    size_t unique = seen.size();
+    std::cerr << std::fixed << std::setprecision(1)
+              << "ip-batch: " << lines << " lines, " << unique << " unique "
+              << (options.ipv4_prefix < 32 || options.ipv6_prefix < 128 ? "networks" : "addresses")
+              << " (" << (lines > 0 ? 100.0 * static_cast<double>(lines - invalid - unique) / static_cast<double>(lines) : 0.0)
+              << "% deduplicated), " << state.resolved << " resolved, " << state.failed << " failed, "
+              << invalid << " invalid";
+    if (options.with_weather) std::cerr << ", " << state.weather_lookups << " weather lookups";
+    std::cerr << " in " << elapsed << "s (" << static_cast<double>(lines) / std::max(elapsed, 1e-9)
+              << " lines/s), concurrency " << workers << std::endl;
+
+    return state.failed == 0 ? 0 : 1;
+}
+
+// Hashed timing wheel: each timer sits in the slot of its expiry tick with the
+// number of whole revolutions still to go, so scheduling and expiring are O(1)
+// per timer however many are pending.
+class TimerWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TimerWheel(Clock::duration tick_length, size_t slot_count, Clock::time_point origin);
+    // Fires `id` once, `delay` after the last tick advanced to (at least one tick)
+    void schedule(size_t id, Clock::duration delay);
+    // Moves up to now, appending the ids of every expired timer
+    void advance(Clock::time_point now, std::vector<size_t>& expired);
+    Clock::time_point next_tick() const { return start + tick * static_cast<Clock::rep>(current + 1); }
+    size_t pending() const { return count; }
+
+private:
+    struct Timer {
+        size_t id;
+        uint64_t rounds;
+    };
+
+    Clock::duration tick;
+    Clock::time_point start;
+    uint64_t current = 0;  // ticks advanced since start
+    size_t count = 0;
+    std::vector<std::vector<Timer>> slots;
+};
+
+TimerWheel::TimerWheel(Clock::duration tick_length, size_t slot_count, Clock::time_point origin)
+    : tick(tick_length), start(origin), slots(std::max<size_t>(1, slot_count)) {}
+
+void TimerWheel::schedule(size_t id, Clock::duration delay) {
+    uint64_t ticks = static_cast<uint64_t>(std::max<Clock::rep>(1, (delay + tick - Clock::duration(1)) / tick));
+    uint64_t target = current + ticks;
+    slots[target % slots.size()].push_back({id, (ticks - 1) / slots.size()});
+    ++count;
+}
+
+void TimerWheel::advance(Clock::time_point now, std::vector<size_t>& expired) {
+    while (next_tick() <= now) {
+        auto& slot = slots[++current % slots.size()];
+        for (size_t i = 0; i < slot.size();) {
+            if (slot[i].rounds > 0) {
+                --slot[i].rounds;
+                ++i;
+                continue;
+            }
+            expired.push_back(slot[i].id);
+            slot[i] = slot.back();
+            slot.pop_back();
+            --count;
+        }
+    }
+}
+
+// --watch: keeps a list of locations current until interrupted. A timer wheel
+// spreads the refreshes evenly over --interval instead of sending them in
+// bursts, a small worker pool fetches them through the shared cache, and only
+// what changed is written: single cells of a live table on a terminal, or JSON
+// merge patches (RFC 7386) as NDJSON otherwise.
+//
+//   {"query":"London","time":"2025-10-17 11:00:05","changes":{"temp_c":13.4}}
+class WeatherWatch {
+public:
+    struct Options {
+        std::string input_file;  // "-" reads stdin
+        int interval_seconds = 300;
+        int concurrency = 4;
+        bool ndjson = false;  // patches instead of the live table
+    };
+
+    static int run(Options options);
+    // Fields of current that differ from previous; fields it lost become null
+    static RecordOutput::Record diff(const RecordOutput::Record& previous, const RecordOutput::Record& current);
+
+private:
+    static constexpr auto TICK = std::chrono::milliseconds(100);
+    static constexpr size_t WHEEL_SLOTS = 1024;
+    static constexpr size_t FLUSH_BYTES = 64 * 1024;
+    static constexpr int HEADER_LINES = 5;
+    static constexpr size_t COLUMN_COUNT = 7;
+    static constexpr int COLUMN_WIDTHS[COLUMN_COUNT] = {22, 8, 8, 24, 12, 5, 8};
+
+    struct Site {
+        std::string location;
+        RecordOutput::Record record;  // last published state, null before the first refresh
+        std::vector<std::string> cells;  // table cells as drawn, with their colors
+        bool in_flight = false;
+    };
+
+    struct Result {
+        size_t site;
+        RecordOutput::Record record;
+        std::string error;
+    };
+
+    struct State {
+        std::mutex mutex;
+        std::condition_variable work_ready;
+        std::condition_variable results_ready;
+        std::deque<size_t> work;
+        std::vector<Result> results;
+        bool stopping = false;
+    };
+
+    struct Counters {
+        size_t refreshes = 0;
+        size_t changes = 0;
+        size_t failures = 0;
+        size_t skipped = 0;  // still in flight when due again
+    };
+
+    static volatile std::sig_atomic_t stop_requested;
+    static volatile std::sig_atomic_t resized;
+    static void on_signal(int) { stop_requested = 1; }
+    static void on_resize(int) { resized = 1; }
+
+    static void worker(State& state, const std::vector<Site>& sites);
+    // Applies a refresh; false when nothing changed
+    static bool publish(const Options& options, Site& site, Result& result, Counters& counters, std::string& out);
+    static std::vector<std::string> table_cells(const Site& site);
+    static std::string fit(std::string_view text, int width);
+    static int visible_rows(size_t sites);
+    // Redraws everything; returns the number of table rows that fit
+    static int draw_screen(const Options& options, std::vector<Site>& sites);
+    static void draw_cells(Site& site, size_t row, bool force);
+    static std::string status_line(const Counters& counters, size_t in_flight);
+};
+
+volatile std::sig_atomic_t WeatherWatch::stop_requested = 0;
+volatile std::sig_atomic_t WeatherWatch::resized = 0;
+
+RecordOutput::Record WeatherWatch::diff(const RecordOutput::Record& previous, const RecordOutput::Record& current) {
+    RecordOutput::Record changes = RecordOutput::Record::object();
+    for (const auto& field : current.items()) {
+        auto old = previous.is_object() ? previous.find(field.key()) : previous.end();
+        if (!previous.is_object() || old == previous.end() || *old != field.value()) {
+            changes[field.key()] = field.value();
+        }
+    }
+    if (previous.is_object()) {
+        for (const auto& field : previous.items()) {
+            if (!current.contains(field.key())) changes[field.key()] = nullptr;
+        }
+    }
+    return changes;
+}
+
+void WeatherWatch::worker(State& state, const std::vector<Site>& sites) {
+    RecordOutput::Options current;
+    current.query = RecordOutput::Query::CURRENT;
+    std::vector<RecordOutput::Record> records;
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    while (true) {
+        state.work_ready.wait(lock, [&state] { return state.stopping || !state.work.empty(); });
+        if (state.stopping) return;
+        size_t index = state.work.front();
+        state.work.pop_front();
+        lock.unlock();
+
+        // Only the main thread writes sites, and never location, so this read needs no lock
+        Result result{index, RecordOutput::Record(), std::string()};
+        records.clear();
+        if (RecordOutput::lookup(current, sites[index].location, records, result.error) && !records.empty()) {
+            result.record = std::move(records.front());
+            // Identity and the local clock change nothing worth reporting
+            result.record.erase("query");
+            result.record.erase("localtime");
+        } else if (result.error.empty()) {
+            result.error = "lookup failed";
+        }
+
+        lock.lock();
+        state.results.push_back(std::move(result));
+        state.results_ready.notify_one();
+    }
+}
+
+bool WeatherWatch::publish(const Options& options, Site& site, Result& result, Counters& counters,
+                           std::string& out) {
+    ++counters.refreshes;
+    // A failure keeps the last known values and flags them until the next success
+    RecordOutput::Record next = std::move(result.record);
+    if (!result.error.empty()) {
+        ++counters.failures;
+        next = site.record.is_object() ? site.record : RecordOutput::Record::object();
+        next["error"] = result.error;
+    }
+    RecordOutput::Record changes = diff(site.record, next);
+    if (changes.empty()) return false;
+    ++counters.changes;
+    site.record = std::move(next);
+
+    if (options.ndjson) {
+        RecordOutput::Record line;
+        line["query"] = site.location;
+        line["time"] = Utils::get_current_time();
+        line["changes"] = std::move(changes);
+        out += line.dump();
+        out += '\n';
+    }
+    return true;
+}
+
+std::string WeatherWatch::fit(std::string_view text, int width) {
+    // Widths count code points so names such as "São Paulo" stay aligned
+    std::string cell;
+    int used = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        bool lead = (static_cast<unsigned char>(text[i]) & 0xC0) != 0x80;
+        if (lead && used == width - 1) break;  // one column always separates cells
+        if (lead) ++used;
+        cell += text[i];
+    }
+    cell.append(static_cast<size_t>(std::max(0, width - used)), ' ');
+    return cell;
+}
+
+std::vector<std::string> WeatherWatch::table_cells(const Site& site) {
+    std::vector<std::string> cells(COLUMN_COUNT);
+    const auto& record = site.record;
+    cells[0] = std::string(Colors::CYAN) + fit(site.location, COLUMN_WIDTHS[0]);
+    if (!record.is_object() || !record.contains("temp_c")) {
+        std::string waiting = record.contains("error") ? record["error"].get<std::string>() : "waiting...";
+        cells[3] = std::string(record.contains("error") ? Colors::RED : Colors::GRAY) + fit(waiting, COLUMN_WIDTHS[3]);
+        for (size_t i = 1; i < COLUMN_COUNT; ++i) {
+            if (i != 3) cells[i] = fit("", COLUMN_WIDTHS[i]);
+        }
+        return cells;
+    }
+
+    auto number = [&record](const char* field) { return record.value(field, 0.0); };
+    auto fixed = [](double value, const char* suffix) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.1f%s", value, suffix);
+        return std::string(buffer);
+    };
+    double temp = number("temp_c");
+    std::string condition = record.value("condition", std::string());
+    std::string updated = record.value("last_updated", std::string());
+    if (updated.size() >= 16) updated = updated.substr(11, 5);
+    bool failed = record.contains("error");
+
+    cells[1] = std::string(Utils::get_temperature_color(temp)) + fit(fixed(temp, "°"), COLUMN_WIDTHS[1]);
+    cells[2] = std::string(Colors::GRAY) + fit(fixed(number("feelslike_c"), "°"), COLUMN_WIDTHS[2]);
+    cells[3] = std::string(Utils::get_condition_color(record.value("condition_code", 0), condition)) +
+               fit(condition, COLUMN_WIDTHS[3]);
+    cells[4] = std::string(Colors::GRAY) +
+               fit(fixed(number("wind_kph"), " ") + record.value("wind_dir", std::string()), COLUMN_WIDTHS[4]);
+    cells[5] = std::string(Colors::BLUE) + fit(std::to_string(record.value("humidity", 0)) + "%", COLUMN_WIDTHS[5]);
+    // A failed refresh leaves the old values up, marked by a red timestamp
+    cells[6] = std::string(failed ? Colors::RED : Colors::DIM) + fit(updated + (failed ? "!" : ""), COLUMN_WIDTHS[6]);
+    return cells;
+}
+
+int WeatherWatch::visible_rows(size_t sites) {
+    int height = 24;
+#ifndef _WIN32
+    winsize size{};
+    if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_row > 0) height = size.ws_row;
+#endif
+    int rows = std::max(1, height - HEADER_LINES - 1);  // the last line notes any rows cut off
+    return static_cast<int>(std::min<size_t>(sites, static_cast<size_t>(rows)));
+}
+
+// Draws the changed cells of one row; force redraws all of them
+void WeatherWatch::draw_cells(Site& site, size_t row, bool force) {
+    std::vector<std::string> cells = table_cells(site);
+    if (site.cells.size() != cells.size()) {
+        site.cells.assign(cells.size(), std::string());
+        force = true;
+    }
+    int column = 1;
+    for (size_t i = 0; i < cells.size(); ++i) {
+        if (force || cells[i] != site.cells[i]) {
+            std::cout << "\033[" << HEADER_LINES + 1 + static_cast<int>(row) << ';' << column << 'H' << cells[i]
+                      << Colors::RESET;
+            site.cells[i] = std::move(cells[i]);
+        }
+        column += COLUMN_WIDTHS[i];
+    }
+}
+
+int WeatherWatch::draw_screen(const Options& options, std::vector<Site>& sites) {
+    static const char* const headings[COLUMN_COUNT] = {"Location", "Temp", "Feels", "Condition", "Wind kph",
+                                                       "Hum", "Updated"};
+    int width = 0;
+    for (int column : COLUMN_WIDTHS) width += column;
+
+    Display::clear_screen();
+    std::cout << Colors::BOLD << Colors::CYAN << "Watching " << sites.size() << " locations every "
+              << options.interval_seconds << "s" << Colors::RESET << Colors::GRAY << "  (Ctrl-C to stop)"
+              << Colors::RESET << "\n\n\n"
+              << Colors::BOLD;
+    for (size_t i = 0; i < COLUMN_COUNT; ++i) std::cout << fit(headings[i], COLUMN_WIDTHS[i]);
+    std::cout << Colors::RESET << "\n" << Display::horizontal_rule(static_cast<size_t>(width)) << "\n";
+
+    int rows = visible_rows(sites.size());
+    for (int row = 0; row < rows; ++row) draw_cells(sites[static_cast<size_t>(row)], static_cast<size_t>(row), true);
+    if (static_cast<size_t>(rows) < sites.size()) {
+        std::cout << "\033[" << HEADER_LINES + 1 + rows << ";1H" << Colors::GRAY << "... "
+                  << sites.size() - static_cast<size_t>(rows)
+                  << " more not shown (--format ndjson streams every location)" << Colors::RESET;
+    }
+    return rows;
+}
+
+std::string WeatherWatch::status_line(const Counters& counters, size_t in_flight) {
+    std::ostringstream line;
+    line << counters.refreshes << " refreshes, " << counters.changes << " changed, " << counters.failures
+         << " failed, " << in_flight << " in flight";
+    if (counters.skipped > 0) line << ", " << counters.skipped << " skipped";
+    return line.str();
+}
+
+int WeatherWatch::run(Options options) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (options.input_file != "-") {
+        file.open(options.input_file);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open watch file: " + options.input_file);
+        }
+        in = &file;
+    }
+    std::vector<Site> sites;
+    std::unordered_set<std::string> seen;
+    std::string line;
+    while (std::getline(*in, line)) {
+        line = Utils::trim(line);
+        if (line.empty() || line[0] == '#' || !seen.insert(line).second) continue;
+        sites.push_back({line, RecordOutput::Record(), {}, false});
+    }
+    if (sites.empty()) {
+        std::cerr << "No locations to watch" << std::endl;
+        return 2;
+    }
+#ifndef _WIN32
+    // Cursor addressing only makes sense on a terminal; pipes get patches
+    if (!::isatty(STDOUT_FILENO)) options.ndjson = true;
+#endif
+    options.interval_seconds = std::max(1, options.interval_seconds);
+    const auto interval = std::chrono::duration_cast<TimerWheel::Clock::duration>(
+        std::chrono::seconds(options.interval_seconds));
+
+    State state;
+    const size_t workers = static_cast<size_t>(std::clamp(options.concurrency, 1, static_cast<int>(sites.size())));
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; ++i) threads.emplace_back(worker, std::ref(state), std::cref(sites));
+
+    // Location i first comes due i/n of the way into the interval, and every interval after
+    auto start = TimerWheel::Clock::now();
+    TimerWheel wheel(TICK, WHEEL_SLOTS, start);
+    for (size_t i = 0; i < sites.size(); ++i) {
+        wheel.schedule(i, interval * static_cast<TimerWheel::Clock::rep>(i) /
+                              static_cast<TimerWheel::Clock::rep>(sites.size()));
+    }
+
+    stop_requested = 0;
+    resized = 0;
+    auto previous_int = std::signal(SIGINT, on_signal);
+    auto previous_term = std::signal(SIGTERM, on_signal);
+#ifdef SIGWINCH
+    auto previous_winch = std::signal(SIGWINCH, on_resize);
+#endif
+
+    int rows = 0;
+    if (!options.ndjson) {
+        Frame::install();
+        std::cout << "\033[?25l";  // hide the cursor while cells are rewritten in place
+        rows = draw_screen(options, sites);
+        Frame::present();
+    }
+
+    Counters counters;
+    size_t in_flight = 0;
+    std::string out, status;
+    std::vector<size_t> due;
+    std::vector<Result> results;
+    while (!stop_requested) {
+        due.clear();
+        wheel.advance(TimerWheel::Clock::now(), due);
+        if (!due.empty()) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            for (size_t index : due) {
+                wheel.schedule(index, interval);
+                if (sites[index].in_flight) {
+                    ++counters.skipped;
+                    continue;
+                }
+                sites[index].in_flight = true;
+                ++in_flight;
+                state.work.push_back(index);
+            }
+            state.work_ready.notify_all();
+        }
+
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            state.results_ready.wait_until(lock, wheel.next_tick(), [&state] { return !state.results.empty(); });
+            results.swap(state.results);
+        }
+        for (auto& result : results) {
+            sites[result.site].in_flight = false;
+            --in_flight;
+            bool changed = publish(options, sites[result.site], result, counters, out);
+            if (changed && !options.ndjson && result.site < static_cast<size_t>(rows)) {
+                draw_cells(sites[result.site], result.site, false);
+            }
+        }
+        results.clear();
+
+        if (options.ndjson) {
+            if (!out.empty()) {
+                std::fwrite(out.data(), 1, out.size(), stdout);
+                std::fflush(stdout);
+                out.clear();
+            }
+            continue;
+        }
+        if (resized) {
+            resized = 0;
+            rows = draw_screen(options, sites);
+            status.clear();
+        }
+        std::string next_status = status_line(counters, in_flight);
+        if (next_status != status) {
+            status = std::move(next_status);
+            std::cout << "\033[2;1H\033[K" << Colors::GRAY << status << Colors::RESET;
+        }
+        Frame::present();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.stopping = true;
+    }
+    state.work_ready.notify_all();
+    for (auto& thread : threads) thread.join();
+
+    std::signal(SIGINT, previous_int == SIG_ERR ? SIG_DFL : previous_int);
+    std::signal(SIGTERM, previous_term == SIG_ERR ? SIG_DFL : previous_term);
+#ifdef SIGWINCH
+    std::signal(SIGWINCH, previous_winch == SIG_ERR ? SIG_DFL : previous_winch);
+#endif
+    if (!options.ndjson) {
+        std::cout << "\033[" << HEADER_LINES + 2 + rows << ";1H\033[?25h";
+        Frame::uninstall();
+    }
+    std::cerr << "watch: " << sites.size() << " locations, " << status_line(counters, in_flight) << std::endl;
+    return 0;
+}
+
+// --monitor-alerts: reports how the weather alerts of a set of locations
+// changed since the previous check. Alerts already seen are remembered per
+// location, keyed by headline, effective and expires time, in alerts.json next
+// to the cache, so each new, updated or expired alert is written once as an
+// NDJSON event instead of every alert on every run.
+//
+//   {"change":"new","query":"London","headline":"...","severity":"Moderate",...}
+class AlertMonitor {
+public:
+    struct Options {
+        std::string input_file;  // "-" reads stdin
+        std::string state_file;  // empty keeps alerts.json in the cache directory
+        int concurrency = 4;
+        int interval_seconds = 0;  // 0 checks once and exits
+    };
+
+    enum class Change { NEW, UPDATED, EXPIRED };
+
+    struct Event {
+        Change change;
+        json alert;  // the remembered fields; an update also carries "previous_expires"
+    };
+
+    static int run(const Options& options);
+    // Updates one location's remembered alerts (a JSON object keyed by alert_key)
+    // to the ones now in effect and appends what changed
+    static void compare(const std::vector<Alert>& alerts, std::time_t now, json& seen, std::vector<Event>& events);
+    static const char* change_name(Change change);
+    // Seconds since the epoch of an ISO 8601 time with offset, 0 when unreadable
+    static std::time_t parse_time(const std::string& text);
+    // The state as last saved, an empty object when missing or unreadable
+    static json load_state(const std::string& path);
+    // Replaces the state file through a temporary file; false when it was not saved
+    static bool save_state(const std::string& path, const json& state);
+
+private:
+    // Event fields in output order
+    static constexpr const char* FIELDS[] = {"headline", "severity", "urgency", "areas", "category", "event",
+                                             "effective", "expires", "previous_expires", "desc", "instruction"};
+
+    static std::string alert_key(const std::string& headline, const std::string& effective,
+                                 const std::string& expires);
+    static json remembered(const Alert& alert);
+    static bool expired(const json& entry, std::time_t now);
+    static std::string state_path(const Options& options);
+    static int check(const Options& options, const std::vector<std::string>& locations);
+
+    static volatile std::sig_atomic_t stop_requested;
+    static void on_signal(int) { stop_requested = 1; }
+};
+
+volatile std::sig_atomic_t AlertMonitor::stop_requested = 0;
+
+const char* AlertMonitor::change_name(Change change) {
+    switch (change) {
+        case Change::NEW: return "new";
+        case Change::UPDATED: return "updated";
+        case Change::EXPIRED: return "expired";
+    }
+    return "new";
+}
+
+std::time_t AlertMonitor::parse_time(const std::string& text) {
+    int year, month, day, hour, minute, second, consumed = 0;
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2dT%2d:%2d:%2d%n", &year, &month, &day, &hour, &minute, &second,
+                    &consumed) != 6) {
+        return 0;
+    }
+    long offset = 0;
+    const char* zone = text.c_str() + consumed;
+    int offset_hours, offset_minutes;
+    if ((zone[0] == '+' || zone[0] == '-') && std::sscanf(zone + 1, "%2d:%2d", &offset_hours, &offset_minutes) == 2) {
+        offset = (zone[0] == '-' ? -1 : 1) * (offset_hours * 3600L + offset_minutes * 60L);
+    }
+    // Days since 1970-01-01 in the proleptic Gregorian calendar, without timegm()
+    int y = year - (month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long year_of_era = y - era * 400;
+    long day_of_year = (153L * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    long days = era * 146097 + day_of_era - 719468;
+    return static_cast<std::time_t>(days * 86400L + hour * 3600L + minute * 60L + second - offset);
+}
+
+std::string AlertMonitor::alert_key(const std::string& headline, const std::string& effective,
+                                    const std::string& expires) {
+    return effective + " " + expires + " " + headline;
+}
+
+json AlertMonitor::remembered(const Alert& alert) {
+    json entry;
+    entry["headline"] = alert.headline;
+    entry["severity"] = alert.severity;
+    entry["urgency"] = alert.urgency;
+    entry["areas"] = alert.areas;
+    entry["category"] = alert.category;
+    entry["event"] = alert.event;
+    entry["effective"] = alert.effective;
+    entry["expires"] = alert.expires;
+    entry["desc"] = alert.desc;
+    entry["instruction"] = alert.instruction;
+    return entry;
+}
+
+bool AlertMonitor::expired(const json& entry, std::time_t now) {
+    std::time_t expires = parse_time(entry.value("expires", std::string()));
+    return expires > 0 && expires <= now;
+}
+
+void AlertMonitor::compare(const std::vector<Alert>& alerts, std::time_t now, json& seen, std::vector<Event>& events) {
+    if (!seen.is_object()) seen = json::object();
+    json current = json::object();
+    for (const auto& alert : alerts) {
+        current[alert_key(alert.headline, alert.effective, alert.expires)] = remembered(alert);
+    }
+
+    for (auto& [key, entry] : current.items()) {
+        auto known = seen.find(key);
+        if (known != seen.end()) {
+            // Same alert; its text or severity may still have been revised
+            bool was_expired = known->value("expired", false);
+            known->erase("expired");
+            if (*known != entry) events.push_back({Change::UPDATED, entry});
+            if (expired(entry, now)) {
+                entry["expired"] = true;
+                if (!was_expired) events.push_back({Change::EXPIRED, entry});
+            }
+            *known = entry;
+            continue;
+        }
+
+        // An alert whose expiry moved keeps its headline and start: an update, not a new alert
+        auto previous = seen.end();
+        for (auto it = seen.begin(); it != seen.end(); ++it) {
+            if (!current.contains(it.key()) && it->value("headline", std::string()) == entry["headline"] &&
+                it->value("effective", std::string()) == entry["effective"]) {
+                previous = it;
+                break;
+            }
+        }
+        if (expired(entry, now)) {
+            // Seen only after its end: announced once if it cuts short a live alert, else not at all
+            entry["expired"] = true;
+            if (previous != seen.end() && !previous->value("expired", false)) {
+                json event = entry;
+                event.erase("expired");
+                events.push_back({Change::EXPIRED, std::move(event)});
+            }
+        } else if (previous != seen.end()) {
+            json event = entry;
+            event["previous_expires"] = previous->value("expires", std::string());
+            events.push_back({Change::UPDATED, std::move(event)});
+        } else {
+            events.push_back({Change::NEW, entry});
+        }
+        if (previous != seen.end()) seen.erase(previous);
+        seen[key] = entry;
+    }
+
+    // Alerts withdrawn from the feed end now, whatever their stated expiry
+    for (auto it = seen.begin(); it != seen.end();) {
+        if (current.contains(it.key())) {
+            ++it;
+            continue;
+        }
+        if (!it->value("expired", false)) {
+            json event = *it;
+            event.erase("expired");
+            events.push_back({Change::EXPIRED, std::move(event)});
+        }
+        it = seen.erase(it);
+    }
+}
+
+std::string AlertMonitor::state_path(const Options& options) {
+    return options.state_file.empty() ? DiskCache::directory() + "/alerts.json" : options.state_file;
+}
+
+json AlertMonitor::load_state(const std::string& path) {
+    json state = json::object();
+    std::ifstream file(path);
+    if (file.is_open()) {
+        try {
+            file >> state;
+        } catch (const json::parse_error&) {
+            LOG_WARNING("Ignoring unreadable alert state " + path);
+            state = json::object();
+        }
+    }
+    if (!state.is_object()) state = json::object();
+    return state;
+}
+
+bool AlertMonitor::save_state(const std::string& path, const json& state) {
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    std::error_code ec;
+    {
+        std::ofstream file(tmp, std::ios::trunc | std::ios::binary);
+        file << state.dump() << '\n';
+        file.flush();
+        if (!file) {
+            std::cerr << "Cannot write alert state to " << tmp << std::endl;
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "Cannot save alert state to " << path << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// One pass: fetch every location in parallel, then diff and persist under a lock
+// so overlapping runs (a slow cron job) never report the same change twice.
+// Lookups bypass the response cache: a cached or stale feed would announce a
+// new alert up to a refresh late and could expire one that is still in effect.
+int AlertMonitor::check(const Options& options, const std::vector<std::string>& locations) {
+    std::vector<std::optional<WeatherReport>> reports(locations.size());
+    std::atomic<size_t> next{0};
+    auto fetch = [&]() {
+        for (size_t i = next++; i < locations.size(); i = next++) {
+            reports[i] = WeatherService::get_alerts(locations[i], nullptr, false);
+        }
+    };
+    std::vector<std::thread> threads;
+    size_t workers = static_cast<size_t>(std::clamp(options.concurrency, 1, static_cast<int>(locations.size())));
+    for (size_t i = 1; i < workers; ++i) threads.emplace_back(fetch);
+    fetch();
+    for (auto& thread : threads) thread.join();
+
+    const std::string path = state_path(options);
+    std::error_code ec;
+    std::filesystem::path parent = std::filesystem::path(path).parent_path();
+    if (!parent.empty()) std::filesystem::create_directories(parent, ec);
+#ifndef _WIN32
+    int lock_fd = open((path + ".lock").c_str(), O_CREAT | O_RDWR, 0644);
+    if (lock_fd >= 0) flock(lock_fd, LOCK_EX);
+#endif
+
+    json state = load_state(path);
+
+    const std::time_t now = std::time(nullptr);
+    std::string out;
+    size_t counts[3] = {0, 0, 0};
+    int failures = 0;
+    std::vector<Event> events;
+    for (size_t i = 0; i < locations.size(); ++i) {
+        if (!reports[i]) {
+            // Remembered alerts stay as they were; a failed lookup must not expire them
+            ++failures;
+            std::cerr << locations[i] << ": lookup failed" << std::endl;
+            continue;
+        }
+        events.clear();
+        compare(reports[i]->alerts, now, state[locations[i]], events);
+        if (state[locations[i]].empty()) state.erase(locations[i]);
+        for (auto& event : events) {
+            ++counts[static_cast<int>(event.change)];
+            RecordOutput::Record record;
+            record["change"] = change_name(event.change);
+            record["query"] = locations[i];
+            for (const char* field : FIELDS) {
+                auto value = event.alert.find(field);
+                if (value != event.alert.end()) record[field] = std::move(*value);
+            }
+            out += record.dump();
+            out += '\n';
+        }
+    }
+    // Events reach the notifier before the state that suppresses them is saved
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+
+    if (!save_state(path, state)) ++failures;
+#ifndef _WIN32
+    if (lock_fd >= 0) {
+        flock(lock_fd, LOCK_UN);
+        close(lock_fd);
+    }
+#endif
+
+    std::cerr << "alerts: " << locations.size() << " locations, " << counts[0] << " new, " << counts[1]
+              << " updated, " << counts[2] << " expired, " << failures << " failed" << std::endl;
+    return failures == 0 ? 0 : 1;
+}
+
+int AlertMonitor::run(const Options& options) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (options.input_file != "-") {
+        file.open(options.input_file);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open alert location file: " + options.input_file);
+        }
+        in = &file;
+    }
+    std::vector<std::string> locations;
+    std::unordered_set<std::string> seen;
+    std::string line;
+    while (std::getline(*in, line)) {
+        line = Utils::trim(line);
+        if (!line.empty() && line[0] != '#' && seen.insert(line).second) locations.push_back(line);
+    }
+    if (locations.empty()) {
+        std::cerr << "No locations to monitor" << std::endl;
+        return 2;
+    }
+    if (options.interval_seconds <= 0) return check(options, locations);
+
+    stop_requested = 0;
+    auto previous_int = std::signal(SIGINT, on_signal);
+    auto previous_term = std::signal(SIGTERM, on_signal);
+    int status = 0;
+    while (!stop_requested) {
+        auto next = std::chrono::steady_clock::now() + std::chrono::seconds(options.interval_seconds);
+        status = check(options, locations);
+        while (!stop_requested && std::chrono::steady_clock::now() < next) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+    std::signal(SIGINT, previous_int == SIG_ERR ? SIG_DFL : previous_int);
+    std::signal(SIGTERM, previous_term == SIG_ERR ? SIG_DFL : previous_term);
+    return status;
+}
+
+// --export: writes the records of many locations to one file for nightly
+// jobs. Lookups and formatting run on --concurrency workers while one writer
+// keeps input order and writes through a 1 MiB buffer. After each flush the
+// writer records how far it got in <output>.progress, so --resume carries on
+// from there after an interruption instead of starting over. Locations whose
+// lookup failed are listed there too; --resume retries them first and appends
+// their rows, and the export is complete only once none is left.
+//
+// Besides csv and ndjson, "columnar" is a compact binary format. It starts
+// with the magic "WXC1" and the column names. Row groups follow, each holding
+// a row count and then one length-prefixed chunk per column. A chunk starts
+// with a type byte (0 null, 1 string, 2 integer, 3 decimal, 4 double) and a
+// null-bitmap flag byte, followed by the bitmap when set. Strings use a
+// dictionary per chunk, integers and thousandths zigzag varints, doubles 8
+// little-endian bytes. tools/read_columnar.py decodes it.
+class BulkExporter {
+public:
+    enum class Format { CSV, NDJSON, COLUMNAR };
+
+    struct Options {
+        std::string input_file;     // "-" reads stdin
+        std::string output_file;    // "-" writes stdout (no resume)
+        Format format = Format::CSV;
+        RecordOutput::Query query = RecordOutput::Query::FORECAST;
+        int days = 7;
+        int concurrency = 16;
+        bool resume = false;
+    };
+
+    static bool parse_format(const std::string& name, Format& format);
+    static int run(const Options& options);
+
+private:
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+    static constexpr size_t ROW_GROUP_ROWS = 16384;
+    static constexpr size_t WINDOW_PER_WORKER = 4;  // results buffered ahead of the writer
+    static constexpr const char* COLUMNAR_MAGIC = "WXC1";
+
+    struct Result {
+        bool ready = false;
+        bool found = false;
+        std::string error;
+        std::vector<RecordOutput::Record> records;
+        std::string text;  // csv or ndjson rows, formatted by the worker
+    };
+
+    struct Progress {
+        size_t locations = 0;    // input locations written, in order
+        uint64_t bytes = 0;      // output size after them
+        uint64_t input_hash = 0; // of those locations, so a different list is not resumed
+        bool complete = false;   // every location written, none failed
+        std::vector<std::string> columns;
+        std::vector<size_t> failed;  // indexes below `locations` whose lookup failed, retried by --resume
+    };
+
+    static const char* format_name(Format format);
+    static uint64_t hash_locations(const std::vector<std::string>& locations, size_t count);
+    static bool load_progress(const std::string& path, const Options& options, Progress& progress);
+    // Throws unless the locations and the output file are the ones the progress describes
+    static void check_resume(const Options& options, const std::vector<std::string>& locations,
+                             const Progress& progress);
+    // False, with the reason on stderr, when the progress could not be saved
+    static bool save_progress(const std::string& path, const Options& options, const Progress& progress);
+
+    static void put_varint(std::string& out, uint64_t value);
+    static uint64_t zigzag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+    static void columnar_header(std::string& out, const std::vector<std::string>& columns);
+    static void columnar_group(std::string& out, const std::vector<std::string>& columns,
+                               const std::vector<RecordOutput::Record>& rows);
+    static void columnar_chunk(std::string& out, const std::string& column,
+                               const std::vector<RecordOutput::Record>& rows);
+};
+
+bool BulkExporter::parse_format(const std::string& name, Format& format) {
+    if (name == "csv") format = Format::CSV;
+    else if (name == "ndjson") format = Format::NDJSON;
+    else if (name == "columnar") format = Format::COLUMNAR;
+    else return false;
+    return true;
+}
+
+const char* BulkExporter::format_name(Format format) {
+    switch (format) {
+        case Format::CSV: return "csv";
+        case Format::NDJSON: return "ndjson";
+        case Format::COLUMNAR: return "columnar";
+    }
+    return "csv";
+}
+
+uint64_t BulkExporter::hash_locations(const std::vector<std::string>& locations, size_t count) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < count && i < locations.size(); ++i) {
+        for (char c : locations[i]) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        hash ^= '\n';
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool BulkExporter::load_progress(const std::string& path, const Options& options, Progress& progress) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    try {
+        json data = json::parse(file);
+        if (data.value("format", std::string()) != format_name(options.format) ||
+            data.value("query", std::string()) != RecordOutput::query_name(options.query) ||
+            data.value("days", 0) != options.days) {
+            throw std::runtime_error("--resume needs the same --format, --query and --days as the interrupted export");
+        }
+        progress.locations = data.at("locations").get<size_t>();
+        progress.bytes = data.at("bytes").get<uint64_t>();
+        progress.input_hash = std::stoull(data.at("input_hash").get<std::string>(), nullptr, 16);
+        progress.complete = data.value("complete", false);
+        progress.columns = data.value("columns", std::vector<std::string>());
+        progress.failed = data.value("failed", std::vector<size_t>());
+    } catch (const json::exception& e) {
+        throw std::runtime_error("Unreadable export progress " + path + ": " + e.what());
+    }
+    return true;
+}
+
+// Written beside the output and renamed into place, so it never describes more than was flushed
+bool BulkExporter::save_progress(const std::string& path, const Options& options, const Progress& progress) {
+    json data;
+    data["format"] = format_name(options.format);
+    data["query"] = RecordOutput::query_name(options.query);
+    data["days"] = options.days;
+    data["locations"] = progress.locations;
+    data["bytes"] = progress.bytes;
+    std::ostringstream hash;
+    hash << std::hex << std::setw(16) << std::setfill('0') << progress.input_hash;
+    data["input_hash"] = hash.str();
+    data["complete"] = progress.complete;
+    data["columns"] = progress.columns;
+    data["failed"] = progress.failed;
+
+    std::string tmp = path + ".tmp." + std::to_string(getpid());
+    std::error_code ec;
+    {
+        std::ofstream file(tmp, std::ios::trunc | std::ios::binary);
+        file << data.dump() << '\n';
+        file.flush();
+        if (!file) {
+            std::cerr << "Cannot write export progress " << tmp << std::endl;
+            std::filesystem::remove(tmp, ec);
+            return false;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::cerr << "Cannot save export progress " << path << ": " << ec.message() << std::endl;
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+    return true;
+}
+
+// The output must still hold every checkpointed byte and start as this export
+// began; resizing a shorter or foreign file would zero-fill or corrupt it
+void BulkExporter::check_resume(const Options& options, const std::vector<std::string>& locations,
+                                const Progress& progress) {
+    if (progress.locations > locations.size() ||
+        progress.input_hash != hash_locations(locations, progress.locations)) {
+        throw std::runtime_error("--resume needs the same locations as the interrupted export");
+    }
+    for (size_t index : progress.failed) {
+        if (index >= progress.locations) {
+            throw std::runtime_error("Unreadable export progress " + options.output_file +
+                                     ".progress: failed location " + std::to_string(index) + " was never reached");
+        }
+    }
+    if (progress.bytes == 0) return;
+
+    const std::string& path = options.output_file;
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    if (ec) throw std::runtime_error("Cannot resume " + path + ": " + ec.message());
+    if (size < progress.bytes) {
+        throw std::runtime_error("Cannot resume " + path + ": it is shorter (" + std::to_string(size) +
+                                 " bytes) than its last checkpoint (" + std::to_string(progress.bytes) + " bytes)");
+    }
+
+    std::string expected;
+    if (options.format == Format::CSV) {
+        for (size_t i = 0; i < progress.columns.size(); ++i) {
+            if (i > 0) expected += ',';
+            expected += progress.columns[i];
+        }
+        expected += '\n';
+    } else if (options.format == Format::COLUMNAR) {
+        columnar_header(expected, progress.columns);
+    } else {
+        expected = "{";
+    }
+    std::string head(static_cast<size_t>(std::min<uint64_t>(progress.bytes, expected.size())), '\0');
+    char last = '\n';
+    std::ifstream file(path, std::ios::binary);
+    file.read(&head[0], static_cast<std::streamsize>(head.size()));
+    if (options.format != Format::COLUMNAR) {
+        // Text checkpoints always fall after a complete line
+        file.seekg(static_cast<std::streamoff>(progress.bytes - 1));
+        file.get(last);
+    }
+    if (!file || head.size() < expected.size() || head != expected || last != '\n') {
+        throw std::runtime_error("Cannot resume " + path + ": it does not start as a " + format_name(options.format) +
+                                 " export of these columns; remove it and its .progress file to start over");
+    }
+}
+
+void BulkExporter::put_varint(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out += static_cast<char>(value | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+void BulkExporter::columnar_header(std::string& out, const std::vector<std::string>& columns) {
+    out += COLUMNAR_MAGIC;
+    put_varint(out, columns.size());
+    for (const auto& column : columns) {
+        put_varint(out, column.size());
+        out += column;
+    }
+}
+
+void BulkExporter::columnar_chunk(std::string& out, const std::string& column,
+                                  const std::vector<RecordOutput::Record>& rows) {
+    enum : char { NULLS, STRING, INTEGER, DECIMAL, DOUBLE };
+    std::vector<const RecordOutput::Record*> values(rows.size(), nullptr);
+    bool any_null = false, any_string = false, any_float = false, any_value = false, decimal = true;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        auto it = rows[i].find(column);
+        if (it == rows[i].end() || it->is_null()) {
+            any_null = true;
+            continue;
+        }
+        values[i] = &*it;
+        any_value = true;
+        if (it->is_number_float()) {
+            any_float = true;
+            double scaled = it->get<double>() * 1000;
+            if (std::abs(scaled) > 1e15 || std::abs(scaled - std::round(scaled)) > 1e-6) decimal = false;
+        } else if (!it->is_number()) {
+            any_string = true;
+        }
+    }
+    char type = !any_value ? NULLS : any_string ? STRING : !any_float ? INTEGER : decimal ? DECIMAL : DOUBLE;
+
+    std::string chunk;
+    chunk += type;
+    chunk += static_cast<char>(any_null && any_value);
+    if (any_null && any_value) {
+        std::string bitmap((rows.size() + 7) / 8, '\0');
+        for (size_t i = 0; i < rows.size(); ++i) {
+            if (values[i]) bitmap[i / 8] = static_cast<char>(bitmap[i / 8] | (1 << (i % 8)));
+        }
+        chunk += bitmap;
+    }
+    if (type == STRING) {
+        // Names, dates and conditions repeat across rows, so each distinct value is stored once
+        std::unordered_map<std::string, size_t> dictionary;
+        std::vector<size_t> indexes;
+        std::string entries;
+        for (const auto* value : values) {
+            if (!value) continue;
+            std::string text = value->is_string() ? value->get<std::string>() : value->dump();
+            auto [it, inserted] = dictionary.try_emplace(text, dictionary.size());
+            if (inserted) {
+                put_varint(entries, text.size());
+                entries += text;
+            }
+            indexes.push_back(it->second);
+        }
+        put_varint(chunk, dictionary.size());
+        chunk += entries;
+        for (size_t index : indexes) put_varint(chunk, index);
+    } else if (type != NULLS) {
+        for (const auto* value : values) {
+            if (!value) continue;
+            if (type == INTEGER) {
+                put_varint(chunk, zigzag(value->get<int64_t>()));
+            } else if (type == DECIMAL) {
+                put_varint(chunk, zigzag(static_cast<int64_t>(std::llround(value->get<double>() * 1000))));
+            } else {
+                double number = value->get<double>();
+                uint64_t bits;
+                std::memcpy(&bits, &number, sizeof(bits));
+                for (int shift = 0; shift < 64; shift += 8) chunk += static_cast<char>(bits >> shift);
+            }
+        }
+    }
+    put_varint(out, chunk.size());
+    out += chunk;
+}
+
+void BulkExporter::columnar_group(std::string& out, const std::vector<std::string>& columns,
+                                  const std::vector<RecordOutput::Record>& rows) {
+    if (rows.empty()) return;
+    put_varint(out, rows.size());
+    for (const auto& column : columns) columnar_chunk(out, column, rows);
+}
+
+int BulkExporter::run(const Options& options) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (options.input_file != "-") {
+        file.open(options.input_file);
+        if (!file.is_open()) {
+            throw std::runtime_error("Cannot open export location file: " + options.input_file);
+        }
+        in = &file;
+    }
+    std::vector<std::string> locations;
+    std::string line;
+    while (std::getline(*in, line)) {
+        line = Utils::trim(line);
+        if (!line.empty() && line[0] != '#') locations.push_back(line);
+    }
+    if (locations.empty()) {
+        std::cerr << "No locations to export" << std::endl;
+        return 2;
+    }
+
+    const bool to_stdout = options.output_file == "-";
+    const std::string progress_path = options.output_file + ".progress";
+    Progress progress;
+    if (options.resume && load_progress(progress_path, options, progress)) {
+        check_resume(options, locations, progress);
+        if (progress.complete) {
+            std::cerr << "export: " << options.output_file << " is already complete" << std::endl;
+            return 0;
+        }
+        // Anything written after the last checkpoint is incomplete and written again
+        std::error_code ec;
+        std::filesystem::resize_file(options.output_file, progress.bytes, ec);
+        if (ec) throw std::runtime_error("Cannot resume " + options.output_file + ": " + ec.message());
+    } else {
+        progress = Progress();
+    }
+
+    FILE* output = stdout;
+    if (!to_stdout) {
+        output = std::fopen(options.output_file.c_str(), progress.bytes > 0 ? "ab" : "wb");
+        if (!output) throw std::runtime_error("Cannot open export output: " + options.output_file);
+    }
+    // The buffer below is the only one; stdio would just copy it again
+    if (!to_stdout) std::setvbuf(output, nullptr, _IONBF, 0);
+
+    RecordOutput::Options lookup_options;
+    lookup_options.query = options.query;
+    lookup_options.days = options.days;
+    lookup_options.format = options.format == Format::CSV ? RecordOutput::Format::CSV : RecordOutput::Format::NDJSON;
+
+    // Locations that failed last time go first, and their rows after the checkpoint
+    const size_t start = progress.locations;
+    std::vector<size_t> order = std::move(progress.failed);
+    const size_t retries = order.size();
+    for (size_t index = start; index < locations.size(); ++index) order.push_back(index);
+    progress.failed.clear();
+
+    const size_t workers = static_cast<size_t>(
+        std::clamp(options.concurrency, 1, static_cast<int>(std::max<size_t>(1, order.size()))));
+    const size_t window = workers * WINDOW_PER_WORKER;
+    std::vector<Result> results(order.size());
+    std::mutex mutex;
+    std::condition_variable ready, space;
+    size_t next = 0, written = 0;  // positions in order
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            space.wait(lock, [&] { return next >= order.size() || next < written + window; });
+            if (next >= order.size()) return;
+            size_t position = next++;
+            size_t index = order[position];
+            lock.unlock();
+
+            Result result;
+            result.found = RecordOutput::lookup(lookup_options, locations[index], result.records, result.error);
+            if (result.found && options.format != Format::COLUMNAR) {
+                bool first = false;  // the writer adds the CSV header once
+                for (const auto& record : result.records) {
+                    RecordOutput::write_record(lookup_options, record, result.text, first);
+                }
+            }
+            result.ready = true;
+
+            lock.lock();
+            results[position] = std::move(result);
+            ready.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < workers; ++i) threads.emplace_back(worker);
+
+    std::string out;
+    out.reserve(FLUSH_BYTES + FLUSH_BYTES / 4);
+    std::vector<RecordOutput::Record> rows;
+    size_t records_written = 0;
+    std::vector<size_t> failed;  // this run's failures, in the order they were written
+    bool write_failed = false;
+    bool progress_failed = false;  // reported by save_progress; the workers still have to be joined
+    auto export_start = std::chrono::steady_clock::now();
+
+    // The first `done` positions of order are written; retries not reached yet stay failed
+    auto flush = [&](size_t done) {
+        if (options.format == Format::COLUMNAR) {
+            columnar_group(out, progress.columns, rows);
+            rows.clear();
+        }
+        if (!out.empty() && std::fwrite(out.data(), 1, out.size(), output) != out.size()) write_failed = true;
+        progress.bytes += out.size();
+        out.clear();
+        if (write_failed || to_stdout) return;
+        progress.locations = done > retries ? order[done - 1] + 1 : start;
+        progress.input_hash = hash_locations(locations, progress.locations);
+        progress.failed = failed;
+        for (size_t position = done; position < retries; ++position) progress.failed.push_back(order[position]);
+        std::sort(progress.failed.begin(), progress.failed.end());
+        progress.complete = done == order.size() && progress.failed.empty();
+        if (!save_progress(progress_path, options, progress)) progress_failed = true;
+    };
+
+    for (size_t position = 0; position < order.size() && !write_failed && !progress_failed; ++position) {
+        const size_t index = order[position];
+        Result result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&] { return results[position].ready; });
+            result = std::move(results[position]);
+            results[position] = Result();
+            written = position + 1;
+        }
+        space.notify_all();
+
+        if (!result.found) {
+            failed.push_back(index);
+            std::cerr << locations[index] << ": " << result.error << std::endl;
+            continue;
+        }
+        if (result.records.empty()) continue;
+        // The first record names the columns for the whole file
+        if (progress.bytes == 0 && out.empty() && progress.columns.empty()) {
+            for (const auto& column : result.records.front().items()) progress.columns.push_back(column.key());
+            if (options.format == Format::CSV) {
+                bool first = true;
+                std::string header;
+                RecordOutput::write_record(lookup_options, result.records.front(), header, first);
+                out += header.substr(0, header.find('\n') + 1);
+            } else if (options.format == Format::COLUMNAR) {
+                columnar_header(out, progress.columns);
+            }
+        }
+        records_written += result.records.size();
+        if (options.format == Format::COLUMNAR) {
+            for (auto& record : result.records) rows.push_back(std::move(record));
+            if (rows.size() >= ROW_GROUP_ROWS) flush(position + 1);
+        } else {
+            out += result.text;
+            if (out.size() >= FLUSH_BYTES) flush(position + 1);
+        }
+    }
+    if (!write_failed && !progress_failed) flush(order.size());
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = order.size();  // stops the workers early after a write or progress error
+    }
+    space.notify_all();
+    for (auto& thread : threads) thread.join();
+    if (to_stdout) std::fflush(stdout);
+    else std::fclose(output);
+    if (write_failed) {
+        std::cerr << "Write to " << options.output_file << " failed: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    if (progress_failed) return 1;
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - export_start).count();
+    std::cerr << std::fixed << std::setprecision(1) << "export: " << locations.size() - start << " locations";
+    if (start > 0) std::cerr << " (resumed after " << start << ")";
+    if (retries > 0) std::cerr << ", " << retries << " retried";
+    std::cerr << ", " << records_written << " " << format_name(options.format) << " records, "
+              << progress.bytes / 1024 << " KiB, " << failed.size() << " failed in " << elapsed << "s" << std::endl;
+    if (!failed.empty() && !to_stdout) {
+        std::cerr << "export: --resume retries the " << failed.size() << " failed locations" << std::endl;
+    }
+    return failed.empty() ? 0 : 1;
+}
+
+// --serve: one long-lived process answers lookups for many short-lived clients
+// with a warm response cache, connection pool and config. A poll() loop owns
+// every socket, lookups run on a small worker pool, and identical requests in
+// flight at the same time share one lookup.
+//
+// Protocol: one JSON object per line each way, replies in request order.
+//   {"query":"forecast","target":"London","days":3}
+//   {"ok":true,"records":[...]}   or   {"ok":false,"error":"..."}
+// {"query":"stats"} reports request, lookup and coalescing counters;
+// {"query":"metrics"} returns the Metrics histograms in Prometheus text format.
+class WeatherDaemon {
+public:
+    static int serve(const std::string& path);
+
+private:
+    static constexpr int WORKERS = 8;  // lookups wait on the network, not the CPU
+    static constexpr size_t MAX_CLIENTS = 1024;
+    static constexpr size_t MAX_REQUEST_BYTES = 64 * 1024;
+    static constexpr int METRICS_INTERVAL_MS = 15000;
+
+    struct Connection {
+        int fd = -1;
+        std::string in;
+        std::string out;
+        // Replies leave in request order even when lookups finish out of order
+        std::deque<std::optional<std::string>> replies;
+        uint64_t first_reply = 0;  // sequence number of replies.front()
+        bool eof = false;
+        bool broken = false;
+    };
+
+    struct Waiter {
+        uint64_t connection;
+        uint64_t reply;
+    };
+
+    struct Lookup {
+        std::string key;
+        std::string target;
+        RecordOutput::Options options;
+    };
+
+    struct State {
+        std::unordered_map<uint64_t, Connection> connections;
+        std::unordered_map<std::string, std::vector<Waiter>> in_flight;
+        uint64_t next_id = 0;
+        uint64_t requests = 0;
+        uint64_t lookups = 0;
+        uint64_t coalesced = 0;
+    };
+
+    static volatile std::sig_atomic_t stop_requested;
+    static int wake_pipe[2];
+
+    // Shared with the workers
+    static std::mutex mutex;
+    static std::condition_variable work_ready;
+    static std::deque<Lookup> work;
+    static std::deque<std::pair<std::string, std::string>> finished;  // key, reply line
+    static bool workers_stop;
+
+    static void on_signal(int);
+    static void wake();
+    static void set_nonblocking(int fd);
+    static int open_listener(const std::string& path);
+    static void worker();
+    static std::string answer(const Lookup& lookup);
+    static std::string error_reply(const std::string& message);
+
+    static void accept_clients(State& state, int listener);
+    static void read_requests(State& state, uint64_t id, Connection& connection);
+    static void handle_request(State& state, uint64_t id, Connection& connection, const std::string& line);
+    static void complete(Connection& connection, uint64_t reply, const std::string& line);
+    static void deliver(State& state, const std::string& key, const std::string& line);
+    static void write_replies(Connection& connection);
+};
 
-void Display::key_value(const std::string& key, const std::string& value, const std::string& color) {
-    std::cout << " " << Colors::BOLD << Colors::GRAY << std::setw(18) << std::left << key + ":" 
-              << Colors::RESET << color << value << Colors::RESET << std::endl;
+volatile std::sig_atomic_t WeatherDaemon::stop_requested = 0;
+int WeatherDaemon::wake_pipe[2] = {-1, -1};
+std::mutex WeatherDaemon::mutex;
+std::condition_variable WeatherDaemon::work_ready;
+std::deque<WeatherDaemon::Lookup> WeatherDaemon::work;
+std::deque<std::pair<std::string, std::string>> WeatherDaemon::finished;
+bool WeatherDaemon::workers_stop = false;
+
+std::string WeatherDaemon::error_reply(const std::string& message) {
+    RecordOutput::Record reply;
+    reply["ok"] = false;
+    reply["error"] = message;
+    return reply.dump() + "\n";
 }
 
-void Display::progress_bar(int percentage, const std::string& label) {
-    const int bar_width = 50;
-    int filled = (percentage * bar_width) / 100;
-    
-    std::cout << " " << Colors::BOLD << label << ": " << Colors::RESET;
-    std::cout << "[";
-    
-    for (int i = 0; i < bar_width; ++i) {
-        if (i < filled) {
-            std::cout << Colors::GREEN << "█" << Colors::RESET;
-        } else {
-            std::cout << Colors::DARK_GRAY << "░" << Colors::RESET;
-        }
+std::string WeatherDaemon::answer(const Lookup& lookup) {
+    std::vector<RecordOutput::Record> records;
+    std::string error;
+    try {
+        if (!RecordOutput::lookup(lookup.options, lookup.target, records, error)) return error_reply(error);
+    } catch (const std::exception& e) {
+        LOG_ERROR("Daemon lookup for " + lookup.target + " failed: " + e.what());
+        return error_reply("lookup failed");
     }
-    
-    std::cout << "] " << Colors::BOLD << percentage << "%" << Colors::RESET << std::endl;
+    RecordOutput::Record reply;
+    reply["ok"] = true;
+    reply["records"] = std::move(records);
+    return reply.dump() + "\n";
 }
 
-void Display::weather_card(const json& data, const std::string& location) {
-    if (!data.contains("current")) return;
-    
-    auto& current = data["current"];
-    std::string condition = current["condition"]["text"];
-    double temp = current["temp_c"];
-    
-    std::cout << "\n╭─────────────────────────────────────╮" << std::endl;
-    std::cout << "│ " << Colors::BOLD << Colors::CYAN << std::setw(33) << std::left << location << Colors::RESET << " │" << std::endl;
-    std::cout << "├─────────────────────────────────────┤" << std::endl;
-    std::cout << "│ " << Utils::get_weather_icon(condition) << " " << condition << std::setw(25) << " " << "│" << std::endl;
-    std::cout << "│ " << Colors::BOLD << Utils::get_temperature_color(temp) << std::setw(33) << std::left 
-              << (std::to_string(static_cast<int>(temp)) + "°C") << Colors::RESET << " │" << std::endl;
-    std::cout << "│ Feels like " << Utils::get_temperature_color(current["feelslike_c"]) 
-              << static_cast<int>(current["feelslike_c"].get<double>()) << "°C" << Colors::RESET << std::setw(18) << " " << "│" << std::endl;
-    std::cout << "╰─────────────────────────────────────╯" << std::endl;
+void WeatherDaemon::complete(Connection& connection, uint64_t reply, const std::string& line) {
+    if (reply < connection.first_reply) return;
+    connection.replies[reply - connection.first_reply] = line;
+    while (!connection.replies.empty() && connection.replies.front()) {
+        connection.out += *connection.replies.front();
+        connection.replies.pop_front();
+        connection.first_reply++;
+    }
 }
 
-void Display::hourly_forecast(const json& data) {
-    if (!data.contains("forecast") || data["forecast"]["forecastday"].empty()) return;
-    
-    section_header("24-HOUR FORECAST");
-    
-    auto& hours = data["forecast"]["forecastday"][0]["hour"];
-    std::cout << "\n";
-    
-    // Header
-    std::cout << Colors::BOLD << std::setw(6) << "Time" << std::setw(12) << "Condition" 
-              << std::setw(8) << "Temp" << std::setw(8) << "Rain%" << std::setw(10) << "Wind" << Colors::RESET << std::endl;
-    std::cout << std::string(44, '─') << std::endl;
-    
-    // Show next 12 hours
-    for (int i = 0; i < std::min(12, static_cast<int>(hours.size())); i++) {
-        auto& hour = hours[i];
-        std::string time = hour["time"].get<std::string>().substr(11, 5); // Extract HH:MM
-        std::string condition = hour["condition"]["text"];
-        double temp = hour["temp_c"];
-        int rain_chance = hour["chance_of_rain"];
-        double wind = hour["wind_kph"];
-        
-        std::cout << Colors::CYAN << std::setw(6) << time << Colors::RESET
-                  << std::setw(12) << (condition.length() > 10 ? condition.substr(0, 10) : condition)
-                  << Utils::get_temperature_color(temp) << std::setw(6) << static_cast<int>(temp) << "°" << Colors::RESET
-                  << Colors::BLUE << std::setw(6) << rain_chance << "%" << Colors::RESET
-                  << Colors::GRAY << std::setw(8) << static_cast<int>(wind) << "kph" << Colors::RESET << std::endl;
+void WeatherDaemon::deliver(State& state, const std::string& key, const std::string& line) {
+    auto found = state.in_flight.find(key);
+    if (found == state.in_flight.end()) return;
+    for (const auto& waiter : found->second) {
+        auto connection = state.connections.find(waiter.connection);
+        // Clients that hung up meanwhile are simply skipped
+        if (connection != state.connections.end()) complete(connection->second, waiter.reply, line);
     }
+    state.in_flight.erase(found);
 }
 
-void Display::seven_day_forecast(const json& data) {
-    if (!data.contains("forecast")) return;
-    
-    section_header("7-DAY FORECAST");
-    
-    auto& forecast_days = data["forecast"]["forecastday"];
-    
-    std::cout << "\n" << Colors::BOLD;
-    std::cout << std::setw(12) << "Date" << std::setw(15) << "Condition" 
-              << std::setw(8) << "High" << std::setw(8) << "Low" 
-              << std::setw(8) << "Rain%" << std::setw(10) << "Wind" << Colors::RESET << std::endl;
-    std::cout << std::string(61, '─') << std::endl;
-    
-    for (const auto& day : forecast_days) {
-        std::string date = day["date"].get<std::string>().substr(5); // Remove year
-        std::string condition = day["day"]["condition"]["text"];
-        double max_temp = day["day"]["maxtemp_c"];
-        double min_temp = day["day"]["mintemp_c"];
-        int rain_chance = day["day"]["daily_chance_of_rain"];
-        double max_wind = day["day"]["maxwind_kph"];
-        
-        std::cout << Colors::CYAN << std::setw(12) << date << Colors::RESET
-                  << std::setw(15) << (condition.length() > 13 ? condition.substr(0, 13) : condition)
-                  << Utils::get_temperature_color(max_temp) << std::setw(6) << static_cast<int>(max_temp) << "°" << Colors::RESET
-                  << Utils::get_temperature_color(min_temp) << std::setw(6) << static_cast<int>(min_temp) << "°" << Colors::RESET
-                  << Colors::BLUE << std::setw(6) << rain_chance << "%" << Colors::RESET
-                  << Colors::GRAY << std::setw(8) << static_cast<int>(max_wind) << "kph" << Colors::RESET << std::endl;
+void WeatherDaemon::handle_request(State& state, uint64_t id, Connection& connection, const std::string& line) {
+    std::string text = Utils::trim(line);
+    if (text.empty()) return;
+    uint64_t reply = connection.first_reply + connection.replies.size();
+    connection.replies.emplace_back();
+    state.requests++;
+
+    Lookup lookup;
+    std::string query;
+    try {
+        json request = json::parse(text);
+        if (!request.is_object()) throw std::invalid_argument("request must be an object");
+        query = request.value("query", std::string());
+        lookup.target = Utils::trim(request.value("target", std::string()));
+        lookup.options.days = std::min(CacheQuery::MAX_FORECAST_DAYS, std::max(0, request.value("days", 0)));
+    } catch (const std::exception&) {
+        complete(connection, reply, error_reply("invalid request"));
+        return;
     }
-}
 
-void Display::menu() {
-    std::cout << "\n╭─────────────────────── MAIN MENU ───────────────────────╮" << std::endl;
-    std::cout << "│                                                         │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "1." << Colors::RESET << " 🌤️  Current Weather & Today's Forecast              │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "2." << Colors::RESET << " 📅  7-Day Extended Forecast                        │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "3." << Colors::RESET << " 🕒  24-Hour Detailed Forecast                      │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "4." << Colors::RESET << " 💨  Air Quality Index & Pollution Data            │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "5." << Colors::RESET << " ⚠️   Weather Alerts & Warnings                     │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "6." << Colors::RESET << " 🌿  Pollen & Allergen Information                 │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "7." << Colors::RESET << " 🌍  IP Geolocation & Weather                       │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "8." << Colors::RESET << " ⚙️   Settings & Configuration                       │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "9." << Colors::RESET << " 📄  Export Weather Report                          │" << std::endl;
-    std::cout << "│ " << Colors::BOLD << "0." << Colors::RESET << " 🚪  Exit Application                               │" << std::endl;
-    std::cout << "│                                                         │" << std::endl;
-    std::cout << "╰─────────────────────────────────────────────────────────╯" << std::endl;
-    std::cout << "\n" << Colors::BOLD << Colors::PURPLE << "Select an option (0-9): " << Colors::RESET;
-}
+    if (query == "stats") {
+        RecordOutput::Record stats;
+        stats["ok"] = true;
+        stats["clients"] = state.connections.size();
+        stats["requests"] = state.requests;
+        stats["lookups"] = state.lookups;
+        stats["coalesced"] = state.coalesced;
+        stats["in_flight"] = state.in_flight.size();
+        complete(connection, reply, stats.dump() + "\n");
+        return;
+    }
+    if (query == "metrics") {
+        RecordOutput::Record metrics;
+        metrics["ok"] = true;
+        metrics["prometheus"] = Metrics::prometheus();
+        complete(connection, reply, metrics.dump() + "\n");
+        return;
+    }
+    if (!RecordOutput::parse_query(query, lookup.options.query)) {
+        complete(connection, reply, error_reply("unknown query: " + query));
+        return;
+    }
+    if (lookup.target.empty()) {
+        complete(connection, reply, error_reply("missing target"));
+        return;
+    }
 
-void Display::clear_screen() {
-    std::cout << "\033[2J\033[1;1H";
+    lookup.key = query + "|" + std::to_string(lookup.options.days) + "|" + lookup.target;
+    auto& waiters = state.in_flight[lookup.key];
+    waiters.push_back({id, reply});
+    if (waiters.size() > 1) {
+        state.coalesced++;
+        LOG_DEBUG("Coalesced daemon request " + lookup.key);
+        return;
+    }
+    state.lookups++;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        work.push_back(std::move(lookup));
+    }
+    work_ready.notify_one();
 }
 
-void Display::error_message(const std::string& message) {
-    std::cout << "\n" << Colors::BG_RED << Colors::WHITE << " ❌ ERROR " << Colors::RESET 
-              << " " << Colors::RED << message << Colors::RESET << std::endl;
+#ifndef _WIN32
+void WeatherDaemon::on_signal(int) {
+    stop_requested = 1;
+    wake();
 }
 
-void Display::success_message(const std::string& message) {
-    std::cout << "\n" << Colors::BG_GREEN << Colors::WHITE << " ✅ SUCCESS " << Colors::RESET 
-              << " " << Colors::GREEN << message << Colors::RESET << std::endl;
+void WeatherDaemon::wake() {
+    char byte = 1;
+    // A full pipe already guarantees the loop wakes up
+    ssize_t written = ::write(wake_pipe[1], &byte, 1);
+    (void)written;
 }
 
-void Display::warning_message(const std::string& message) {
-    std::cout << "\n" << Colors::BG_YELLOW << Colors::WHITE << " ⚠️  WARNING " << Colors::RESET 
-              << " " << Colors::YELLOW << message << Colors::RESET << std::endl;
+void WeatherDaemon::set_nonblocking(int fd) {
+    ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
 }
 
-void Display::info_message(const std::string& message) {
-    std::cout << "\n" << Colors::CYAN << "ℹ️  " << message << Colors::RESET << std::endl;
-}
+int WeatherDaemon::open_listener(const std::string& path) {
+    sockaddr_un address{};
+    if (path.empty()) {
+        std::cerr << "No private directory for the daemon socket; choose one with --socket <path>" << std::endl;
+        return -1;
+    }
+    if (path.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Invalid socket path: " << path << std::endl;
+        return -1;
+    }
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
 
-// Enhanced weather service class
-class WeatherService {
-public:
-    static json get_current_weather(const std::string& location);
-    static json get_forecast(const std::string& location, int days = 7);
-    static json get_hourly_forecast(const std::string& location);
-    static json get_air_quality(const std::string& location);
-    static json get_alerts(const std::string& location);
-    static json get_ip_lookup(const std::string& ip);
-    static bool export_weather_report(const std::string& location, const std::string& filename);
-};
+    if (DaemonClient::connect(path)) {
+        DaemonClient::disconnect();
+        std::cerr << "A weather daemon is already serving " << path << std::endl;
+        return -1;
+    }
+    // Nobody answers, so a socket file left here belongs to a daemon that died
+    struct stat existing {};
+    if (::lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << path << " exists and is not a socket" << std::endl;
+            return -1;
+        }
+        ::unlink(path.c_str());
+    }
 
-json WeatherService::get_current_weather(const std::string& location) {
-    std::string url = Config::BASE_URL + "current.json?key=" + Config::API_KEY + 
-                     "&q=" + Utils::url_encode(location) + "&aqi=yes";
-    return HttpClient::make_request(url);
+    int sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        std::cerr << "Cannot create socket: " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    mode_t previous = ::umask(077);  // only this user may connect
+    int bound = ::bind(sock, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+    ::umask(previous);
+    if (bound != 0 || ::listen(sock, SOMAXCONN) != 0) {
+        std::cerr << "Cannot listen on " << path << ": " << std::strerror(errno) << std::endl;
+        ::close(sock);
+        return -1;
+    }
+    set_nonblocking(sock);
+    return sock;
 }
 
-json WeatherService::get_forecast(const std::string& location, int days) {
-    std::string url = Config::BASE_URL + "forecast.json?key=" + Config::API_KEY + 
-                     "&q=" + Utils::url_encode(location) + "&days=" + std::to_string(days) + 
-                     "&aqi=yes&alerts=yes";
-    return HttpClient::make_request(url);
-}
+void WeatherDaemon::worker() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        work_ready.wait(lock, [] { return workers_stop || !work.empty(); });
+        if (workers_stop) return;
+        Lookup lookup = std::move(work.front());
+        work.pop_front();
+        lock.unlock();
+
+        std::string reply = answer(lookup);
 
-json WeatherService::get_hourly_forecast(const std::string& location) {
-    return get_forecast(location, 2); // Get 2 days for 48-hour forecast
+        lock.lock();
+        finished.emplace_back(std::move(lookup.key), std::move(reply));
+        wake();
+    }
 }
 
-json WeatherService::get_air_quality(const std::string& location) {
-    std::string url = Config::BASE_URL + "current.json?key=" + Config::API_KEY + 
-                     "&q=" + Utils::url_encode(location) + "&aqi=yes";
-    return HttpClient::make_request(url);
+void WeatherDaemon::accept_clients(State& state, int listener) {
+    while (true) {
+        int client = ::accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN: backlog drained
+        }
+        if (state.connections.size() >= MAX_CLIENTS) {
+            ::close(client);
+            continue;
+        }
+        set_nonblocking(client);
+        state.connections[++state.next_id].fd = client;
+    }
 }
 
-json WeatherService::get_alerts(const std::string& location) {
-    std::string url = Config::BASE_URL + "forecast.json?key=" + Config::API_KEY + 
-                     "&q=" + Utils::url_encode(location) + "&alerts=yes";
-    return HttpClient::make_request(url);
+void WeatherDaemon::read_requests(State& state, uint64_t id, Connection& connection) {
+    char chunk[16384];
+    ssize_t n = ::recv(connection.fd, chunk, sizeof(chunk), 0);
+    if (n == 0) {
+        connection.eof = true;
+    } else if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) connection.broken = true;
+        return;
+    } else {
+        connection.in.append(chunk, static_cast<size_t>(n));
+    }
+
+    size_t start = 0;
+    size_t newline;
+    while ((newline = connection.in.find('\n', start)) != std::string::npos) {
+        handle_request(state, id, connection, connection.in.substr(start, newline - start));
+        start = newline + 1;
+    }
+    connection.in.erase(0, start);
+    if (connection.in.size() > MAX_REQUEST_BYTES) {
+        connection.in.clear();
+        uint64_t reply = connection.first_reply + connection.replies.size();
+        connection.replies.emplace_back();
+        complete(connection, reply, error_reply("request too long"));
+        connection.eof = true;
+    }
 }
 
-json WeatherService::get_ip_lookup(const std::string& ip) {
-    std::string url = Config::BASE_URL + "ip.json?key=" + Config::API_KEY + "&q=" + ip;
-    return HttpClient::make_request(url);
+void WeatherDaemon::write_replies(Connection& connection) {
+    while (!connection.out.empty()) {
+        ssize_t n = ::send(connection.fd, connection.out.data(), connection.out.size(), MSG_NOSIGNAL);
+        if (n > 0) {
+            connection.out.erase(0, static_cast<size_t>(n));
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        connection.broken = true;
+        return;
+    }
 }
 
-bool WeatherService::export_weather_report(const std::string& location, const std::string& filename) {
-    json data = get_forecast(location, 7);
-    if (data.is_null()) return false;
-    
-    std::ofstream file(filename);
-    if (!file.is_open()) return false;
-    
-    file << "Weather Report for " << location << std::endl;
-    file << "Generated: " << Utils::get_current_time() << std::endl;
-    file << "=================================================" << std::endl;
-    
-    if (data.contains("current")) {
-        auto& current = data["current"];
-        file << "\nCURRENT CONDITIONS:" << std::endl;
-        file << "Temperature: " << current["temp_c"] << "°C" << std::endl;
-        file << "Condition: " << current["condition"]["text"] << std::endl;
-        file << "Feels Like: " << current["feelslike_c"] << "°C" << std::endl;
-        file << "Humidity: " << current["humidity"] << "%" << std::endl;
-        file << "Wind: " << current["wind_kph"] << " km/h " << current["wind_dir"] << std::endl;
+int WeatherDaemon::serve(const std::string& path) {
+    int listener = open_listener(path);
+    if (listener < 0) return 1;
+    if (::pipe(wake_pipe) != 0) {
+        std::cerr << "Cannot create wake-up pipe: " << std::strerror(errno) << std::endl;
+        ::close(listener);
+        return 1;
     }
-    
-    if (data.contains("forecast")) {
-        file << "\n7-DAY FORECAST:" << std::endl;
-        for (const auto& day : data["forecast"]["forecastday"]) {
-            file << day["date"] << ": " 
-                 << day["day"]["condition"]["text"] << " | "
-                 << "High: " << day["day"]["maxtemp_c"] << "°C | "
-                 << "Low: " << day["day"]["mintemp_c"] << "°C" << std::endl;
+    set_nonblocking(wake_pipe[0]);
+    set_nonblocking(wake_pipe[1]);
+
+    stop_requested = 0;
+    workers_stop = false;
+    auto previous_int = std::signal(SIGINT, on_signal);
+    auto previous_term = std::signal(SIGTERM, on_signal);
+    auto previous_pipe = std::signal(SIGPIPE, SIG_IGN);
+
+    // Clients ask for the same places in different shapes; one wide fetch covers them
+    HttpClient::widen_requests = true;
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < WORKERS; ++i) workers.emplace_back(worker);
+
+    LOG_INFO("Daemon listening on " + path);
+    std::cout << "Serving weather lookups on " << path << " (Ctrl-C to stop)" << std::endl;
+
+    State state;
+    std::vector<pollfd> fds;
+    std::vector<uint64_t> ids;  // connection behind fds[i + 2]
+    auto next_metrics = std::chrono::steady_clock::now();
+    while (!stop_requested) {
+        // Keep --metrics-file current for a scraper while the daemon runs
+        int timeout = -1;
+        if (!Metrics::export_path.empty()) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= next_metrics) {
+                Metrics::write_prometheus(Metrics::export_path);
+                next_metrics = now + std::chrono::milliseconds(METRICS_INTERVAL_MS);
+            }
+            timeout = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                next_metrics - now).count()) + 1;
+        }
+
+        fds.clear();
+        ids.clear();
+        fds.push_back({listener, static_cast<short>(state.connections.size() < MAX_CLIENTS ? POLLIN : 0), 0});
+        fds.push_back({wake_pipe[0], POLLIN, 0});
+        for (const auto& [id, connection] : state.connections) {
+            short events = connection.eof ? 0 : POLLIN;
+            if (!connection.out.empty()) events |= POLLOUT;
+            fds.push_back({connection.fd, events, 0});
+            ids.push_back(id);
+        }
+
+        if (::poll(fds.data(), fds.size(), timeout) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Daemon poll failed: " + std::string(std::strerror(errno)));
+            break;
+        }
+
+        if (fds[1].revents & POLLIN) {
+            char drain[256];
+            while (::read(wake_pipe[0], drain, sizeof(drain)) > 0) {}
+            std::deque<std::pair<std::string, std::string>> done;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                done.swap(finished);
+            }
+            for (const auto& [key, line] : done) deliver(state, key, line);
+        }
+
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto found = state.connections.find(ids[i]);
+            Connection& connection = found->second;
+            short revents = fds[i + 2].revents;
+            if (revents & (POLLIN | POLLHUP | POLLERR)) read_requests(state, ids[i], connection);
+            // Fully closed by the peer: nobody is left to read pending replies
+            if ((revents & (POLLHUP | POLLERR)) && connection.eof) connection.broken = true;
+            if (!connection.broken) write_replies(connection);
+            bool drained = connection.eof && connection.replies.empty() && connection.out.empty();
+            if (connection.broken || drained) {
+                ::close(connection.fd);
+                state.connections.erase(found);
+            }
         }
+
+        if (fds[0].revents & POLLIN) accept_clients(state, listener);
     }
-    
-    return true;
+
+    LOG_INFO("Daemon stopping after " + std::to_string(state.requests) + " requests (" +
+             std::to_string(state.lookups) + " lookups, " + std::to_string(state.coalesced) + " coalesced)");
+    for (const auto& [id, connection] : state.connections) ::close(connection.fd);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        workers_stop = true;
+        work.clear();
+    }
+    work_ready.notify_all();
+    for (auto& thread : workers) thread.join();
+    finished.clear();
+
+    ::close(listener);
+    ::unlink(path.c_str());
+    ::close(wake_pipe[0]);
+    ::close(wake_pipe[1]);
+    std::signal(SIGINT, previous_int == SIG_ERR ? SIG_DFL : previous_int);
+    std::signal(SIGTERM, previous_term == SIG_ERR ? SIG_DFL : previous_term);
+    std::signal(SIGPIPE, previous_pipe == SIG_ERR ? SIG_DFL : previous_pipe);
+
+    std::cout << "\nServed " << state.requests << " requests with " << state.lookups << " lookups ("
+              << state.coalesced << " coalesced)" << std::endl;
+    return 0;
+}
+#else
+int WeatherDaemon::serve(const std::string&) {
+    std::cerr << "--serve needs Unix domain sockets, which this platform build does not support" << std::endl;
+    return 1;
 }
+#endif
 
 // Enhanced weather display functions
 class WeatherDisplay {
@@ -620,126 +6877,141 @@ public:
     static void show_weather_alerts(const std::string& location);
     static void show_pollen_data(const std::string& location);
     static void show_ip_lookup(const std::string& ip);
-    static void show_detailed_current(const json& data, const std::string& location);
-    static void show_astronomy_data(const json& data);
+    static void show_detailed_current(const WeatherReport& report, const std::string& location);
+    static void show_astronomy_data(const WeatherReport& report);
+    // Drawing only, separate from fetching so screens can be benchmarked
+    static void render_current_weather(const WeatherReport& report, const std::string& location);
+    static void render_extended_forecast(const WeatherReport& report);
 };
 
 void WeatherDisplay::show_current_weather(const std::string& location) {
-    Utils::animate_loading("Fetching current weather data");
-    
-    json data = WeatherService::get_forecast(location, 1);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Fetching current weather data", [&](const CancelFlag& cancel) {
+        return WeatherService::get_forecast(location, 1, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch weather data for " + location);
         return;
     }
-    
+    render_current_weather(*report, location);
+}
+
+void WeatherDisplay::render_current_weather(const WeatherReport& report, const std::string& location) {
     Display::clear_screen();
     Display::banner();
     
     // Weather card
-    Display::weather_card(data, location);
+    Display::weather_card(report, location);
+    if (report.location.reuse_distance_km >= 0) {
+        std::ostringstream note;
+        note << std::fixed << std::setprecision(1) << "Conditions from " << report.location.name << ", "
+             << report.location.reuse_distance_km << " km away (cached)";
+        Display::info_message(note.str());
+    }
     
     // Detailed current conditions
-    show_detailed_current(data, location);
+    show_detailed_current(report, location);
     
     // Today's forecast
-    if (data.contains("forecast") && !data["forecast"]["forecastday"].empty()) {
-        auto& today = data["forecast"]["forecastday"][0];
+    if (!report.days.empty()) {
+        const auto& today = report.days[0];
         Display::section_header("TODAY'S FORECAST");
         
-        Display::key_value("Max Temperature", std::to_string(static_cast<int>(today["day"]["maxtemp_c"].get<double>())) + "°C", 
-                          Utils::get_temperature_color(today["day"]["maxtemp_c"]));
-        Display::key_value("Min Temperature", std::to_string(static_cast<int>(today["day"]["mintemp_c"].get<double>())) + "°C", 
-                          Utils::get_temperature_color(today["day"]["mintemp_c"]));
-        Display::key_value("Condition", today["day"]["condition"]["text"], Colors::GREEN);
-        Display::key_value("Precipitation", std::to_string(today["day"]["totalprecip_mm"].get<double>()) + " mm", Colors::BLUE);
-        Display::key_value("Max Wind", std::to_string(static_cast<int>(today["day"]["maxwind_kph"].get<double>())) + " km/h", Colors::CYAN);
+        Display::key_value("Max Temperature", std::to_string(static_cast<int>(today.maxtemp_c)) + "°C", 
+                          Utils::get_temperature_color(today.maxtemp_c));
+        Display::key_value("Min Temperature", std::to_string(static_cast<int>(today.mintemp_c)) + "°C", 
+                          Utils::get_temperature_color(today.mintemp_c));
+        Display::key_value("Condition", today.condition_text,
+                          Utils::get_condition_color(today.condition_code, today.condition_text));
+        Display::key_value("Precipitation", std::to_string(today.totalprecip_mm) + " mm", Colors::BLUE);
+        Display::key_value("Max Wind", std::to_string(static_cast<int>(today.maxwind_kph)) + " km/h", Colors::CYAN);
         
-        Display::progress_bar(today["day"]["daily_chance_of_rain"].get<int>(), "Chance of Rain");
-        Display::progress_bar(today["day"]["daily_chance_of_snow"].get<int>(), "Chance of Snow");
+        Display::progress_bar(today.daily_chance_of_rain, "Chance of Rain");
+        Display::progress_bar(today.daily_chance_of_snow, "Chance of Snow");
         
         // Astronomy data
-        show_astronomy_data(data);
+        show_astronomy_data(report);
     }
 }
 
-void WeatherDisplay::show_detailed_current(const json& data, const std::string& location) {
-    if (!data.contains("current")) return;
+void WeatherDisplay::show_detailed_current(const WeatherReport& report, const std::string& location) {
+    if (!report.current.available) return;
     
-    auto& current = data["current"];
+    const auto& current = report.current;
     
     Display::section_header("DETAILED CONDITIONS");
     
     // Temperature section
-    Display::key_value("Temperature", std::to_string(static_cast<int>(current["temp_c"].get<double>())) + "°C", 
-                      Utils::get_temperature_color(current["temp_c"]));
-    Display::key_value("Feels Like", std::to_string(static_cast<int>(current["feelslike_c"].get<double>())) + "°C", 
-                      Utils::get_temperature_color(current["feelslike_c"]));
+    Display::key_value("Temperature", std::to_string(static_cast<int>(current.temp_c)) + "°C", 
+                      Utils::get_temperature_color(current.temp_c));
+    Display::key_value("Feels Like", std::to_string(static_cast<int>(current.feelslike_c)) + "°C", 
+                      Utils::get_temperature_color(current.feelslike_c));
     
     // Wind section
-    Display::key_value("Wind Speed", std::to_string(static_cast<int>(current["wind_kph"].get<double>())) + " km/h", Colors::CYAN);
-    Display::key_value("Wind Direction", current["wind_dir"].get<std::string>(), Colors::CYAN);
-    Display::key_value("Wind Gust", std::to_string(static_cast<int>(current["gust_kph"].get<double>())) + " km/h", Colors::CYAN);
+    Display::key_value("Wind Speed", std::to_string(static_cast<int>(current.wind_kph)) + " km/h", Colors::CYAN);
+    Display::key_value("Wind Direction", current.wind_dir, Colors::CYAN);
+    Display::key_value("Wind Gust", std::to_string(static_cast<int>(current.gust_kph)) + " km/h", Colors::CYAN);
     
     // Atmospheric conditions
-    Display::key_value("Pressure", std::to_string(static_cast<int>(current["pressure_mb"].get<double>())) + " mb", Colors::BLUE);
-    Display::key_value("Humidity", std::to_string(current["humidity"].get<int>()) + "%", Colors::BLUE);
-    Display::key_value("Visibility", std::to_string(static_cast<int>(current["vis_km"].get<double>())) + " km", Colors::BLUE);
-    Display::key_value("UV Index", std::to_string(static_cast<int>(current["uv"].get<double>())), Colors::ORANGE);
+    Display::key_value("Pressure", std::to_string(static_cast<int>(current.pressure_mb)) + " mb", Colors::BLUE);
+    Display::key_value("Humidity", std::to_string(current.humidity) + "%", Colors::BLUE);
+    Display::key_value("Visibility", std::to_string(static_cast<int>(current.vis_km)) + " km", Colors::BLUE);
+    Display::key_value("UV Index", std::to_string(static_cast<int>(current.uv)), Colors::ORANGE);
     
     // Progress bars for key metrics
-    Display::progress_bar(current["humidity"].get<int>(), "Humidity");
-    Display::progress_bar(std::min(100, static_cast<int>(current["uv"].get<double>() * 10)), "UV Index");
+    Display::progress_bar(current.humidity, "Humidity");
+    Display::progress_bar(std::min(100, static_cast<int>(current.uv * 10)), "UV Index");
 }
 
-void WeatherDisplay::show_astronomy_data(const json& data) {
-    if (!data.contains("forecast") || data["forecast"]["forecastday"].empty()) return;
+void WeatherDisplay::show_astronomy_data(const WeatherReport& report) {
+    if (report.days.empty()) return;
     
-    auto& astro = data["forecast"]["forecastday"][0]["astro"];
+    const auto& astro = report.days[0];
     
     Display::section_header("ASTRONOMY");
     
-    Display::key_value("Sunrise", astro["sunrise"].get<std::string>(), Colors::ORANGE);
-    Display::key_value("Sunset", astro["sunset"].get<std::string>(), Colors::ORANGE);
-    Display::key_value("Moonrise", astro["moonrise"].get<std::string>(), Colors::PURPLE);
-    Display::key_value("Moonset", astro["moonset"].get<std::string>(), Colors::PURPLE);
-    Display::key_value("Moon Phase", astro["moon_phase"].get<std::string>(), Colors::PURPLE);
+    Display::key_value("Sunrise", astro.sunrise, Colors::ORANGE);
+    Display::key_value("Sunset", astro.sunset, Colors::ORANGE);
+    Display::key_value("Moonrise", astro.moonrise, Colors::PURPLE);
+    Display::key_value("Moonset", astro.moonset, Colors::PURPLE);
+    Display::key_value("Moon Phase", astro.moon_phase, Colors::PURPLE);
     
-    int moon_illumination = astro["moon_illumination"].get<int>();
-    Display::progress_bar(moon_illumination, "Moon Illumination");
+    Display::progress_bar(astro.moon_illumination, "Moon Illumination");
 }
 
 void WeatherDisplay::show_extended_forecast(const std::string& location) {
-    Utils::animate_loading("Fetching extended forecast");
-    
-    json data = WeatherService::get_forecast(location, 7);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Fetching extended forecast", [&](const CancelFlag& cancel) {
+        return WeatherService::get_forecast(location, 7, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch forecast data for " + location);
         return;
     }
-    
+    render_extended_forecast(*report);
+}
+
+void WeatherDisplay::render_extended_forecast(const WeatherReport& report) {
     Display::clear_screen();
     Display::banner();
     
-    Display::seven_day_forecast(data);
+    Display::seven_day_forecast(report);
     
     // Additional statistics
-    if (data.contains("forecast")) {
+    if (!report.days.empty()) {
         Display::section_header("FORECAST SUMMARY");
         
-        auto& days = data["forecast"]["forecastday"];
+        const auto& days = report.days;
         double avg_high = 0, avg_low = 0, total_rain = 0;
         int rainy_days = 0;
         
         for (const auto& day : days) {
-            avg_high += day["day"]["maxtemp_c"].get<double>();
-            avg_low += day["day"]["mintemp_c"].get<double>();
-            total_rain += day["day"]["totalprecip_mm"].get<double>();
-            if (day["day"]["daily_chance_of_rain"].get<int>() > 50) rainy_days++;
+            avg_high += day.maxtemp_c;
+            avg_low += day.mintemp_c;
+            total_rain += day.totalprecip_mm;
+            if (day.daily_chance_of_rain > 50) rainy_days++;
         }
         
-        avg_high /= days.size();
-        avg_low /= days.size();
+        avg_high /= static_cast<double>(days.size());
+        avg_low /= static_cast<double>(days.size());
         
         Display::key_value("Avg High", std::to_string(static_cast<int>(avg_high)) + "°C", Utils::get_temperature_color(avg_high));
         Display::key_value("Avg Low", std::to_string(static_cast<int>(avg_low)) + "°C", Utils::get_temperature_color(avg_low));
@@ -749,10 +7021,10 @@ void WeatherDisplay::show_extended_forecast(const std::string& location) {
 }
 
 void WeatherDisplay::show_hourly_forecast(const std::string& location) {
-    Utils::animate_loading("Fetching hourly forecast");
-    
-    json data = WeatherService::get_hourly_forecast(location);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Fetching hourly forecast", [&](const CancelFlag& cancel) {
+        return WeatherService::get_hourly_forecast(location, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch hourly data for " + location);
         return;
     }
@@ -760,14 +7032,14 @@ void WeatherDisplay::show_hourly_forecast(const std::string& location) {
     Display::clear_screen();
     Display::banner();
     
-    Display::hourly_forecast(data);
+    Display::hourly_forecast(*report);
 }
 
 void WeatherDisplay::show_air_quality(const std::string& location) {
-    Utils::animate_loading("Fetching air quality data");
-    
-    json data = WeatherService::get_air_quality(location);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Fetching air quality data", [&](const CancelFlag& cancel) {
+        return WeatherService::get_air_quality(location, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch air quality data for " + location);
         return;
     }
@@ -777,10 +7049,10 @@ void WeatherDisplay::show_air_quality(const std::string& location) {
     
     Display::section_header("AIR QUALITY INDEX - " + location);
     
-    if (data.contains("current") && data["current"].contains("air_quality")) {
-        auto& aqi = data["current"]["air_quality"];
+    if (report->air_quality.available) {
+        const auto& aqi = report->air_quality;
         
-        int us_epa = aqi["us-epa-index"].get<int>();
+        int us_epa = aqi.us_epa_index;
         std::string aqi_level, health_advice;
         
         switch(us_epa) {
@@ -801,22 +7073,22 @@ void WeatherDisplay::show_air_quality(const std::string& location) {
         
         Display::section_header("POLLUTANT BREAKDOWN");
         
-        Display::key_value("Carbon Monoxide", std::to_string(static_cast<int>(aqi["co"].get<double>())) + " µg/m³", Colors::CYAN);
-        Display::key_value("Nitrogen Dioxide", std::to_string(static_cast<int>(aqi["no2"].get<double>())) + " µg/m³", Colors::CYAN);
-        Display::key_value("Ozone", std::to_string(static_cast<int>(aqi["o3"].get<double>())) + " µg/m³", Colors::CYAN);
-        Display::key_value("Sulphur Dioxide", std::to_string(static_cast<int>(aqi["so2"].get<double>())) + " µg/m³", Colors::CYAN);
-        Display::key_value("PM 2.5", std::to_string(static_cast<int>(aqi["pm2_5"].get<double>())) + " µg/m³", Colors::CYAN);
-        Display::key_value("PM 10", std::to_string(static_cast<int>(aqi["pm10"].get<double>())) + " µg/m³", Colors::CYAN);
+        Display::key_value("Carbon Monoxide", std::to_string(static_cast<int>(aqi.co)) + " µg/m³", Colors::CYAN);
+        Display::key_value("Nitrogen Dioxide", std::to_string(static_cast<int>(aqi.no2)) + " µg/m³", Colors::CYAN);
+        Display::key_value("Ozone", std::to_string(static_cast<int>(aqi.o3)) + " µg/m³", Colors::CYAN);
+        Display::key_value("Sulphur Dioxide", std::to_string(static_cast<int>(aqi.so2)) + " µg/m³", Colors::CYAN);
+        Display::key_value("PM 2.5", std::to_string(static_cast<int>(aqi.pm2_5)) + " µg/m³", Colors::CYAN);
+        Display::key_value("PM 10", std::to_string(static_cast<int>(aqi.pm10)) + " µg/m³", Colors::CYAN);
     } else {
         Display::warning_message("Air quality data not available for this location");
     }
 }
 
 void WeatherDisplay::show_weather_alerts(const std::string& location) {
-    Utils::animate_loading("Checking weather alerts");
-    
-    json data = WeatherService::get_alerts(location);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Checking weather alerts", [&](const CancelFlag& cancel) {
+        return WeatherService::get_alerts(location, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch alerts for " + location);
         return;
     }
@@ -826,23 +7098,22 @@ void WeatherDisplay::show_weather_alerts(const std::string& location) {
     
     Display::section_header("WEATHER ALERTS - " + location);
     
-    if (data.contains("alerts") && !data["alerts"]["alert"].empty()) {
-        auto& alerts = data["alerts"]["alert"];
+    if (!report->alerts.empty()) {
+        const auto& alerts = report->alerts;
         
         for (size_t i = 0; i < alerts.size(); ++i) {
             const auto& alert = alerts[i];
             
             std::cout << "\n╭── Alert " << (i + 1) << " ──────────────────────────────────────────╮" << std::endl;
-            std::cout << "│ " << Colors::BOLD << Colors::RED << "⚠️  " << alert["headline"].get<std::string>() << Colors::RESET << std::endl;
+            std::cout << "│ " << Colors::BOLD << Colors::RED << "⚠️  " << alert.headline << Colors::RESET << std::endl;
             std::cout << "├─────────────────────────────────────────────────────────────┤" << std::endl;
-            std::cout << "│ " << Colors::BOLD << "Severity: " << Colors::RESET << Colors::ORANGE << alert["severity"].get<std::string>() << Colors::RESET << std::endl;
-            std::cout << "│ " << Colors::BOLD << "Areas: " << Colors::RESET << alert["areas"].get<std::string>() << std::endl;
-            std::cout << "│ " << Colors::BOLD << "Expires: " << Colors::RESET << alert["expires"].get<std::string>() << std::endl;
+            std::cout << "│ " << Colors::BOLD << "Severity: " << Colors::RESET << Colors::ORANGE << alert.severity << Colors::RESET << std::endl;
+            std::cout << "│ " << Colors::BOLD << "Areas: " << Colors::RESET << alert.areas << std::endl;
+            std::cout << "│ " << Colors::BOLD << "Expires: " << Colors::RESET << alert.expires << std::endl;
             std::cout << "│ " << Colors::BOLD << "Description: " << Colors::RESET << std::endl;
             
             // Word wrap the description
-            std::string desc = alert["desc"].get<std::string>();
-            std::vector<std::string> words = Utils::split(desc, ' ');
+            std::vector<std::string> words = Utils::split(alert.desc, ' ');
             std::string line = "│ ";
             
             for (const auto& word : words) {
@@ -863,10 +7134,10 @@ void WeatherDisplay::show_weather_alerts(const std::string& location) {
 }
 
 void WeatherDisplay::show_pollen_data(const std::string& location) {
-    Utils::animate_loading("Fetching pollen information");
-    
-    json data = WeatherService::get_forecast(location, 3);
-    if (data.is_null()) {
+    auto report = Utils::run_with_spinner("Fetching pollen information", [&](const CancelFlag& cancel) {
+        return WeatherService::get_forecast(location, 3, &cancel);
+    });
+    if (!report) {
         Display::error_message("Failed to fetch pollen data for " + location);
         return;
     }
@@ -879,9 +7150,8 @@ void WeatherDisplay::show_pollen_data(const std::string& location) {
     // Note: WeatherAPI doesn't provide detailed pollen data, so we'll show what's available
     Display::info_message("Detailed pollen data requires a specialized API. Showing available air quality metrics.");
     
-    if (data.contains("current") && data["current"].contains("air_quality")) {
-        auto& aqi = data["current"]["air_quality"];
-        int aqi_level = aqi["us-epa-index"].get<int>();
+    if (report->air_quality.available) {
+        int aqi_level = report->air_quality.us_epa_index;
         
         std::string pollen_estimate;
         if (aqi_level <= 2) pollen_estimate = "Low";
@@ -909,10 +7179,10 @@ void WeatherDisplay::show_pollen_data(const std::string& location) {
 }
 
 void WeatherDisplay::show_ip_lookup(const std::string& ip) {
-    Utils::animate_loading("Looking up IP information");
-    
-    json data = WeatherService::get_ip_lookup(ip);
-    if (data.is_null()) {
+    auto lookup = Utils::run_with_spinner("Looking up IP information", [&](const CancelFlag& cancel) {
+        return WeatherService::get_ip_lookup(ip, &cancel);
+    });
+    if (!lookup) {
         Display::error_message("Failed to lookup IP: " + ip);
         return;
     }
@@ -922,25 +7192,25 @@ void WeatherDisplay::show_ip_lookup(const std::string& ip) {
     
     Display::section_header("IP GEOLOCATION LOOKUP");
     
-    Display::key_value("IP Address", data["ip"].get<std::string>(), Colors::CYAN);
-    Display::key_value("Type", data["type"].get<std::string>(), Colors::CYAN);
-    Display::key_value("Country", data["country_name"].get<std::string>(), Colors::GREEN);
-    Display::key_value("Region", data["region"].get<std::string>(), Colors::GREEN);
-    Display::key_value("City", data["city"].get<std::string>(), Colors::GREEN);
-    Display::key_value("Latitude", std::to_string(data["lat"].get<double>()), Colors::YELLOW);
-    Display::key_value("Longitude", std::to_string(data["lon"].get<double>()), Colors::YELLOW);
-    Display::key_value("Timezone", data["tz_id"].get<std::string>(), Colors::PURPLE);
-    Display::key_value("Local Time", data["localtime"].get<std::string>(), Colors::PURPLE);
+    Display::key_value("IP Address", lookup->ip, Colors::CYAN);
+    Display::key_value("Type", lookup->type, Colors::CYAN);
+    Display::key_value("Country", lookup->country_name, Colors::GREEN);
+    Display::key_value("Region", lookup->region, Colors::GREEN);
+    Display::key_value("City", lookup->city, Colors::GREEN);
+    Display::key_value("Latitude", std::to_string(lookup->lat), Colors::YELLOW);
+    Display::key_value("Longitude", std::to_string(lookup->lon), Colors::YELLOW);
+    Display::key_value("Timezone", lookup->tz_id, Colors::PURPLE);
+    Display::key_value("Local Time", lookup->localtime, Colors::PURPLE);
     
     // Show weather for this location
-    std::string location = data["city"].get<std::string>() + ", " + data["country_name"].get<std::string>();
+    std::string location = lookup->city + ", " + lookup->country_name;
     
     Display::info_message("Fetching weather for detected location...");
-    Utils::animate_loading("Loading weather data", 1000);
-    
-    json weather_data = WeatherService::get_current_weather(location);
-    if (!weather_data.is_null()) {
-        Display::weather_card(weather_data, location);
+    auto weather = Utils::run_with_spinner("Loading weather data", [&](const CancelFlag& cancel) {
+        return WeatherService::get_current_weather(location, &cancel);
+    });
+    if (weather) {
+        Display::weather_card(*weather, location);
     }
 }
 
@@ -964,9 +7234,13 @@ void Settings::show_settings_menu() {
     
     std::cout << "\n" << Colors::BOLD << "Current Configuration:" << Colors::RESET << std::endl;
     Display::key_value("API Key", Config::API_KEY.substr(0, 8) + "...", Colors::GRAY);
+    Display::key_value("API Endpoint", Config::BASE_URL, Colors::GRAY);
     Display::key_value("Timeout", std::to_string(Config::TIMEOUT) + " seconds", Colors::CYAN);
-    Display::key_value("Logging", Logger::logging_enabled ? "Enabled" : "Disabled", 
-                      Logger::logging_enabled ? Colors::GREEN : Colors::RED);
+    Display::key_value("Cache", std::to_string(ResponseCache::entry_count()) + " entries, " +
+                       std::to_string(ResponseCache::size_bytes() / 1024) + " KB of " +
+                       std::to_string(Config::CACHE_SIZE_MB) + " MB", Colors::CYAN);
+    Display::key_value("Logging", Logger::is_enabled() ? std::string("Enabled (") + Logger::level_name(Logger::level()) + ")" : "Disabled", 
+                      Logger::is_enabled() ? Colors::GREEN : Colors::RED);
     
     std::cout << "\n╭────────── Settings Menu ──────────╮" << std::endl;
     std::cout << "│                                    │" << std::endl;
@@ -1014,8 +7288,8 @@ void Settings::configure_api_key() {
 }
 
 void Settings::toggle_logging() {
-    Logger::enable_logging(!Logger::logging_enabled);
-    Display::success_message("Logging " + std::string(Logger::logging_enabled ? "enabled" : "disabled"));
+    Logger::enable_logging(!Logger::is_enabled());
+    Display::success_message("Logging " + std::string(Logger::is_enabled() ? "enabled" : "disabled"));
     std::this_thread::sleep_for(std::chrono::seconds(1));
 }
 
@@ -1056,15 +7330,25 @@ public:
     WeatherApp() : running(true) {}
     
     void initialize();
+    void start_services();
     void run();
+    void cleanup();
     void shutdown();
 };
 
 void WeatherApp::initialize() {
-    curl_global_init(CURL_GLOBAL_DEFAULT);
     Config::load_config();
+    Logger::set_level(Logger::parse_level(Config::LOG_LEVEL));
     Logger::enable_logging(true);
-    Logger::info("Weather CLI Pro v2.0 started");
+    LOG_INFO("Weather CLI Pro v2.0 started");
+}
+
+// Network and background cache maintenance; started once command line overrides
+// are applied, and skipped entirely when a daemon answers for us
+void WeatherApp::start_services() {
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    ResponseCache::start_sweeper(std::chrono::seconds(30), HttpClient::retention());
+    if (Config::REFRESH_TOP_KEYS > 0) BackgroundRefresher::start();
 }
 
 std::string WeatherApp::get_location_input() {
@@ -1094,9 +7378,10 @@ void WeatherApp::handle_export_report() {
     std::getline(std::cin, filename);
     if (filename.empty()) filename = "weather_report.txt";
     
-    Utils::animate_loading("Generating weather report");
-    
-    if (WeatherService::export_weather_report(location, filename)) {
+    bool exported = Utils::run_with_spinner("Generating weather report", [&](const CancelFlag& cancel) {
+        return WeatherService::export_weather_report(location, filename, &cancel);
+    });
+    if (exported) {
         Display::success_message("Weather report exported to " + filename);
     } else {
         Display::error_message("Failed to export weather report");
@@ -1104,6 +7389,9 @@ void WeatherApp::handle_export_report() {
 }
 
 void WeatherApp::run() {
+    // Menu sessions revisit the same location, so fetch full forecasts up front
+    HttpClient::widen_requests = true;
+    
     while (running) {
         Display::clear_screen();
         Display::banner();
@@ -1111,7 +7399,10 @@ void WeatherApp::run() {
         Display::menu();
         
         std::string choice;
-        std::getline(std::cin, choice);
+        if (!std::getline(std::cin, choice)) {
+            running = false;  // stdin closed
+            break;
+        }
         choice = Utils::trim(choice);
         
         if (choice == "0" || choice == "exit" || choice == "quit") {
@@ -1172,10 +7463,10 @@ void WeatherApp::run() {
             }
             else if (choice == "7") {
                 std::string ip = get_ip_input();
-                if (!ip.empty()) {
-                    WeatherDisplay::show_ip_lookup(ip);
+                if (ip != "auto" && !Utils::is_valid_ip(ip)) {
+                    Display::error_message("Invalid IP address: " + ip);
                 } else {
-                    Display::error_message("IP address cannot be empty");
+                    WeatherDisplay::show_ip_lookup(ip);
                 }
             }
             else if (choice == "8") {
@@ -1195,7 +7486,7 @@ void WeatherApp::run() {
             }
             
         } catch (const std::exception& e) {
-            Logger::error("Exception in main loop: " + std::string(e.what()));
+            LOG_ERROR("Exception in main loop: " + std::string(e.what()));
             Display::error_message("An error occurred: " + std::string(e.what()));
             std::cout << "\n" << Colors::GRAY << "Press Enter to continue..." << Colors::RESET;
             std::cin.ignore();
@@ -1203,9 +7494,18 @@ void WeatherApp::run() {
     }
 }
 
-void WeatherApp::shutdown() {
-    Logger::info("Weather CLI Pro v2.0 shutting down");
+void WeatherApp::cleanup() {
+    LOG_INFO("Weather CLI Pro v2.0 shutting down");
+    BackgroundRefresher::stop();
+    RequestScheduler::shutdown();
+    ResponseCache::stop_sweeper();
+    ConnectionPool::shutdown();
     curl_global_cleanup();
+    Metrics::finish();
+    Logger::shutdown();
+}
+
+void WeatherApp::shutdown() {
     Display::clear_screen();
     
     // Goodbye animation
@@ -1217,27 +7517,408 @@ void WeatherApp::shutdown() {
     std::cout << Colors::GREEN;
     
     for (const auto& frame : goodbye_frames) {
-        std::cout << "\r" << frame << " Have a great day! " << frame << std::flush;
+        std::cout << "\r" << frame << " Have a great day! " << frame;
+        Frame::present();
         std::this_thread::sleep_for(std::chrono::milliseconds(200));
     }
     
     std::cout << "\r" << Colors::BOLD << "🌈 Weather CLI Pro - Stay informed, stay safe! 🌈" << Colors::RESET << std::endl;
     std::cout << Colors::GRAY << "Version 2.0 - Professional Weather Intelligence" << Colors::RESET << std::endl;
+    Frame::uninstall();
+    // Last, so a --stats summary is not wiped by the goodbye screen
+    cleanup();
+}
+
+// Command line option parsing
+struct CommandLine {
+    bool show_help = false;
+    bool show_version = false;
+    bool batch_mode = false;
+    bool ip_batch_mode = false;
+    bool watch_mode = false;
+    bool alert_mode = false;
+    bool export_mode = false;
+    bool headless = false;
+    bool compact_cache = false;
+    bool serve = false;
+    bool use_daemon = true;
+    bool show_stats = false;
+    std::string metrics_file;
+    std::string socket_path;  // empty: --serve and the client resolve the default when they need it
+    int cache_size_mb = 0;
+    int max_stale_minutes = -1;
+    int refresh_top_keys = -1;
+    int coord_precision = -1;
+    double reuse_radius_km = -1;
+    int reuse_max_age_minutes = -1;
+    std::string base_url;
+    std::string location;
+    BatchProcessor::Options batch;
+    IpBatchProcessor::Options ip_batch;
+    WeatherWatch::Options watch;
+    AlertMonitor::Options alerts;
+    BulkExporter::Options exporter;
+    std::string format_name;
+    RecordOutput::Options records;
+
+    static CommandLine parse(int argc, char* argv[]);
+    void apply_overrides() const;
+    static void print_usage(const char* program);
+};
+
+CommandLine CommandLine::parse(int argc, char* argv[]) {
+    CommandLine cli;
+    std::string arg;
+    std::optional<std::string> inline_value;  // from --flag=value
+    auto value_of = [&](int& i) -> std::string {
+        if (inline_value) return *inline_value;
+        if (i + 1 >= argc) {
+            throw std::runtime_error("Missing value for " + arg);
+        }
+        return argv[++i];
+    };
+    auto int_value_of = [&](int& i) {
+        std::string value = value_of(i);
+        try {
+            return std::stoi(value);
+        } catch (const std::exception&) {
+            throw std::runtime_error("Invalid number for " + arg + ": " + value);
+        }
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        arg = argv[i];
+        inline_value.reset();
+        size_t equals = arg.find('=');
+        if (arg.compare(0, 2, "--") == 0 && equals != std::string::npos) {
+            inline_value = arg.substr(equals + 1);
+            arg.erase(equals);
+        }
+
+        if (arg == "-h" || arg == "--help") {
+            cli.show_help = true;
+        } else if (arg == "-v" || arg == "--version") {
+            cli.show_version = true;
+        } else if (arg == "--batch") {
+            cli.batch_mode = true;
+            cli.batch.input_file = value_of(i);
+        } else if (arg == "--ip-batch") {
+            cli.ip_batch_mode = true;
+            cli.ip_batch.input_file = value_of(i);
+        } else if (arg == "--collapse") {
+            cli.ip_batch.ipv4_prefix = 24;
+            cli.ip_batch.ipv6_prefix = 48;
+        } else if (arg == "--with-weather") {
+            cli.ip_batch.with_weather = true;
+        } else if (arg == "--watch") {
+            cli.watch_mode = true;
+            cli.watch.input_file = value_of(i);
+        } else if (arg == "--interval") {
+            cli.watch.interval_seconds = int_value_of(i);
+            if (cli.watch.interval_seconds < 1) {
+                throw std::runtime_error("Invalid interval for " + arg + ": must be at least 1 second");
+            }
+            cli.alerts.interval_seconds = cli.watch.interval_seconds;
+        } else if (arg == "--monitor-alerts") {
+            cli.alert_mode = true;
+            cli.alerts.input_file = value_of(i);
+        } else if (arg == "--alert-state") {
+            cli.alerts.state_file = value_of(i);
+        } else if (arg == "--export") {
+            cli.export_mode = true;
+            cli.exporter.input_file = value_of(i);
+        } else if (arg == "--output") {
+            cli.exporter.output_file = value_of(i);
+        } else if (arg == "--resume") {
+            cli.exporter.resume = true;
+        } else if (arg == "--concurrency") {
+            cli.batch.concurrency = int_value_of(i);
+            cli.ip_batch.concurrency = cli.batch.concurrency;
+            cli.watch.concurrency = cli.batch.concurrency;
+            cli.alerts.concurrency = cli.batch.concurrency;
+            cli.exporter.concurrency = cli.batch.concurrency;
+        } else if (arg == "--ordered") {
+            cli.batch.ordered = true;
+        } else if (arg == "--cache-size") {
+            cli.cache_size_mb = int_value_of(i);
+        } else if (arg == "--max-stale") {
+            cli.max_stale_minutes = int_value_of(i);
+        } else if (arg == "--refresh-top") {
+            cli.refresh_top_keys = int_value_of(i);
+        } else if (arg == "--coord-precision") {
+            cli.coord_precision = std::clamp(int_value_of(i), 0, 6);
+        } else if (arg == "--reuse-radius") {
+            std::string value = value_of(i);
+            char* end = nullptr;
+            cli.reuse_radius_km = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() || *end != '\0' || cli.reuse_radius_km < 0) {
+                throw std::runtime_error("Invalid distance for " + arg + ": " + value);
+            }
+        } else if (arg == "--reuse-max-age") {
+            cli.reuse_max_age_minutes = std::max(0, int_value_of(i));
+        } else if (arg == "--base-url") {
+            cli.base_url = value_of(i);
+        } else if (arg == "--stats") {
+            cli.show_stats = true;
+        } else if (arg == "--metrics-file") {
+            cli.metrics_file = value_of(i);
+        } else if (arg == "--no-disk-cache") {
+            DiskCache::enabled = false;
+        } else if (arg == "--compact-cache") {
+            cli.compact_cache = true;
+        } else if (arg == "--format") {
+            std::string format = value_of(i);
+            if (!RecordOutput::parse_format(format, cli.records.format) && format != "columnar") {
+                throw std::runtime_error("Unknown format: " + format + " (expected json, ndjson, csv or columnar)");
+            }
+            cli.format_name = format;
+            cli.headless = true;
+        } else if (arg == "--no-tty") {
+            cli.headless = true;
+        } else if (arg == "--query") {
+            std::string query = value_of(i);
+            if (!RecordOutput::parse_query(query, cli.records.query)) {
+                throw std::runtime_error("Unknown query: " + query);
+            }
+            cli.exporter.query = cli.records.query;
+        } else if (arg == "--serve") {
+            cli.serve = true;
+            if (inline_value) cli.socket_path = *inline_value;
+        } else if (arg == "--socket") {
+            cli.socket_path = value_of(i);
+        } else if (arg == "--no-daemon") {
+            cli.use_daemon = false;
+        } else if (arg == "--days") {
+            cli.records.days = std::min(CacheQuery::MAX_FORECAST_DAYS, std::max(1, int_value_of(i)));
+            cli.exporter.days = cli.records.days;
+        } else if (arg.size() > 2 && arg.compare(0, 2, "--") == 0) {
+            throw std::runtime_error("Unknown option: " + arg);
+        } else {
+            if (!cli.location.empty()) cli.location += " ";
+            cli.location += arg;
+        }
+    }
+    if (cli.batch_mode && cli.ip_batch_mode) {
+        throw std::runtime_error("--batch cannot be combined with --ip-batch");
+    }
+    if (cli.headless && (cli.batch_mode || cli.ip_batch_mode)) {
+        throw std::runtime_error("--format/--no-tty cannot be combined with --batch or --ip-batch");
+    }
+    if (cli.serve && (cli.headless || cli.batch_mode || cli.ip_batch_mode)) {
+        throw std::runtime_error("--serve cannot be combined with --format, --no-tty, --batch or --ip-batch");
+    }
+    if (cli.watch_mode && (cli.batch_mode || cli.ip_batch_mode || cli.serve)) {
+        throw std::runtime_error("--watch cannot be combined with --batch, --ip-batch or --serve");
+    }
+    if (cli.alert_mode && (cli.batch_mode || cli.ip_batch_mode || cli.watch_mode || cli.serve)) {
+        throw std::runtime_error("--monitor-alerts cannot be combined with --batch, --ip-batch, --watch or --serve");
+    }
+    if (cli.export_mode) {
+        if (cli.batch_mode || cli.ip_batch_mode || cli.watch_mode || cli.alert_mode || cli.serve) {
+            throw std::runtime_error("--export cannot be combined with --batch, --ip-batch, --watch, "
+                                     "--monitor-alerts or --serve");
+        }
+        if (!cli.format_name.empty() && !BulkExporter::parse_format(cli.format_name, cli.exporter.format)) {
+            throw std::runtime_error("--export writes csv, ndjson or columnar, not " + cli.format_name);
+        }
+        if (cli.exporter.query == RecordOutput::Query::IP) {
+            throw std::runtime_error("--export cannot export --query ip");
+        }
+        if (cli.exporter.output_file.empty()) {
+            throw std::runtime_error("--export needs --output <file> ('-' for stdout)");
+        }
+        if (cli.exporter.resume && cli.exporter.output_file == "-") {
+            throw std::runtime_error("--resume needs an --output file");
+        }
+        cli.headless = false;
+    } else if (cli.format_name == "columnar") {
+        throw std::runtime_error("The columnar format is only written by --export");
+    }
+    if ((cli.watch_mode || cli.alert_mode) && cli.headless) {
+        // A stream of changes has no closing bracket or fixed columns
+        if (cli.records.format == RecordOutput::Format::CSV) {
+            throw std::runtime_error(std::string(cli.watch_mode ? "--watch" : "--monitor-alerts") +
+                                     " writes NDJSON, not csv");
+        }
+        cli.watch.ndjson = true;
+        cli.headless = false;
+    }
+    return cli;
+}
+
+// Flags win over values loaded from the configuration file
+void CommandLine::apply_overrides() const {
+    if (cache_size_mb > 0) Config::CACHE_SIZE_MB = cache_size_mb;
+    if (max_stale_minutes >= 0) Config::MAX_STALE_MINUTES = max_stale_minutes;
+    if (refresh_top_keys >= 0) Config::REFRESH_TOP_KEYS = refresh_top_keys;
+    if (coord_precision >= 0) Config::COORD_PRECISION = coord_precision;
+    if (reuse_radius_km >= 0) Config::REUSE_RADIUS_KM = reuse_radius_km;
+    if (reuse_max_age_minutes >= 0) Config::REUSE_MAX_AGE_MINUTES = reuse_max_age_minutes;
+    if (!base_url.empty()) Config::set_base_url(base_url);
+    Metrics::print_on_exit = show_stats;
+    Metrics::export_path = metrics_file;
+}
+
+void CommandLine::print_usage(const char* program) {
+    std::cout << "Usage: " << program << " [options] [location]\n"
+              << "\n"
+              << "Without arguments an interactive menu is started. A location\n"
+              << "performs a quick lookup before entering the menu.\n"
+              << "\n"
+              << "Options:\n"
+              << "  -h, --help           Show this help and exit\n"
+              << "  -v, --version        Show version information and exit\n"
+              << "  --batch <file>       Look up every location in <file> (one per line, '-' for stdin)\n"
+              << "  --concurrency <n>    Maximum parallel requests in batch modes (default 16, 4 for --watch)\n"
+              << "  --ordered            Print batch results in input order instead of as completed\n"
+              << "  --ip-batch <file>    Geolocate each distinct IP in <file> ('-' for stdin; the first\n"
+              << "                       field of each line, so access logs work as-is) as NDJSON\n"
+              << "  --collapse           With --ip-batch, look up one address per IPv4 /24 or IPv6 /48\n"
+              << "  --with-weather       With --ip-batch, add current weather, fetched once per city\n"
+              << "  --watch <file>       Keep the current weather of each location in <file> ('-' for\n"
+              << "                       stdin) up to date: a live table, or NDJSON patches when piped\n"
+              << "  --interval <s>       Seconds between refreshes of each watched location (default 300),\n"
+              << "                       or between --monitor-alerts checks (default: check once)\n"
+              << "  --monitor-alerts <file>\n"
+              << "                       Report alerts for the locations in <file> that are new, updated\n"
+              << "                       or expired since the last check, as NDJSON\n"
+              << "  --alert-state <file> Where --monitor-alerts remembers seen alerts\n"
+              << "                       (default alerts.json in the cache directory)\n"
+              << "  --export <file>      Write --query records (default: 7-day forecast) for every location\n"
+              << "                       in <file> to --output as csv (default), ndjson or columnar\n"
+              << "  --output <file>      Destination of --export ('-' for stdout)\n"
+              << "  --resume             Continue an interrupted --export where it stopped\n"
+              << "  --cache-size <mb>    Memory budget for the in-process response cache (default 64)\n"
+              << "  --max-stale <min>    Serve expired entries up to <min> minutes while refreshing (default 30)\n"
+              << "  --refresh-top <n>    Proactively refresh the <n> most used entries before they expire\n"
+              << "  --coord-precision <n>\n"
+              << "                       Coordinate decimals that share a cache entry (default 2)\n"
+              << "  --reuse-radius <km>  Answer coordinates from a cached place this close (default 1, 0 = off)\n"
+              << "  --reuse-max-age <min>\n"
+              << "                       Oldest cached place a nearby query may reuse (default 5)\n"
+              << "  --base-url <url>     API root to query (default https://api.weatherapi.com/v1/,\n"
+              << "                       or $WEATHER_CLI_BASE_URL)\n"
+              << "  --no-disk-cache      Do not read or write the persistent response cache\n"
+              << "  --compact-cache      Remove expired entries from the persistent cache and exit\n"
+              << "  --stats              Print per-stage latency and cache/HTTP counters to stderr on exit\n"
+              << "  --metrics-file <f>   Write the same metrics in Prometheus text format to <f> on exit\n"
+              << "                       (with --serve: rewritten every 15s)\n"
+              << "\n"
+              << "Scripting (no banner, colors, animations or prompts):\n"
+              << "  --format <fmt>       Print records as json, ndjson or csv and exit\n"
+              << "  --no-tty             Same as --format json unless a format is given\n"
+              << "  --query <kind>       current (default), forecast, hourly, aqi, alerts or ip\n"
+              << "  --days <n>           Days to fetch for forecast and hourly queries\n"
+              << "  Without a location, one location (or IP) per stdin line is looked up.\n"
+              << "\n"
+              << "Daemon:\n"
+              << "  --serve[=<path>]     Answer lookups for other invocations over a Unix socket\n"
+              << "  --socket <path>      Socket to serve on or connect to\n"
+              << "                       (default $WEATHER_CLI_SOCKET, then $XDG_RUNTIME_DIR/weather-cli.sock)\n"
+              << "  --no-daemon          Look up locally even when a daemon is running\n"
+              << "  Scripting lookups go through a running daemon automatically.\n";
 }
 
 // Enhanced main function with error handling
+#ifndef WEATHER_CLI_NO_MAIN
 int main(int argc, char* argv[]) {
     try {
+        CommandLine cli;
+        try {
+            cli = CommandLine::parse(argc, argv);
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            CommandLine::print_usage(argv[0]);
+            return 2;
+        }
+
+        if (cli.show_help) {
+            CommandLine::print_usage(argv[0]);
+            return 0;
+        }
+        if (cli.show_version) {
+            std::cout << "Weather CLI Pro " << VERSION << std::endl;
+            return 0;
+        }
+
         WeatherApp app;
         app.initialize();
+        cli.apply_overrides();
+
+        if (cli.headless && cli.use_daemon &&
+            DaemonClient::connect(cli.socket_path.empty() ? DaemonClient::default_socket_path(false) : cli.socket_path)) {
+            // Thin client: the daemon already holds a warm cache and connections
+            if (!cli.location.empty()) cli.records.targets.push_back(cli.location);
+            int status = RecordOutput::run(cli.records);
+            DaemonClient::disconnect();
+            Metrics::finish();
+            Logger::shutdown();
+            return status;
+        }
+
+        app.start_services();
+
+        if (cli.serve) {
+            int status = WeatherDaemon::serve(cli.socket_path.empty() ? DaemonClient::default_socket_path(true)
+                                                                      : cli.socket_path);
+            app.cleanup();
+            return status;
+        }
+        
+        if (cli.compact_cache) {
+            // Keep entries that may still be served stale
+            auto max_age = std::chrono::duration_cast<std::chrono::seconds>(HttpClient::retention());
+            size_t removed = DiskCache::compact(max_age);
+            size_t aliases = LocationKeys::compact();
+            std::cout << "Removed " << removed << " expired entries from " << DiskCache::directory()
+                      << " (" << aliases << " location aliases kept)" << std::endl;
+            app.cleanup();
+            return 0;
+        }
+
+        if (cli.batch_mode) {
+            int status = BatchProcessor::run(cli.batch);
+            app.cleanup();
+            return status;
+        }
+
+        if (cli.ip_batch_mode) {
+            int status = IpBatchProcessor::run(cli.ip_batch);
+            app.cleanup();
+            return status;
+        }
+
+        if (cli.watch_mode) {
+            int status = WeatherWatch::run(cli.watch);
+            app.cleanup();
+            return status;
+        }
+
+        if (cli.alert_mode) {
+            int status = AlertMonitor::run(cli.alerts);
+            app.cleanup();
+            return status;
+        }
+
+        if (cli.export_mode) {
+            int status = BulkExporter::run(cli.exporter);
+            app.cleanup();
+            return status;
+        }
+
+        if (cli.headless) {
+            if (!cli.location.empty()) cli.records.targets.push_back(cli.location);
+            int status = RecordOutput::run(cli.records);
+            app.cleanup();
+            return status;
+        }
+        
+        // Interactive screens are composed in memory and written once each
+        Frame::install();
         
         // Command line argument support
-        if (argc > 1) {
-            std::string location;
-            for (int i = 1; i < argc; ++i) {
-                if (i > 1) location += " ";
-                location += argv[i];
-            }
+        if (!cli.location.empty()) {
+            const std::string& location = cli.location;
             
             // Quick weather lookup from command line
             Display::clear_screen();
@@ -1257,11 +7938,12 @@ int main(int argc, char* argv[]) {
         
     } catch (const std::exception& e) {
         std::cerr << Colors::RED << "Fatal error: " << e.what() << Colors::RESET << std::endl;
-        Logger::error("Fatal error: " + std::string(e.what()));
+        LOG_ERROR("Fatal error: " + std::string(e.what()));
         return 1;
     } catch (...) {
         std::cerr << Colors::RED << "Unknown fatal error occurred" << Colors::RESET << std::endl;
-        Logger::error("Unknown fatal error occurred");
+        LOG_ERROR("Unknown fatal error occurred");
         return 1;
     }
 }
+#endif